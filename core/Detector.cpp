@@ -1,23 +1,53 @@
 #include "Detector.hpp"
 #include "../include/coin_detector.hpp"
 
-Detector::Detector() = default;
+Detector::Detector()
+    : Detector(CoinDetector::Params{}) {}
 
-std::vector<Detection> Detector::run(const cv::Mat& image) {
+Detector::Detector(const CoinDetector::Params& params)
+    : detector_(std::make_shared<const CoinDetector>(params)) {}
+
+void Detector::setParams(const CoinDetector::Params& params) {
+    detector_.store(std::make_shared<const CoinDetector>(params));
+}
+
+CoinDetector::Params Detector::params() const {
+    return detector_.load()->params();
+}
+
+void Detector::setClassifier(std::shared_ptr<const CoinClassifier> classifier) {
+    classifier_.store(std::move(classifier));
+}
+
+std::shared_ptr<const CoinClassifier> Detector::classifier() const {
+    return classifier_.load();
+}
+
+std::vector<Detection> Detector::run(const cv::Mat& image) const {
+    if (image.empty())
+        return {};
+    return run(ImageView::fromMat(image));
+}
+
+std::vector<Detection> Detector::run(const ImageView& image) const {
     std::vector<Detection> out;
     if (image.empty())
         return out;
 
     cv::Mat gray;
-    if (image.channels() == 3)
-        cv::cvtColor(image, gray, cv::COLOR_BGR2GRAY);
-    else
-        gray = image;
+    toGray(image, gray);
+
+    // keeps this call's detector alive across a concurrent setParams()
+    auto detector = detector_.load();
+    auto circles = detector->detect(gray);
 
-    CoinDetector detector;
-    auto circles = detector.detect(gray);
+    // classified from the caller's pixels, sampled in place
+    std::vector<int> classIds;
+    if (auto classifier = classifier_.load(); classifier && !classifier->empty())
+        classIds = classifier->classify(image, circles);
 
-    for (const auto& c : circles) {
+    for (size_t i = 0; i < circles.size(); ++i) {
+        const auto& c = circles[i];
         Detection d;
         d.bbox = cv::Rect(
             int(c.center.x - c.radius),
@@ -25,7 +55,9 @@ std::vector<Detection> Detector::run(const cv::Mat& image) {
             int(2 * c.radius),
             int(2 * c.radius)
         );
-        d.class_id = 0;
+        d.center = c.center;
+        d.radius = c.radius;
+        d.class_id = classIds.empty() ? -1 : classIds[i];
         d.confidence = c.score;
         out.push_back(d);
     }
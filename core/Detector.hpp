@@ -1,16 +1,45 @@
 #pragma once
 #include <opencv2/core.hpp>
+#include <memory>
 #include <vector>
+#include "atomic_shared.hpp"
+#include "coin_classifier.hpp"
+#include "coin_detector.hpp"
+#include "image_view.hpp"
 
 
 struct Detection {
-    cv::Rect bbox;
-    int class_id;
+    cv::Rect bbox;         // integer bounds of the circle, for display
+    cv::Point2f center;    // sub-pixel circle; use these for geometry
+    float radius;
+    int class_id;          // index into the classifier's classes; -1 without one
     float confidence;
 };
 
 class Detector {
 public:
     Detector();
-    std::vector<Detection> run(const cv::Mat& image);
+    explicit Detector(const CoinDetector::Params& params);
+
+    // Thread-safe: the detector is built once and shared by callers.
+    // `image` is gray, BGR or BGRA.
+    std::vector<Detection> run(const cv::Mat& image) const;
+    // Same for pixels in any ImageView format; they are read once while
+    // converting to gray and never copied as color.
+    std::vector<Detection> run(const ImageView& image) const;
+
+    // Swaps in a detector built from `params`. Calls already running
+    // finish with the detector they started with; later calls use the
+    // new one. Safe to call while other threads are in run().
+    void setParams(const CoinDetector::Params& params);
+    CoinDetector::Params params() const;
+
+    // Classifier that fills Detection::class_id (null: all -1). Can be
+    // swapped while other threads are in run(), like setParams().
+    void setClassifier(std::shared_ptr<const CoinClassifier> classifier);
+    std::shared_ptr<const CoinClassifier> classifier() const;
+
+private:
+    AtomicShared<const CoinDetector> detector_;
+    AtomicShared<const CoinClassifier> classifier_;
 };
@@ -0,0 +1,36 @@
+#pragma once
+#include <memory>
+#include <mutex>
+#include <utility>
+
+// A shared_ptr that threads load and replace concurrently, in place of
+// std::atomic<std::shared_ptr<T>> (missing from libc++ and older
+// libstdc++). The lock is only held while the pointer itself is copied
+// or swapped, never while the object is used, and a replaced object is
+// released outside of it.
+template <typename T>
+class AtomicShared {
+public:
+    AtomicShared() = default;
+    explicit AtomicShared(std::shared_ptr<T> p) : ptr_(std::move(p)) {}
+
+    AtomicShared(const AtomicShared&) = delete;
+    AtomicShared& operator=(const AtomicShared&) = delete;
+
+    std::shared_ptr<T> load() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return ptr_;
+    }
+
+    void store(std::shared_ptr<T> p) {
+        std::shared_ptr<T> old;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            old = std::exchange(ptr_, std::move(p));
+        }
+    }
+
+private:
+    mutable std::mutex mutex_;
+    std::shared_ptr<T> ptr_;
+};
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+#include <cstdint>
+#include <vector>
+
+// In-house gradient Hough transform for circles, used by CoinDetector as
+// an alternative to cv::HoughCircles(HOUGH_GRADIENT).
+//
+// 1. Sobel gradients of the (already blurred) 8-bit image; pixels whose
+//    L1 gradient magnitude passes edgeThreshold and is a local maximum
+//    across the edge become edge points.
+// 2. Every edge point votes for centers along its gradient line, in both
+//    directions, for each radius in [minRadius, maxRadius].
+// 3. Accumulator peaks with at least voteThreshold votes, at least
+//    minDist apart, become centers; each center's radius is the peak of
+//    a histogram of distances to nearby edge points.
+//
+// The accumulator is stored in 4x4 blocks of int32 (one 64-byte cache
+// line per block) so the short runs of votes along a gradient line stay
+// within a few cache lines. Vote addresses are computed eight (AVX2) or
+// four (SSE4.1) radii at a time with a scalar fallback; the path is
+// chosen at runtime. All paths cast identical votes; setSimd() pins one
+// so they can be compared (coins_bench --verify-simd).
+//
+// An instance keeps all its scratch buffers between calls; use one per
+// thread.
+class CircleHough {
+public:
+    struct Params {
+        double dp = 1.0;          // accumulator resolution divisor
+        int minDist = 20;         // min distance between centers (pixels)
+        int edgeThreshold = 100;  // min |dx|+|dy| of an edge point
+        int voteThreshold = 30;   // min center votes
+        int minRadius = 10;
+        int maxRadius = 100;
+    };
+
+    // Circles as (x, y, radius, votes), strongest first.
+    void detect(const cv::Mat& blurred,
+        const Params& p,
+        std::vector<cv::Vec4f>& circles);
+
+    enum class Simd { Auto, Scalar, SSE41, AVX2 };
+
+    // Instruction set used by the voting kernel on this machine.
+    static const char* simdPath();
+
+    // Pins this instance to one kernel set; false (and no change) if this
+    // build or CPU can't run it. Auto is the fastest available.
+    bool setSimd(Simd s);
+    // Instruction set this instance uses.
+    const char* path() const;
+
+    // Votes per accumulator cell (CV_32SC1, image size / dp) from the
+    // last detect(); empty if it found no edge points.
+    void accumulator(cv::Mat& votes) const;
+
+private:
+    struct EdgePoint {
+        float x, y;    // pixel position
+        float ux, uy;  // unit gradient direction
+    };
+
+    struct Peak {
+        int x, y;      // accumulator cell
+        int votes;
+    };
+
+    void collectEdges(const Params& p);
+    void vote(const Params& p);
+    void findPeaks(const Params& p);
+    float estimateRadius(float cx, float cy, const Params& p);
+
+    cv::Mat gx_, gy_, mag_;
+    std::vector<EdgePoint> edges_;
+    std::vector<int32_t> acc_;   // blocked accumulator + 1 discard slot
+    std::vector<int32_t> idx_;   // vote addresses for one edge point
+    std::vector<Peak> peaks_;
+    std::vector<float> hist_;
+    int accW_ = 0, accH_ = 0, blocksPerRow_ = 0;
+    Simd simd_ = Simd::Auto;
+};
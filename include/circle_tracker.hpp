@@ -0,0 +1,66 @@
+#pragma once
+#include "coin_detector.hpp"
+#include <vector>
+
+// Frame-to-frame circle tracker for video streams.
+//
+// Every fullScanInterval frames (and whenever nothing is confirmed) the
+// whole frame is detected. In between, only small ROIs around each
+// track's predicted position are searched, with the radius range
+// narrowed to that track. A track becomes confirmed after confirmHits
+// consecutive matches and is dropped after maxMisses frames without one.
+class CircleTracker {
+public:
+    struct Params {
+        int confirmHits = 3;        // matches before a track is reported
+        int maxMisses = 5;          // unmatched frames before a track is dropped
+        int fullScanInterval = 15;  // full-frame detection every N frames
+        float matchDist = 0.5f;     // max center jump, in track radii
+        float roiMargin = 0.5f;     // ROI border around the circle, in radii
+        float radiusSlack = 0.2f;   // ROI radius range: r * (1 +- slack)
+        float smoothing = 0.5f;     // weight of the new measurement
+    };
+
+    struct Track {
+        int id = 0;
+        cv::Point2f center;
+        cv::Point2f velocity;       // pixels per frame
+        float radius = 0.0f;
+        float score = 0.0f;
+        int hits = 0;
+        int misses = 0;
+        bool confirmed = false;
+    };
+
+    explicit CircleTracker(const CoinDetector& detector);
+    CircleTracker(const CoinDetector& detector, const Params& p);
+
+    // Uses `detector` from the next update() on; tracks are kept. The
+    // detector must outlive its use, as with the constructor argument.
+    void setDetector(const CoinDetector& detector);
+
+    // Detects circles in `gray` and updates the tracks.
+    void update(const cv::Mat& gray);
+
+    // All live tracks; report those with confirmed == true.
+    const std::vector<Track>& tracks() const { return tracks_; }
+    bool lastWasFullScan() const { return lastFullScan_; }
+    int frameCount() const { return frame_; }
+    int confirmedCount() const { return confirmedTotal_; }
+
+private:
+    void detectFull(const cv::Mat& gray);
+    void detectRois(const cv::Mat& gray);
+    void associate(bool spawn);
+
+    const CoinDetector* detector_;
+    Params params_;
+    DetectorWorkspace ws_;
+    std::vector<DetectedCircle> dets_;
+    std::vector<DetectedCircle> roiDets_;
+    std::vector<Track> tracks_;
+    int nextId_ = 1;
+    int frame_ = 0;
+    int confirmedTotal_ = 0;
+    bool lastFullScan_ = false;
+};
@@ -0,0 +1,81 @@
+#pragma once
+#include "coin_detector.hpp"
+#include "image_view.hpp"
+#include <opencv2/core.hpp>
+#include <string>
+#include <vector>
+
+// Denomination of detected coins, as a stage after detection.
+//
+// Features (kCoinFeatures floats per coin) are read from a fixed grid of
+// samples inside each circle, so their cost does not grow with the coin
+// size and no color conversion of the frame is needed:
+//
+//   0      radius relative to the median radius of the image's coins
+//   1-8    hue histogram, weighted by saturation
+//   9-14   saturation (3 bins) and value (3 bins) histograms
+//   15-17  ring minus center: saturation, value, chroma distance
+//          (tells bimetallic coins apart)
+//   18-19  texture: mean neighbour difference over mean brightness, and
+//          the spread of the value channel
+//
+// The features of all coins of an image form one matrix (a row per
+// coin) that the classifier scores in one pass.
+
+constexpr int kCoinFeatures = 20;
+
+// Fills `features` (circles.size() x kCoinFeatures, CV_32F). Gray views
+// give zero color features.
+void extractCoinFeatures(const ImageView& image,
+    const std::vector<DetectedCircle>& circles, cv::Mat& features);
+
+class CoinClassifier {
+public:
+    enum class Model {
+        NearestCentroid,    // class with the closest mean feature vector
+        Linear,             // one-vs-rest linear scores, highest wins
+    };
+
+    struct CoinClass {
+        std::string name;   // e.g. "50c"
+        double value = 0.0; // monetary value summed by total()
+    };
+
+    // Fits a model to `features` (one row per coin, CV_32F) with
+    // `labels[i]` an index into `classes`. Features are standardized
+    // first; Linear is a ridge least-squares fit.
+    static CoinClassifier train(const cv::Mat& features, const std::vector<int>& labels,
+        std::vector<CoinClass> classes, Model model = Model::NearestCentroid);
+
+    // OpenCV FileStorage (.yml/.json/.xml), like CoinDetector::Params.
+    bool load(const std::string& path);
+    bool save(const std::string& path) const;
+
+    bool empty() const { return classes_.empty(); }
+    Model model() const { return model_; }
+    const std::vector<CoinClass>& classes() const { return classes_; }
+
+    // One class index per feature row.
+    void classify(const cv::Mat& features, std::vector<int>& classIds) const;
+    // Extracts and classifies; one class index per circle.
+    std::vector<int> classify(const ImageView& image,
+        const std::vector<DetectedCircle>& circles) const;
+
+    // Sum of the class values; ids < 0 count as nothing.
+    double total(const std::vector<int>& classIds) const;
+
+private:
+    // both models reduce to scores = z * weights_^T + bias_, z being the
+    // standardized features: for centroids weights = 2c, bias = -|c|^2
+    void prepare();
+    void standardize(const float* f, float* z) const;
+
+    Model model_ = Model::NearestCentroid;
+    std::vector<CoinClass> classes_;
+    cv::Mat mean_;          // 1 x kCoinFeatures
+    cv::Mat invStd_;        // 1 x kCoinFeatures
+    cv::Mat params_;        // centroids or linear weights (K x kCoinFeatures)
+    cv::Mat linearBias_;    // Linear only: K x 1
+    cv::Mat weights_;       // K x kCoinFeatures
+    cv::Mat bias_;          // 1 x K
+};
@@ -1,33 +1,203 @@
 #pragma once
 
 #include <opencv2/opencv.hpp>
+#include <string>
 #include <vector>
+#include "circle_hough.hpp"
+
+class ThreadPool;
 
 struct DetectedCircle {
     cv::Point2f center;
     float radius;
-    float score; // accumulator value or confidence
+    float score;         // edge support in [0, 1] (see CoinDetector::detect)
+    float votes = 0.0f;  // Hough accumulator votes of the center
+};
+
+// Detected circles plus the intermediate images a caller asked for
+// (see CoinDetector::Output); unrequested images are left empty.
+struct DetectionResult {
+    std::vector<DetectedCircle> circles;
+    cv::Rect area;     // part of the frame the images below cover
+    cv::Mat blurred;   // OutputBlurred
+    cv::Mat edges;     // OutputEdges
+    cv::Mat gradX;     // OutputGradient, CV_16S
+    cv::Mat gradY;     // OutputGradient, CV_16S
+};
+
+// Wall time of each detector stage during the last detect() call, in ms.
+// In pyramid mode the coarse resize and ROI blurs count as blur and the
+// ROI re-detections as hough.
+struct DetectorTimings {
+    double blur = 0.0;
+    double hough = 0.0;
+    double score = 0.0;  // edge support of every candidate
+    double nms = 0.0;
+    double refine = 0.0;  // sub-pixel circle fits
+};
+
+// Scratch buffers for CoinDetector::detect. Own one per thread (or per
+// camera stream) and pass it to every call: while the frame size stays
+// the same, detect() reuses them instead of allocating (the vectors only
+// grow; a Mat is reallocated when the size changes). OpenCV's
+// HoughCircles still allocates its own edge map and accumulators.
+class DetectorWorkspace {
+public:
+    cv::Mat blurred;
+    std::vector<cv::Vec4f> circles;        // x, y, r, votes
+    cv::Mat coarse;                        // pyramid mode: downscaled frame
+    cv::Mat roiBuffer;                     // pyramid mode: refine ROI blur
+    std::vector<cv::Vec4f> coarseCircles;  // pyramid mode: coarse hits
+    std::vector<cv::Vec4f> roiCircles;     // pyramid mode: per-ROI hits
+    CircleHough hough;                     // Backend::Gradient engine
+    std::vector<DetectedCircle> candidates;
+    std::vector<int> order;                // NMS: candidates by score
+    std::vector<int> gridHead, gridNext;   // NMS: kept circles per cell
+    cv::Mat roiMask;                       // Params::roiPolygon, rasterized
+    std::vector<cv::Point> roiMaskPolygon; // polygon roiMask was drawn from
+    DetectorTimings timings;               // stages of the last call
+    cv::Rect area;                         // part of the frame the last call processed
+
+    // Number of detect() calls on which any buffer above (or the output
+    // vector) was allocated or moved. Stays constant for a fixed frame
+    // size. Says nothing about other heap allocations (OpenCV internals,
+    // tile tasks); coins_bench counts those.
+    size_t workspaceGrowths() const { return growths_; }
+    size_t calls() const { return calls_; }
+
+private:
+    friend class CoinDetector;
+    size_t growths_ = 0;
+    size_t calls_ = 0;
 };
 
 class CoinDetector {
 public:
+    // Circle Hough transform used by detect(). Gradient is experimental
+    // and only selectable in coins_bench: at the recall of OpenCV it is
+    // no faster and far less precise on the bundled sets.
+    enum class Backend {
+        OpenCV,    // cv::HoughCircles(HOUGH_GRADIENT)
+        Gradient,  // in-house CircleHough (circle_hough.hpp)
+    };
+
     struct Params {
         int gaussKernel = 9;
         double gaussSigma = 2.0;
-        int cannyLow = 100;
-        int cannyHigh = 200;
-        int houghDp = 1.1;
+        int cannyLow = 100;    // only used for OutputEdges
+        int cannyHigh = 200;   // only used for OutputEdges
+        double houghDp = 1.0;  // accumulator resolution divisor (> 1 = coarser)
         int houghMinDist = 47;
         int houghParam1 = 200; // Canny high threshold (internal)
         int houghParam2 = 32;  // accumulator threshold
         int minRadius = 10;
         int maxRadius = 200;
+
+        // Coarse-to-fine mode: Hough runs on the frame downscaled by
+        // 2^pyramidLevels, then each hit is re-detected at full
+        // resolution in a small ROI (radius +- scale + refineMargin).
+        int pyramidLevels = 0; // 0 = off (full-resolution Hough)
+        int refineMargin = 3;
+
+        // Sub-pixel refinement: a least-squares circle fit to the strong,
+        // radially oriented edge points within +-subpixelBand pixels of
+        // each detected circle.
+        bool subpixel = true;
+        int subpixelBand = 3;
+
+        Backend backend = Backend::OpenCV;
+
+        // Fixed search region in frame pixels, e.g. the counting tray of
+        // a mounted camera: a rectangle and/or a polygon (empty = whole
+        // frame). Combined with the mask passed to detect(), if any.
+        cv::Rect roi;
+        std::vector<cv::Point> roiPolygon;
+
+        // detectTiled(): edge of the square tiles the frame is split
+        // into (<= 0: 1024). Each tile is processed with maxRadius plus
+        // the blur support of overlap on every side.
+        int tileSize = 0;
+
+        // cv::FileStorage (.yml/.yaml, .json or .xml, by extension), one
+        // key per field above (roi as [x, y, w, h], roiPolygon as
+        // [x0, y0, x1, y1, ..]); backend can only be "opencv". Keys
+        // missing from the file keep their current value. Both return
+        // false if the file can't be opened or parsed; a failed load
+        // leaves every field as it was.
+        bool load(const std::string& path);
+        bool save(const std::string& path) const;
+
+        // The same detector for a frame downscaled by `factor` (>= 1):
+        // lengths, the search region and the tile size shrink by
+        // `factor`, the Hough vote threshold with them (votes grow with
+        // the circumference), and pyramidLevels drops by log2(factor).
+        Params scaledDown(int factor) const;
+    };
+
+    // Debug/visualization outputs, combined as a bit mask.
+    enum Output : unsigned {
+        OutputNone = 0,
+        OutputBlurred = 1u << 0,
+        OutputEdges = 1u << 1,     // Canny(cannyLow, cannyHigh) of blurred
+        OutputGradient = 1u << 2,  // Sobel dx/dy of blurred
     };
 
     //CoinDetector(const Params& p = Params());
     CoinDetector();                      // конструктор по умолчанию
     explicit CoinDetector(const Params& p);  // конструктор с параметрами
+    const Params& params() const { return params_; }
+    // Each circle is scored by edge support: the fraction of points
+    // sampled on its circumference where the blurred image has a strong
+    // gradient (|dx|+|dy| >= houghParam1/2) pointing along the radius,
+    // all with the same polarity. Overlapping circles (centers closer
+    // than half the smaller radius) are then suppressed in score order.
+    //
+    // With a search region (Params::roi, Params::roiPolygon or a `mask`:
+    // CV_8UC1, frame size, nonzero = allowed) blur and Hough run only on
+    // its bounding rectangle, and Hough candidates whose center is
+    // outside the region are dropped before they are scored.
+    //
+    // Uses a workspace private to the calling thread.
     std::vector<DetectedCircle> detect(const cv::Mat& imgGray) const;
+    std::vector<DetectedCircle> detect(const cv::Mat& imgGray, const cv::Mat& mask) const;
+    // Fills `out` (cleared first) using caller-owned scratch buffers.
+    void detect(const cv::Mat& imgGray,
+        DetectorWorkspace& ws,
+        std::vector<DetectedCircle>& out) const;
+    void detect(const cv::Mat& imgGray,
+        const cv::Mat& mask,
+        DetectorWorkspace& ws,
+        std::vector<DetectedCircle>& out) const;
+    // Same as above, and also computes the requested `outputs` into `res`
+    // (in pyramid mode they are taken from the coarse level; with a
+    // search region they cover only res.area).
+    void detect(const cv::Mat& imgGray,
+        DetectorWorkspace& ws,
+        DetectionResult& res,
+        unsigned outputs,
+        const cv::Mat& mask = cv::Mat()) const;
+    // For frames far larger than a coin (scans of whole collections):
+    // splits the frame into Params::tileSize tiles, detects each tile
+    // on `pool` with a per-thread workspace, keeps the circles centered
+    // in each tile's own (non-overlapping) part and applies houghMinDist
+    // (more votes wins) and the overlap rule of detect() across tile
+    // borders. HoughCircles still sees only its tile, so a weak circle
+    // can come out with another radius or not at all. A frame that fits
+    // in one tile is detected directly.
+    // `ws` receives the stage timings, summed over tiles. Must not be
+    // called from a task running on `pool`.
+    void detectTiled(const cv::Mat& imgGray,
+        const cv::Mat& mask,
+        ThreadPool& pool,
+        DetectorWorkspace& ws,
+        std::vector<DetectedCircle>& out) const;
+    // Skips the blur: `blurred` must already be the GaussianBlur of the
+    // frame with gaussKernel/gaussSigma (lets callers that try many
+    // Hough settings share one blur). Ignores pyramidLevels; applies
+    // Params::roi and roiPolygon.
+    void detectBlurred(const cv::Mat& blurred,
+        DetectorWorkspace& ws,
+        std::vector<DetectedCircle>& out) const;
 
 private:
     Params params_;
@@ -0,0 +1,121 @@
+#pragma once
+#include "label_io.hpp"
+#include "mapped_file.hpp"
+#include <opencv2/core.hpp>
+#include <cstdint>
+#include <cstdio>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// A dataset packed into one file for repeated evaluation runs: every
+// image as a pre-decoded 8-bit gray plane, its labels in one fixed-layout
+// circle table, and an index. Opening it maps the file; a raw plane is
+// handed out as a cv::Mat over the mapping, so reading an image costs
+// no decode and no copy. Planes may instead be stored PNG-compressed
+// (smaller file, a lossless decode per read).
+//
+// Layout (host byte order: a pack is a local cache, not an exchange
+// format):
+//
+//   PackHeader | planes, each 64-byte aligned | circle table
+//   (LabelCircle[]) | names (UTF-8, not terminated) | PackEntry[]
+//
+// Write with DatasetPackWriter, read with DatasetPack.
+
+struct PackHeader {
+    char magic[8];              // "COINPACK"
+    uint32_t version;
+    uint32_t count;             // images
+    uint64_t indexOffset;       // PackEntry[count]
+    uint64_t circlesOffset;     // LabelCircle[circleCount]
+    uint64_t circleCount;
+    uint64_t namesOffset;
+    uint64_t namesSize;
+    uint64_t reserved;
+};
+
+struct PackEntry {
+    enum Flags : uint32_t {
+        Compressed = 1,         // plane is a PNG stream
+        HasLabels = 2,          // a label file was found (may hold 0 circles)
+    };
+
+    uint64_t offset;            // plane bytes
+    uint64_t size;
+    uint32_t width;
+    uint32_t height;
+    uint32_t stride;            // bytes per row of a raw plane
+    uint32_t flags;
+    uint32_t firstCircle;       // range in the circle table
+    uint32_t circleCount;
+    uint32_t nameOffset;        // range in the names block
+    uint32_t nameSize;
+};
+
+static_assert(sizeof(PackHeader) == 64, "PackHeader layout");
+static_assert(sizeof(PackEntry) == 48, "PackEntry layout");
+static_assert(sizeof(LabelCircle) == 16, "LabelCircle layout");
+
+class DatasetPackWriter {
+public:
+    DatasetPackWriter() = default;
+    ~DatasetPackWriter();
+
+    DatasetPackWriter(const DatasetPackWriter&) = delete;
+    DatasetPackWriter& operator=(const DatasetPackWriter&) = delete;
+
+    bool open(const std::string& path, bool compress = false);
+    // `gray` must be CV_8UC1. `labels` null: the image has no labels.
+    bool add(const std::string& name, const cv::Mat& gray,
+        const std::vector<LabelCircle>* labels);
+    // Writes the circle table, the names and the index, then the header.
+    // A pack without a successful finish() is rejected by DatasetPack.
+    bool finish();
+
+    size_t count() const { return entries_.size(); }
+    uint64_t bytes() const { return pos_; }
+
+private:
+    bool write(const void* data, size_t size);
+    bool pad();
+
+    std::FILE* f_ = nullptr;
+    bool compress_ = false;
+    uint64_t pos_ = 0;
+    std::vector<PackEntry> entries_;
+    std::vector<LabelCircle> circles_;
+    std::string names_;
+    std::vector<unsigned char> encoded_;   // reused PNG buffer
+};
+
+class DatasetPack {
+public:
+    // Checks the header and that every table and plane lies inside the
+    // file; false (with nothing open) otherwise.
+    bool open(const std::string& path);
+    void close();
+    bool isOpen() const { return header_ != nullptr; }
+
+    // By extension (.pack); does not open the file.
+    static bool isPackPath(const std::string& path);
+
+    size_t size() const { return header_ ? header_->count : 0; }
+    std::string_view name(size_t i) const;
+
+    // Raw planes: a read-only view of the mapping, valid while the pack
+    // is open; never write into it. Compressed planes: a decoded copy.
+    cv::Mat gray(size_t i) const;
+
+    bool hasLabels(size_t i) const { return (entries_[i].flags & PackEntry::HasLabels) != 0; }
+    std::span<const LabelCircle> labels(size_t i) const;
+    std::vector<GTCircle> groundTruth(size_t i) const;
+
+private:
+    MappedFile file_;
+    const PackHeader* header_ = nullptr;
+    const PackEntry* entries_ = nullptr;
+    const LabelCircle* circles_ = nullptr;
+    const char* names_ = nullptr;
+};
@@ -1,5 +1,6 @@
 #pragma once
 #include "coin_detector.hpp"
+#include <cstdint>
 #include <vector>
 #include <string>
 
@@ -20,11 +21,27 @@ struct EvalResult {
     }
 };
 
+// Area of the intersection of two circles over the area of their union,
+// in [0, 1].
+float circleIoU(cv::Point2f c1, float r1, cv::Point2f c2, float r2);
+
 class Evaluator {
 public:
+    enum class Matching {
+        Greedy,     // detections by descending score take their best free GT
+        Optimal,    // maximum number of matches, then best total quality
+    };
+
     // match_tol: maximum center distance (in pixels) to be considered a match
     // radius_tol: relative tolerance (fraction) for radius difference (e.g. 0.3 => 30%)
     Evaluator(float match_tol = 20.0f, float radius_tol = 0.4f);
+
+    // iou > 0 replaces the distance/radius tolerances: a detection and a
+    // GT circle can match when their circleIoU is at least `iou`.
+    void setIoU(float iou) { iou_ = iou; }
+    void setMatching(Matching m) { matching_ = m; }
+
+    // The result does not depend on the order of `dets` or `gts`.
     EvalResult evaluate(
         const std::vector<DetectedCircle>& dets, 
         const std::vector<GTCircle>& gts
@@ -33,4 +50,46 @@ public:
 private:
     float match_tol_;
     float radius_tol_;
+    float iou_ = 0.0f;
+    Matching matching_ = Matching::Greedy;
+};
+
+// Precision/recall over detection scores for one IoU threshold.
+struct PRCurve {
+    float iou = 0.0f;
+    double ap = 0.0;                // 101-point interpolated, as in COCO
+    std::vector<float> score;       // descending; one point per detection
+    std::vector<float> precision;
+    std::vector<float> recall;
+};
+
+// Collects detections of many images and computes precision-recall
+// curves and AP at several IoU thresholds. add() finds the overlapping
+// pairs of an image once (via a grid over the GT circles) and matches
+// them per threshold; curves() sorts all detections by score once and
+// sweeps every threshold in the same pass.
+class APAccumulator {
+public:
+    // Default thresholds: 0.50, 0.55, .. 0.95.
+    explicit APAccumulator(std::vector<float> ious = {},
+        Evaluator::Matching matching = Evaluator::Matching::Greedy);
+
+    void add(const std::vector<DetectedCircle>& dets, const std::vector<GTCircle>& gts);
+    void merge(const APAccumulator& other);
+
+    // With `points` false only iou and ap are filled.
+    std::vector<PRCurve> curves(bool points = false) const;
+    // Mean AP over the thresholds.
+    double meanAP() const;
+
+    const std::vector<float>& ious() const { return ious_; }
+    size_t detections() const { return scores_.size(); }
+    size_t groundTruth() const { return num_gt_; }
+
+private:
+    std::vector<float> ious_;
+    Evaluator::Matching matching_;
+    std::vector<float> scores_;                 // every detection added
+    std::vector<std::vector<uint8_t>> tp_;      // [threshold][detection]
+    size_t num_gt_ = 0;
 };
@@ -0,0 +1,41 @@
+#pragma once
+#include "coin_detector.hpp"
+#include <opencv2/core.hpp>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Decoding of frames for detection. Detection only needs one gray
+// plane, so frames are decoded straight to it: a color JPEG decodes just
+// its luma and no BGR frame (three full-resolution planes) is ever
+// allocated.
+//
+// `reduce` (1, 2, 4 or 8) decodes at that fraction of the resolution
+// per axis. For JPEG libjpeg scales during the inverse DCT, so the
+// full-resolution frame never exists either; other formats are decoded
+// and then shrunk by OpenCV. Circles found on a reduced frame go back to
+// full-resolution coordinates with toFullResolution(), and the detector
+// for it comes from Params::scaledDown(reduce).
+//
+// Files are memory-mapped and decoded from the mapping, so the
+// compressed bytes are not copied to the heap and names outside the
+// ANSI code page open on Windows as well.
+
+// 1, 2, 4 or 8: the largest supported factor not above `factor`.
+int supportedReduction(int factor);
+
+// Empty if the file can't be opened or decoded.
+cv::Mat readGray(const std::string& path, int reduce = 1);
+// Encoded image bytes (any format cv::imdecode knows), e.g. a request
+// payload or a frame from a stream. Empty if they can't be decoded.
+cv::Mat decodeGray(const void* data, size_t size, int reduce = 1);
+cv::Mat decodeGray(const std::vector<uchar>& bytes, int reduce = 1);
+
+// For the stages that need color (e.g. the coin classifier): BGR at full
+// resolution, read the same way. Empty on failure.
+cv::Mat readColor(const std::string& path);
+
+// Maps circles detected on a frame reduced by `factor` to the
+// full-resolution frame: pixel centers scale about the pixel corner
+// ((x + 0.5) * factor - 0.5), radii by `factor`.
+void toFullResolution(std::vector<DetectedCircle>& circles, int factor);
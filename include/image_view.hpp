@@ -0,0 +1,30 @@
+#pragma once
+#include <opencv2/core.hpp>
+#include <cstddef>
+
+// Read-only view of an interleaved 8-bit image whose pixels belong to
+// someone else (a wxImage, a camera buffer, a decoded cv::Mat). Nothing
+// is copied until toGray() produces the frame the detector works on.
+struct ImageView {
+    enum class Format { Gray, BGR, RGB, BGRA, RGBA };
+
+    const unsigned char* data = nullptr;
+    int width = 0;
+    int height = 0;
+    size_t stride = 0;  // bytes per row; 0 = tightly packed
+    Format format = Format::BGR;
+
+    // Gray, BGR or BGRA by channel count; `m` must be 8-bit.
+    static ImageView fromMat(const cv::Mat& m);
+
+    int channels() const;
+    bool empty() const { return !data || width <= 0 || height <= 0; }
+    // Mat header over the same pixels.
+    cv::Mat mat() const;
+};
+
+// Writes the 8-bit grayscale version of `src` to `dst` in a single pass
+// over the source pixels, whatever the channel order (no intermediate
+// BGR copy). A Gray view is wrapped, not copied, so `dst` then borrows
+// the caller's pixels.
+void toGray(const ImageView& src, cv::Mat& dst);
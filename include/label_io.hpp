@@ -0,0 +1,95 @@
+#pragma once
+#include "evaluator.hpp"
+#include <string>
+#include <string_view>
+#include <vector>
+
+// The one place label files are read and written. Every tool stores
+// circles in one of three formats, one circle per record:
+//
+//   Txt   "cx cy r [score]" per line, whitespace separated. Lines may
+//         also be key=value ("x=.. y=.. radius=..", "0: cx=.. cy=.. r=..
+//         score=.."); '#' starts a comment; other lines are skipped.
+//   Csv   "cx,cy,r[,score]" per line (',' ';' or tab). An optional
+//         header row names the columns (x/cx, y/cy, r/radius,
+//         score/confidence), in any order; other columns are skipped.
+//         A header that doesn't name x, y and r fails the file.
+//   Json  an array of {"cx":..,"cy":..,"r":..[,"score":..]} objects (x,
+//         y and radius are accepted too) or of [cx, cy, r(, score)]
+//         arrays, at any depth (e.g. {"circles": [...]}).
+//
+// Reading memory-maps the file and parses numbers with std::from_chars,
+// so it neither copies the file nor goes through iostreams or locales.
+
+enum class LabelFormat { Auto, Txt, Csv, Json };
+
+struct LabelCircle {
+    float cx = 0.0f;
+    float cy = 0.0f;
+    float r = 0.0f;
+    float score = -1.0f;   // < 0: a ground truth label, not a detection
+};
+
+// Auto guesses the format from the content: '[' or '{' first is Json, a
+// ',' or ';' in the first data line is Csv, anything else Txt.
+LabelFormat detectLabelFormat(std::string_view text);
+// By extension (.txt, .csv, .json); Auto if unknown.
+LabelFormat labelFormatFor(const std::string& path);
+
+// Appends the circles found in `text` to `out`. Returns false (adding
+// nothing) for malformed Json or an unrecognised Csv header; other
+// unparsable Txt/Csv lines are skipped.
+bool parseLabels(std::string_view text, std::vector<LabelCircle>& out,
+    LabelFormat format = LabelFormat::Auto);
+
+// Replaces `out` with the labels in `path`. Returns false if the file
+// cannot be opened or parseLabels fails.
+bool readLabels(const std::string& path, std::vector<LabelCircle>& out,
+    LabelFormat format = LabelFormat::Auto);
+
+// Label file of an image, the first that exists of <stem>_labels.txt
+// (written by the label editor), <stem>.txt, <stem>.csv and
+// <stem>.json. Empty if there is none.
+std::string findLabelsFor(const std::string& imagePath);
+
+// Ground truth as the Evaluator wants it; empty if `path` is empty or
+// unreadable.
+std::vector<GTCircle> readGroundTruth(const std::string& path);
+
+std::vector<GTCircle> toGroundTruth(const std::vector<LabelCircle>& labels);
+std::vector<LabelCircle> toLabels(const std::vector<DetectedCircle>& dets);
+
+// Formats circles into an internal buffer that keeps its capacity
+// between clear() calls, so writing many files reuses one allocation.
+// Numbers go through std::to_chars (shortest round-trip form).
+class LabelWriter {
+public:
+    explicit LabelWriter(LabelFormat format = LabelFormat::Txt);
+
+    // Auto keeps the current format.
+    void clear(LabelFormat format = LabelFormat::Auto);
+    // score is written only for detections (score >= 0).
+    void add(const LabelCircle& c);
+    void add(const std::vector<LabelCircle>& circles);
+    // "# text" line; Txt only, ignored for the other formats.
+    void comment(std::string_view text);
+
+    // The formatted file contents.
+    std::string_view str();
+    // Writes <path>.tmp and renames it over `path`, so the file is
+    // replaced as a whole. False if either step fails.
+    bool writeTo(const std::string& path);
+
+private:
+    void number(float v);
+    void finish();
+
+    LabelFormat format_;
+    std::string buf_;
+    size_t count_ = 0;
+    bool finished_ = false;
+};
+
+// One-shot helper: the format follows the extension, Txt if unknown.
+bool writeLabels(const std::string& path, const std::vector<LabelCircle>& circles,
+    LabelFormat format = LabelFormat::Auto);
@@ -0,0 +1,55 @@
+#pragma once
+#include "coin_detector.hpp"
+#include <chrono>
+#include <condition_variable>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Polls a CoinDetector::Params file (see Params::load) from a background
+// thread and calls onChange with the new params whenever the file's
+// timestamp or size changes and it parses. Each reload starts from
+// `base`, the params the program started with (the startup file over
+// the defaults, then any command-line overrides), so deleting a key
+// reverts that field to its startup value, not to the default. A file
+// that fails to parse is reported once on stderr and the previous
+// params stay in effect.
+//
+// onChange runs on the watcher thread; it should only publish the new
+// params (e.g. swap a snapshot), not wait for in-flight work.
+class ParamsWatcher {
+public:
+    using Callback = std::function<void(const CoinDetector::Params&)>;
+
+    ParamsWatcher(std::string path,
+        const CoinDetector::Params& base,
+        Callback onChange,
+        std::chrono::milliseconds interval = std::chrono::milliseconds(500));
+    ~ParamsWatcher();
+
+    ParamsWatcher(const ParamsWatcher&) = delete;
+    ParamsWatcher& operator=(const ParamsWatcher&) = delete;
+
+private:
+    struct Stamp {
+        std::filesystem::file_time_type time{};
+        std::uintmax_t size = 0;
+        bool operator==(const Stamp& o) const { return time == o.time && size == o.size; }
+    };
+
+    bool stamp(Stamp& s) const;
+    void run();
+
+    std::string path_;
+    CoinDetector::Params base_;
+    Callback onChange_;
+    std::chrono::milliseconds interval_;
+    Stamp loaded_, failed_;
+
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    bool stop_ = false;
+    std::thread thread_;
+};
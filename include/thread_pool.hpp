@@ -0,0 +1,51 @@
+#pragma once
+#include "bounded_queue.hpp"
+#include <functional>
+#include <future>
+#include <memory>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Fixed-size worker pool. Tasks wait in a BoundedQueue, so submit()
+// blocks once `queueCapacity` tasks are pending (backpressure instead of
+// unbounded memory growth). The destructor finishes queued tasks.
+class ThreadPool {
+public:
+    explicit ThreadPool(size_t threads, size_t queueCapacity = 0)
+        : tasks_(queueCapacity ? queueCapacity : 2 * (threads ? threads : 1)) {
+        if (threads == 0)
+            threads = 1;
+        workers_.reserve(threads);
+        for (size_t i = 0; i < threads; ++i) {
+            workers_.emplace_back([this] {
+                while (auto task = tasks_.pop())
+                    (*task)();
+            });
+        }
+    }
+
+    ~ThreadPool() {
+        tasks_.close();
+        for (auto& w : workers_)
+            w.join();
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    template <typename F>
+    auto submit(F&& fn) -> std::future<std::invoke_result_t<F>> {
+        using R = std::invoke_result_t<F>;
+        auto task = std::make_shared<std::packaged_task<R()>>(std::forward<F>(fn));
+        auto result = task->get_future();
+        tasks_.push([task] { (*task)(); });
+        return result;
+    }
+
+    size_t size() const { return workers_.size(); }
+
+private:
+    BoundedQueue<std::function<void()>> tasks_;
+    std::vector<std::thread> workers_;
+};
@@ -0,0 +1,57 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+# Runs coin_detector --batch on the bundled datasets with and without the
+# coarse-to-fine pyramid and prints F1 and wall time for both. Fails
+# (exit 1) if the pyramid loses more than TOL F1 on any dataset, or a
+# run reports no F1.
+# Nothing is written next to the images (--vis none, --results to a
+# temporary file). Extra arguments go to both runs, e.g. --tile 512.
+#
+#   scripts/compare_pyramid.sh [levels] [-- options]
+#   TOL=0.01 COIN_DETECTOR=path/to/coin_detector scripts/compare_pyramid.sh 2
+
+ROOT="$(cd "$(dirname "${BASH_SOURCE[0]}")/.." && pwd)"
+
+LEVELS="${1:-1}"
+shift || true
+[[ "${1:-}" == "--" ]] && shift
+TOL="${TOL:-0.02}"
+DATASETS=("$ROOT/data/rczulch" "$ROOT/data/Nikita/part2")
+
+EXE="${COIN_DETECTOR:-$ROOT/out/build/x64-release/coin_detector}"
+[[ -f "$EXE" || ! -f "$EXE.exe" ]] || EXE="$EXE.exe"
+
+if [[ ! -f "$EXE" ]]; then
+  echo "Executable not found: $EXE"
+  echo "Build it:"
+  echo "  cmake --build --preset x64-release --target coin_detector"
+  exit 3
+fi
+
+TMP="$(mktemp -d)"
+trap 'rm -rf "$TMP"' EXIT
+
+# Prints "<F1> <wall ms>" for one batch run.
+run() {
+  local log="$TMP/run.log"
+  "$EXE" "$1" --batch --vis none --results "$TMP/results.csv" "${@:2}" >"$log"
+  local f1 ms
+  f1="$(sed -n 's/.* F1=\([^ ]*\).*/\1/p' "$log" | tail -n 1)"
+  ms="$(sed -n 's/^Total wall time (ms): //p' "$log" | tail -n 1)"
+  echo "${f1:-nan} ${ms:-nan}"
+}
+
+status=0
+printf "%-24s %10s %10s %12s %12s\n" dataset "F1 full" "F1 L=$LEVELS" "ms full" "ms L=$LEVELS"
+for dir in "${DATASETS[@]}"; do
+  read -r f1Full msFull < <(run "$dir" "$@")
+  read -r f1Pyr msPyr < <(run "$dir" --pyramid "$LEVELS" "$@")
+  printf "%-24s %10s %10s %12s %12s\n" "${dir#"$ROOT"/data/}" \
+    "$f1Full" "$f1Pyr" "$msFull" "$msPyr"
+  if ! awk -v a="$f1Full" -v b="$f1Pyr" -v t="$TOL" 'BEGIN { exit !(a ~ /^[0-9.]+$/ && b ~ /^[0-9.]+$/ && b >= a - t) }'; then
+    echo "  F1 dropped by more than $TOL"
+    status=1
+  fi
+done
+exit "$status"
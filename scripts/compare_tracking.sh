@@ -0,0 +1,54 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+# Runs coin_detect_cli --video on a clip twice: with the tracker's
+# default full-scan interval and with a full-frame detection on every
+# frame (--full-scan 1). Prints fps and two stability measures for
+# both: the number of confirmed tracks over the clip (each real coin
+# should get one) and how many frames changed the confirmed count.
+#
+#   scripts/compare_tracking.sh [video] [-- options]
+#   COIN_DETECT_CLI=path/to/coin_detect_cli scripts/compare_tracking.sh out/test_conveyor.mp4
+#
+# The default clip is the one scripts/make_test_video.sh writes.
+
+ROOT="$(cd "$(dirname "${BASH_SOURCE[0]}")/.." && pwd)"
+
+VIDEO="${1:-$ROOT/out/test_conveyor.mp4}"
+shift || true
+[[ "${1:-}" == "--" ]] && shift
+
+EXE="${COIN_DETECT_CLI:-$ROOT/out/build/x64-release/tools/detect_cli/coin_detect_cli}"
+[[ -f "$EXE" || ! -f "$EXE.exe" ]] || EXE="$EXE.exe"
+
+if [[ ! -f "$EXE" ]]; then
+  echo "Executable not found: $EXE"
+  echo "Build it:"
+  echo "  cmake --build --preset x64-release --target coin_detect_cli"
+  exit 3
+fi
+if [[ ! -f "$VIDEO" ]]; then
+  echo "Video not found: $VIDEO (see scripts/make_test_video.sh)"
+  exit 3
+fi
+
+TMP="$(mktemp -d)"
+trap 'rm -rf "$TMP"' EXIT
+
+# Prints "<fps> <full scans> <tracks> <count changes>" for one run.
+run() {
+  "$EXE" --video "$VIDEO" "$@" >"$TMP/tracks.txt" 2>"$TMP/summary.txt"
+  local fps scans tracks changes
+  fps="$(sed -n 's/.* fps=\([^ ]*\).*/\1/p' "$TMP/summary.txt" | tail -n 1)"
+  scans="$(sed -n 's/.* full_scans=\([^ ]*\).*/\1/p' "$TMP/summary.txt" | tail -n 1)"
+  tracks="$(sed -n 's/.* coins=\([^ ]*\).*/\1/p' "$TMP/summary.txt" | tail -n 1)"
+  # lines are "frame n [id cx cy r score]*n"
+  changes="$(awk 'NR > 1 && $2 != prev { c++ } { prev = $2 } END { print c + 0 }' "$TMP/tracks.txt")"
+  echo "${fps:-nan} ${scans:-nan} ${tracks:-nan} $changes"
+}
+
+printf "%-16s %10s %12s %8s %15s\n" mode fps "full scans" tracks "count changes"
+read -r fps scans tracks changes < <(run "$@")
+printf "%-16s %10s %12s %8s %15s\n" tracker "$fps" "$scans" "$tracks" "$changes"
+read -r fps scans tracks changes < <(run --full-scan 1 "$@")
+printf "%-16s %10s %12s %8s %15s\n" "full every frame" "$fps" "$scans" "$tracks" "$changes"
@@ -0,0 +1,26 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+# Builds a synthetic "conveyor" clip from a bundled photo: a fixed-size
+# window pans across the image so the coins drift through the frame.
+# Needs ffmpeg. Feed the result to: coin_detect_cli --video <out.mp4>
+
+ROOT="$(cd "$(dirname "${BASH_SOURCE[0]}")/.." && pwd)"
+
+IMG="${1:-$ROOT/data/rczulch/coins1.jpg}"
+OUT="${2:-$ROOT/out/test_conveyor.mp4}"
+SECONDS_LEN="${3:-10}"
+
+if ! command -v ffmpeg >/dev/null 2>&1; then
+  echo "ffmpeg not found"
+  exit 3
+fi
+
+mkdir -p "$(dirname "$OUT")"
+
+# 2/3 of the width, panning left to right over the clip length
+ffmpeg -y -loglevel error -loop 1 -i "$IMG" \
+  -vf "crop=trunc(iw*2/3/2)*2:trunc(ih/2)*2:x='(iw-ow)*t/${SECONDS_LEN}':y=0" \
+  -t "$SECONDS_LEN" -r 30 -pix_fmt yuv420p "$OUT"
+
+echo "Wrote $OUT"
@@ -0,0 +1,452 @@
+#include "circle_hough.hpp"
+#include <opencv2/imgproc.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define COINS_HOUGH_X86 1
+#include <immintrin.h>
+#if defined(__GNUC__) || defined(__clang__)
+#define COINS_TARGET(isa) __attribute__((target(isa)))
+#else
+#define COINS_TARGET(isa)
+#endif
+#endif
+
+namespace {
+
+// Accumulator geometry shared by the voting kernels.
+struct VoteGrid {
+    int w, h;           // accumulator size in cells
+    int blocksPerRow;   // 4x4 blocks per accumulator row
+    int32_t discard;    // index of the slot out-of-range votes go to
+};
+
+inline int32_t blockedIndex(int x, int y, int blocksPerRow) {
+    return (((y >> 2) * blocksPerRow + (x >> 2)) << 4) | ((y & 3) << 2) | (x & 3);
+}
+
+// ------------------------------------------------------------
+// Scalar kernels
+// ------------------------------------------------------------
+
+// Writes the accumulator addresses of (x + r*dx, y + r*dy) for
+// r = r0 .. r0+n-1. Cells outside the grid map to g.discard, so the
+// caller can increment every address without a branch.
+void voteAddressesScalar(float x, float y, float dx, float dy,
+    int r0, int n, const VoteGrid& g, int32_t* out) {
+    for (int i = 0; i < n; ++i) {
+        const float r = float(r0 + i);
+        const int cx = cvRound(x + r * dx);
+        const int cy = cvRound(y + r * dy);
+        out[i] = (unsigned(cx) < unsigned(g.w) && unsigned(cy) < unsigned(g.h))
+            ? blockedIndex(cx, cy, g.blocksPerRow)
+            : g.discard;
+    }
+}
+
+void l1MagnitudeScalar(const short* dx, const short* dy, short* mag, int n) {
+    for (int i = 0; i < n; ++i)
+        mag[i] = short(std::min(std::abs(dx[i]) + std::abs(dy[i]), 32767));
+}
+
+bool blockReachesScalar(const int32_t* block, int threshold) {
+    for (int i = 0; i < 16; ++i)
+        if (block[i] >= threshold) return true;
+    return false;
+}
+
+// ------------------------------------------------------------
+// SSE4.1 / AVX2 kernels
+// ------------------------------------------------------------
+#ifdef COINS_HOUGH_X86
+
+COINS_TARGET("sse4.1")
+void voteAddressesSSE41(float x, float y, float dx, float dy,
+    int r0, int n, const VoteGrid& g, int32_t* out) {
+    const __m128 vx = _mm_set1_ps(x), vy = _mm_set1_ps(y);
+    const __m128 vdx = _mm_set1_ps(dx), vdy = _mm_set1_ps(dy);
+    const __m128 lane = _mm_setr_ps(0.f, 1.f, 2.f, 3.f);
+    const __m128i w = _mm_set1_epi32(g.w), h = _mm_set1_epi32(g.h);
+    const __m128i bpr = _mm_set1_epi32(g.blocksPerRow);
+    const __m128i discard = _mm_set1_epi32(g.discard);
+    const __m128i minus1 = _mm_set1_epi32(-1), three = _mm_set1_epi32(3);
+
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        const __m128 r = _mm_add_ps(_mm_set1_ps(float(r0 + i)), lane);
+        const __m128i cx = _mm_cvtps_epi32(_mm_add_ps(vx, _mm_mul_ps(r, vdx)));
+        const __m128i cy = _mm_cvtps_epi32(_mm_add_ps(vy, _mm_mul_ps(r, vdy)));
+        const __m128i ok = _mm_and_si128(
+            _mm_and_si128(_mm_cmpgt_epi32(w, cx), _mm_cmpgt_epi32(cx, minus1)),
+            _mm_and_si128(_mm_cmpgt_epi32(h, cy), _mm_cmpgt_epi32(cy, minus1)));
+        const __m128i block = _mm_add_epi32(
+            _mm_mullo_epi32(_mm_srai_epi32(cy, 2), bpr), _mm_srai_epi32(cx, 2));
+        const __m128i idx = _mm_or_si128(_mm_slli_epi32(block, 4),
+            _mm_or_si128(_mm_slli_epi32(_mm_and_si128(cy, three), 2),
+                _mm_and_si128(cx, three)));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i),
+            _mm_blendv_epi8(discard, idx, ok));
+    }
+    voteAddressesScalar(x, y, dx, dy, r0 + i, n - i, g, out + i);
+}
+
+COINS_TARGET("sse4.1")
+void l1MagnitudeSSE41(const short* dx, const short* dy, short* mag, int n) {
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dx + i));
+        const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dy + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(mag + i),
+            _mm_adds_epi16(_mm_abs_epi16(a), _mm_abs_epi16(b)));
+    }
+    l1MagnitudeScalar(dx + i, dy + i, mag + i, n - i);
+}
+
+COINS_TARGET("sse4.1")
+bool blockReachesSSE41(const int32_t* block, int threshold) {
+    const __m128i t = _mm_set1_epi32(threshold - 1);
+    const __m128i* p = reinterpret_cast<const __m128i*>(block);
+    __m128i any = _mm_cmpgt_epi32(_mm_loadu_si128(p), t);
+    any = _mm_or_si128(any, _mm_cmpgt_epi32(_mm_loadu_si128(p + 1), t));
+    any = _mm_or_si128(any, _mm_cmpgt_epi32(_mm_loadu_si128(p + 2), t));
+    any = _mm_or_si128(any, _mm_cmpgt_epi32(_mm_loadu_si128(p + 3), t));
+    return !_mm_testz_si128(any, any);
+}
+
+// Multiply and add stay separate (no FMA) so every path rounds x + r*dx
+// exactly like the scalar kernel and casts identical votes.
+COINS_TARGET("avx2")
+void voteAddressesAVX2(float x, float y, float dx, float dy,
+    int r0, int n, const VoteGrid& g, int32_t* out) {
+    const __m256 vx = _mm256_set1_ps(x), vy = _mm256_set1_ps(y);
+    const __m256 vdx = _mm256_set1_ps(dx), vdy = _mm256_set1_ps(dy);
+    const __m256 lane = _mm256_setr_ps(0.f, 1.f, 2.f, 3.f, 4.f, 5.f, 6.f, 7.f);
+    const __m256i w = _mm256_set1_epi32(g.w), h = _mm256_set1_epi32(g.h);
+    const __m256i bpr = _mm256_set1_epi32(g.blocksPerRow);
+    const __m256i discard = _mm256_set1_epi32(g.discard);
+    const __m256i minus1 = _mm256_set1_epi32(-1), three = _mm256_set1_epi32(3);
+
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        const __m256 r = _mm256_add_ps(_mm256_set1_ps(float(r0 + i)), lane);
+        const __m256i cx = _mm256_cvtps_epi32(_mm256_add_ps(vx, _mm256_mul_ps(r, vdx)));
+        const __m256i cy = _mm256_cvtps_epi32(_mm256_add_ps(vy, _mm256_mul_ps(r, vdy)));
+        const __m256i ok = _mm256_and_si256(
+            _mm256_and_si256(_mm256_cmpgt_epi32(w, cx), _mm256_cmpgt_epi32(cx, minus1)),
+            _mm256_and_si256(_mm256_cmpgt_epi32(h, cy), _mm256_cmpgt_epi32(cy, minus1)));
+        const __m256i block = _mm256_add_epi32(
+            _mm256_mullo_epi32(_mm256_srai_epi32(cy, 2), bpr), _mm256_srai_epi32(cx, 2));
+        const __m256i idx = _mm256_or_si256(_mm256_slli_epi32(block, 4),
+            _mm256_or_si256(_mm256_slli_epi32(_mm256_and_si256(cy, three), 2),
+                _mm256_and_si256(cx, three)));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i),
+            _mm256_blendv_epi8(discard, idx, ok));
+    }
+    voteAddressesScalar(x, y, dx, dy, r0 + i, n - i, g, out + i);
+}
+
+COINS_TARGET("avx2")
+void l1MagnitudeAVX2(const short* dx, const short* dy, short* mag, int n) {
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dx + i));
+        const __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dy + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(mag + i),
+            _mm256_adds_epi16(_mm256_abs_epi16(a), _mm256_abs_epi16(b)));
+    }
+    l1MagnitudeScalar(dx + i, dy + i, mag + i, n - i);
+}
+
+COINS_TARGET("avx2")
+bool blockReachesAVX2(const int32_t* block, int threshold) {
+    const __m256i t = _mm256_set1_epi32(threshold - 1);
+    const __m256i* p = reinterpret_cast<const __m256i*>(block);
+    const __m256i any = _mm256_or_si256(
+        _mm256_cmpgt_epi32(_mm256_loadu_si256(p), t),
+        _mm256_cmpgt_epi32(_mm256_loadu_si256(p + 1), t));
+    return !_mm256_testz_si256(any, any);
+}
+
+#endif // COINS_HOUGH_X86
+
+// ------------------------------------------------------------
+// Runtime dispatch
+// ------------------------------------------------------------
+struct Kernels {
+    void (*voteAddresses)(float, float, float, float, int, int, const VoteGrid&, int32_t*);
+    void (*l1Magnitude)(const short*, const short*, short*, int);
+    bool (*blockReaches)(const int32_t*, int);
+    const char* name;
+};
+
+const Kernels kScalar{ voteAddressesScalar, l1MagnitudeScalar, blockReachesScalar, "scalar" };
+#ifdef COINS_HOUGH_X86
+const Kernels kSSE41{ voteAddressesSSE41, l1MagnitudeSSE41, blockReachesSSE41, "sse4.1" };
+const Kernels kAVX2{ voteAddressesAVX2, l1MagnitudeAVX2, blockReachesAVX2, "avx2" };
+#endif
+
+// The kernels for `s`, or null if this build or CPU can't run them.
+const Kernels* kernelsFor(CircleHough::Simd s) {
+    switch (s) {
+    case CircleHough::Simd::Scalar:
+        return &kScalar;
+#ifdef COINS_HOUGH_X86
+    case CircleHough::Simd::SSE41:
+        return cv::checkHardwareSupport(CV_CPU_SSE4_1) ? &kSSE41 : nullptr;
+    case CircleHough::Simd::AVX2:
+        return cv::checkHardwareSupport(CV_CPU_AVX2) ? &kAVX2 : nullptr;
+#endif
+    default:
+        return nullptr;
+    }
+}
+
+const Kernels& kernels(CircleHough::Simd s = CircleHough::Simd::Auto) {
+    static const Kernels& best = [] () -> const Kernels& {
+        for (auto s : { CircleHough::Simd::AVX2, CircleHough::Simd::SSE41 })
+            if (const Kernels* k = kernelsFor(s))
+                return *k;
+        return kScalar;
+    }();
+    if (s == CircleHough::Simd::Auto)
+        return best;
+    const Kernels* k = kernelsFor(s);
+    return k ? *k : best;
+}
+
+} // namespace
+
+const char* CircleHough::simdPath() {
+    return kernels().name;
+}
+
+bool CircleHough::setSimd(Simd s) {
+    if (s != Simd::Auto && !kernelsFor(s))
+        return false;
+    simd_ = s;
+    return true;
+}
+
+const char* CircleHough::path() const {
+    return kernels(simd_).name;
+}
+
+void CircleHough::accumulator(cv::Mat& votes) const {
+    votes.create(accH_, accW_, CV_32SC1);
+    for (int y = 0; y < accH_; ++y) {
+        int32_t* row = votes.ptr<int32_t>(y);
+        for (int x = 0; x < accW_; ++x)
+            row[x] = acc_[blockedIndex(x, y, blocksPerRow_)];
+    }
+}
+
+void CircleHough::detect(const cv::Mat& blurred,
+    const Params& p,
+    std::vector<cv::Vec4f>& circles) {
+    CV_Assert(blurred.type() == CV_8UC1);
+    circles.clear();
+    acc_.clear();
+    accW_ = accH_ = 0;
+    if (blurred.rows < 3 || blurred.cols < 3)
+        return;
+
+    // Sobel dx and dy in a single pass
+    cv::spatialGradient(blurred, gx_, gy_, 3);
+
+    collectEdges(p);
+    if (edges_.empty())
+        return;
+
+    vote(p);
+    findPeaks(p);
+
+    const float dp = float(std::max(1.0, p.dp));
+    for (const auto& pk : peaks_) {
+        const float cx = pk.x * dp, cy = pk.y * dp;
+        const float r = estimateRadius(cx, cy, p);
+        if (r > 0.0f)
+            circles.emplace_back(cx, cy, r, float(pk.votes));
+    }
+}
+
+void CircleHough::collectEdges(const Params& p) {
+    const int rows = gx_.rows, cols = gx_.cols;
+    mag_.create(rows, cols, CV_16SC1);
+    const auto& k = kernels(simd_);
+    for (int y = 0; y < rows; ++y)
+        k.l1Magnitude(gx_.ptr<short>(y), gy_.ptr<short>(y), mag_.ptr<short>(y), cols);
+
+    // tan(22.5) and tan(67.5) in 1/1024 units, as in Canny's NMS
+    constexpr int kTan22 = 424, kTan67 = 2472;
+    const int thr = std::max(1, p.edgeThreshold);
+
+    edges_.clear();
+    for (int y = 1; y < rows - 1; ++y) {
+        const short* dxr = gx_.ptr<short>(y);
+        const short* dyr = gy_.ptr<short>(y);
+        const short* up = mag_.ptr<short>(y - 1);
+        const short* mid = mag_.ptr<short>(y);
+        const short* down = mag_.ptr<short>(y + 1);
+
+        for (int x = 1; x < cols - 1; ++x) {
+            const int m = mid[x];
+            if (m < thr)
+                continue;
+
+            // Keep only maxima across the edge (along the gradient)
+            const int dx = dxr[x], dy = dyr[x];
+            const int ax = std::abs(dx), ay = std::abs(dy);
+            int a, b;
+            if (ay * 1024 < ax * kTan22) {          // horizontal gradient
+                a = mid[x - 1]; b = mid[x + 1];
+            }
+            else if (ay * 1024 > ax * kTan67) {     // vertical gradient
+                a = up[x]; b = down[x];
+            }
+            else if ((dx ^ dy) >= 0) {              // diagonal, same signs
+                a = up[x - 1]; b = down[x + 1];
+            }
+            else {                                  // diagonal, opposite signs
+                a = up[x + 1]; b = down[x - 1];
+            }
+            if (m <= a || m < b)
+                continue;
+
+            const float inv = 1.0f / std::sqrt(float(dx * dx + dy * dy));
+            edges_.push_back({ float(x), float(y), dx * inv, dy * inv });
+        }
+    }
+}
+
+void CircleHough::vote(const Params& p) {
+    const double dp = std::max(1.0, p.dp);
+    const float inv = float(1.0 / dp);
+    accW_ = std::max(1, int(std::ceil(gx_.cols / dp)));
+    accH_ = std::max(1, int(std::ceil(gx_.rows / dp)));
+    blocksPerRow_ = (accW_ + 3) / 4;
+    const size_t cells = size_t(blocksPerRow_) * size_t((accH_ + 3) / 4) * 16;
+
+    acc_.assign(cells + 1, 0);
+    const VoteGrid g{ accW_, accH_, blocksPerRow_, int32_t(cells) };
+
+    const int rMin = std::max(1, p.minRadius);
+    const int rMax = std::max(rMin, p.maxRadius);
+    const int n = rMax - rMin + 1;
+    idx_.resize(size_t(n));
+
+    const auto voteAddresses = kernels(simd_).voteAddresses;
+    int32_t* acc = acc_.data();
+    const int32_t* idx = idx_.data();
+    for (const auto& e : edges_) {
+        const float x = e.x * inv, y = e.y * inv;
+        const float dx = e.ux * inv, dy = e.uy * inv;
+
+        // Polarity is unknown (coin darker or brighter than background),
+        // so vote on both sides of the edge.
+        voteAddresses(x, y, dx, dy, rMin, n, g, idx_.data());
+        for (int i = 0; i < n; ++i) acc[idx[i]]++;
+        voteAddresses(x, y, -dx, -dy, rMin, n, g, idx_.data());
+        for (int i = 0; i < n; ++i) acc[idx[i]]++;
+    }
+}
+
+void CircleHough::findPeaks(const Params& p) {
+    peaks_.clear();
+    const int thr = std::max(1, p.voteThreshold);
+    const int blockRows = (accH_ + 3) / 4;
+    const int32_t* acc = acc_.data();
+    const auto blockReaches = kernels(simd_).blockReaches;
+
+    auto at = [&](int x, int y) {
+        if (unsigned(x) >= unsigned(accW_) || unsigned(y) >= unsigned(accH_))
+            return 0;
+        return int(acc[blockedIndex(x, y, blocksPerRow_)]);
+    };
+
+    for (int by = 0; by < blockRows; ++by) {
+        for (int bx = 0; bx < blocksPerRow_; ++bx) {
+            const int32_t* block = acc + ((by * blocksPerRow_ + bx) << 4);
+            if (!blockReaches(block, thr))
+                continue;
+
+            for (int j = 0; j < 16; ++j) {
+                const int v = block[j];
+                if (v < thr)
+                    continue;
+                const int x = bx * 4 + (j & 3), y = by * 4 + (j >> 2);
+                // strict maximum against earlier cells, >= against later
+                // ones, so a plateau yields exactly one peak
+                if (v <= at(x - 1, y - 1) || v <= at(x, y - 1) ||
+                    v <= at(x + 1, y - 1) || v <= at(x - 1, y) ||
+                    v < at(x + 1, y) || v < at(x - 1, y + 1) ||
+                    v < at(x, y + 1) || v < at(x + 1, y + 1))
+                    continue;
+                peaks_.push_back({ x, y, v });
+            }
+        }
+    }
+
+    std::sort(peaks_.begin(), peaks_.end(), [](const Peak& a, const Peak& b) {
+        if (a.votes != b.votes) return a.votes > b.votes;
+        return a.y != b.y ? a.y < b.y : a.x < b.x;
+    });
+
+    // Greedy minDist suppression, strongest first
+    const double dp = std::max(1.0, p.dp);
+    const double minDist = std::max(1.0, double(p.minDist)) / dp;
+    const double minDist2 = minDist * minDist;
+    size_t kept = 0;
+    for (size_t i = 0; i < peaks_.size(); ++i) {
+        bool close = false;
+        for (size_t j = 0; j < kept && !close; ++j) {
+            const double dx = peaks_[i].x - peaks_[j].x;
+            const double dy = peaks_[i].y - peaks_[j].y;
+            close = dx * dx + dy * dy < minDist2;
+        }
+        if (!close)
+            peaks_[kept++] = peaks_[i];
+    }
+    peaks_.resize(kept);
+}
+
+float CircleHough::estimateRadius(float cx, float cy, const Params& p) {
+    const int rMin = std::max(1, p.minRadius);
+    const int rMax = std::max(rMin, p.maxRadius);
+    hist_.assign(size_t(rMax) + 2, 0.0f);
+
+    // Edge points are in raster order: only scan rows within rMax.
+    auto first = std::lower_bound(edges_.begin(), edges_.end(), cy - rMax,
+        [](const EdgePoint& e, float y) { return e.y < y; });
+    auto last = std::upper_bound(first, edges_.end(), cy + rMax,
+        [](float y, const EdgePoint& e) { return y < e.y; });
+
+    const float r2Min = float(rMin) * rMin, r2Max = float(rMax) * rMax;
+    for (auto it = first; it != last; ++it) {
+        const float dx = it->x - cx, dy = it->y - cy;
+        const float d2 = dx * dx + dy * dy;
+        if (d2 < r2Min || d2 > r2Max)
+            continue;
+        const float d = std::sqrt(d2);
+        // a point on the circle has its gradient along the radius
+        if (std::abs(dx * it->ux + dy * it->uy) < 0.9f * d)
+            continue;
+        hist_[size_t(d + 0.5f)] += 1.0f;
+    }
+
+    // Best radius = most supporting points per unit circumference,
+    // on a [1 2 1]-smoothed histogram.
+    int best = 0;
+    float bestScore = 0.0f;
+    for (int r = rMin; r <= rMax; ++r) {
+        const float s = hist_[r - 1] + 2.0f * hist_[r] + hist_[r + 1];
+        if (s / r > bestScore) { bestScore = s / r; best = r; }
+    }
+    if (best == 0)
+        return 0.0f;
+
+    const float w = hist_[best - 1] + hist_[best] + hist_[best + 1];
+    return ((best - 1) * hist_[best - 1] + best * hist_[best] +
+        (best + 1) * hist_[best + 1]) / w;
+}
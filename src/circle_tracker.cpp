@@ -0,0 +1,142 @@
+#include "circle_tracker.hpp"
+#include <algorithm>
+#include <cmath>
+
+CircleTracker::CircleTracker(const CoinDetector& detector)
+    : CircleTracker(detector, Params{}) {}
+
+CircleTracker::CircleTracker(const CoinDetector& detector, const Params& p)
+    : detector_(&detector), params_(p) {}
+
+void CircleTracker::setDetector(const CoinDetector& detector) {
+    detector_ = &detector;
+}
+
+void CircleTracker::update(const cv::Mat& gray) {
+    for (auto& t : tracks_)
+        t.center += t.velocity;
+
+    bool anyConfirmed = std::any_of(tracks_.begin(), tracks_.end(),
+        [](const Track& t) { return t.confirmed; });
+    bool fullScan = !anyConfirmed || params_.fullScanInterval <= 1 ||
+        frame_ % params_.fullScanInterval == 0;
+
+    if (fullScan)
+        detectFull(gray);
+    else
+        detectRois(gray);
+
+    associate(fullScan);
+    lastFullScan_ = fullScan;
+    frame_++;
+}
+
+void CircleTracker::detectFull(const cv::Mat& gray) {
+    detector_->detect(gray, ws_, dets_);
+}
+
+void CircleTracker::detectRois(const cv::Mat& gray) {
+    dets_.clear();
+    const cv::Rect frame(0, 0, gray.cols, gray.rows);
+
+    for (const auto& t : tracks_) {
+        const float reach = t.radius * (1.0f + params_.radiusSlack + params_.roiMargin)
+            + std::hypot(t.velocity.x, t.velocity.y);
+        cv::Rect roi(cvRound(t.center.x - reach), cvRound(t.center.y - reach),
+            cvRound(2 * reach) + 1, cvRound(2 * reach) + 1);
+        roi &= frame;
+        if (roi.width < 8 || roi.height < 8)
+            continue;
+
+        // Same detector, radius range narrowed to this track and a
+        // single circle expected per ROI.
+        CoinDetector::Params p = detector_->params();
+        p.pyramidLevels = 0;
+        p.minRadius = std::max(1, int(t.radius * (1.0f - params_.radiusSlack)));
+        p.maxRadius = std::max(p.minRadius + 1,
+            int(std::ceil(t.radius * (1.0f + params_.radiusSlack))));
+        p.houghMinDist = std::max(1, int(t.radius));
+        // the search region is in frame coordinates; tracks only start
+        // from full scans, which already honour it
+        p.roi = cv::Rect();
+        p.roiPolygon.clear();
+
+        CoinDetector roiDetector(p);
+        roiDetector.detect(gray(roi), ws_, roiDets_);
+        for (auto d : roiDets_) {
+            d.center.x += float(roi.x);
+            d.center.y += float(roi.y);
+            dets_.push_back(d);
+        }
+    }
+}
+
+void CircleTracker::associate(bool spawn) {
+    struct Pair { float dist; int track, det; };
+    std::vector<Pair> pairs;
+    for (int i = 0; i < int(tracks_.size()); ++i) {
+        const auto& t = tracks_[i];
+        const float maxDist = params_.matchDist * t.radius;
+        for (int j = 0; j < int(dets_.size()); ++j) {
+            const float d = std::hypot(dets_[j].center.x - t.center.x,
+                dets_[j].center.y - t.center.y);
+            if (d <= maxDist)
+                pairs.push_back({ d, i, j });
+        }
+    }
+    std::sort(pairs.begin(), pairs.end(), [](const Pair& a, const Pair& b) {
+        if (a.dist != b.dist) return a.dist < b.dist;
+        return a.track != b.track ? a.track < b.track : a.det < b.det;
+    });
+
+    std::vector<char> trackUsed(tracks_.size(), 0), detUsed(dets_.size(), 0);
+    const float a = params_.smoothing;
+    for (const auto& pr : pairs) {
+        if (trackUsed[pr.track] || detUsed[pr.det])
+            continue;
+        trackUsed[pr.track] = detUsed[pr.det] = 1;
+
+        auto& t = tracks_[pr.track];
+        const auto& d = dets_[pr.det];
+        // t.center is the prediction; the residual corrects velocity
+        const cv::Point2f residual = d.center - t.center;
+        t.velocity += residual * a;
+        t.center += residual * a;
+        t.radius += (d.radius - t.radius) * a;
+        t.score = d.score;
+        t.hits++;
+        t.misses = 0;
+        if (!t.confirmed && t.hits >= params_.confirmHits) {
+            t.confirmed = true;
+            confirmedTotal_++;
+        }
+    }
+
+    for (size_t i = 0; i < tracks_.size(); ++i) {
+        if (!trackUsed[i])
+            tracks_[i].misses++;
+    }
+    tracks_.erase(std::remove_if(tracks_.begin(), tracks_.end(),
+        [&](const Track& t) {
+            return t.misses > (t.confirmed ? params_.maxMisses : 0);
+        }), tracks_.end());
+
+    // New tracks only come from full-frame scans
+    if (!spawn)
+        return;
+    for (size_t j = 0; j < dets_.size(); ++j) {
+        if (detUsed[j])
+            continue;
+        Track t;
+        t.id = nextId_++;
+        t.center = dets_[j].center;
+        t.radius = dets_[j].radius;
+        t.score = dets_[j].score;
+        t.hits = 1;
+        if (t.hits >= params_.confirmHits) {
+            t.confirmed = true;
+            confirmedTotal_++;
+        }
+        tracks_.push_back(t);
+    }
+}
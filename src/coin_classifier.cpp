@@ -0,0 +1,443 @@
+#include "coin_classifier.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Sample grid, in units of the radius: kGrid x kGrid cell centers,
+// keeping those inside the circle (about 280 samples per coin).
+constexpr int kGrid = 20;
+constexpr float kInside = 0.95f;    // stay clear of the rim and background
+constexpr float kCenter = 0.5f;     // center region: rho < kCenter
+constexpr float kRing = 0.65f;      // ring region: rho >= kRing
+constexpr int kHueBins = 8;
+
+struct Sample {
+    float u, v;
+    bool center, ring;
+    int right, down;    // neighbour sample indices for texture, -1 if none
+};
+
+const std::vector<Sample>& sampleGrid() {
+    static const std::vector<Sample> grid = [] {
+        std::vector<Sample> s;
+        std::vector<int> at(kGrid * kGrid, -1);
+        for (int j = 0; j < kGrid; ++j) {
+            for (int i = 0; i < kGrid; ++i) {
+                float u = (2.0f * i + 1.0f) / kGrid - 1.0f;
+                float v = (2.0f * j + 1.0f) / kGrid - 1.0f;
+                float rho = std::sqrt(u * u + v * v);
+                if (rho > kInside)
+                    continue;
+                at[j * kGrid + i] = int(s.size());
+                s.push_back({ u, v, rho < kCenter, rho >= kRing, -1, -1 });
+            }
+        }
+        for (int j = 0; j < kGrid; ++j) {
+            for (int i = 0; i < kGrid; ++i) {
+                int k = at[j * kGrid + i];
+                if (k < 0)
+                    continue;
+                if (i + 1 < kGrid) s[k].right = at[j * kGrid + i + 1];
+                if (j + 1 < kGrid) s[k].down = at[(j + 1) * kGrid + i];
+            }
+        }
+        return s;
+    }();
+    return grid;
+}
+
+// Channel offsets of B, G, R in a pixel of `f`.
+void channelOrder(ImageView::Format f, int& b, int& g, int& r) {
+    switch (f) {
+    case ImageView::Format::RGB:
+    case ImageView::Format::RGBA: r = 0; g = 1; b = 2; break;
+    case ImageView::Format::Gray: r = g = b = 0; break;
+    default: b = 0; g = 1; r = 2; break;
+    }
+}
+
+struct Hsv {
+    float h;    // [0, 6), 0 for gray
+    float s;    // [0, 1]
+    float v;    // [0, 1]
+    float y;    // luma [0, 1]
+};
+
+inline Hsv toHsv(int b, int g, int r) {
+    int mx = std::max({ b, g, r }), mn = std::min({ b, g, r });
+    Hsv o;
+    o.v = float(mx) * (1.0f / 255.0f);
+    o.y = (0.114f * b + 0.587f * g + 0.299f * r) * (1.0f / 255.0f);
+    int c = mx - mn;
+    o.s = mx ? float(c) / float(mx) : 0.0f;
+    if (c == 0) {
+        o.h = 0.0f;
+    }
+    else if (mx == r) {
+        o.h = float(g - b) / float(c);
+        if (o.h < 0.0f) o.h += 6.0f;
+    }
+    else if (mx == g) {
+        o.h = float(b - r) / float(c) + 2.0f;
+    }
+    else {
+        o.h = float(r - g) / float(c) + 4.0f;
+    }
+    return o;
+}
+
+inline int bin3(float x) {
+    return std::min(2, int(x * 3.0f));
+}
+
+} // namespace
+
+void extractCoinFeatures(const ImageView& image,
+    const std::vector<DetectedCircle>& circles, cv::Mat& features) {
+    features.create(int(circles.size()), kCoinFeatures, CV_32F);
+    features.setTo(0);
+    if (circles.empty() || image.empty())
+        return;
+
+    // radius relative to the other coins of the image: denominations
+    // differ by size, while the absolute size depends on the camera
+    std::vector<float> radii;
+    radii.reserve(circles.size());
+    for (const auto& c : circles)
+        radii.push_back(c.radius);
+    std::nth_element(radii.begin(), radii.begin() + radii.size() / 2, radii.end());
+    const float median = std::max(1.0f, radii[radii.size() / 2]);
+
+    const auto& grid = sampleGrid();
+    const int ch = image.channels();
+    const size_t stride = image.stride ? image.stride : size_t(image.width) * ch;
+    const bool color = image.format != ImageView::Format::Gray;
+    int ob, og, orr;
+    channelOrder(image.format, ob, og, orr);
+
+    std::vector<Hsv> px(grid.size());
+    std::vector<bool> valid(grid.size());
+
+    for (size_t n = 0; n < circles.size(); ++n) {
+        const DetectedCircle& c = circles[n];
+        float* f = features.ptr<float>(int(n));
+        f[0] = c.radius / median;
+
+        // gather
+        for (size_t k = 0; k < grid.size(); ++k) {
+            int x = int(c.center.x + grid[k].u * c.radius);
+            int y = int(c.center.y + grid[k].v * c.radius);
+            valid[k] = x >= 0 && y >= 0 && x < image.width && y < image.height;
+            if (!valid[k])
+                continue;
+            const unsigned char* p = image.data + size_t(y) * stride + size_t(x) * ch;
+            px[k] = toHsv(p[ob], p[og], p[orr]);
+        }
+
+        // histograms and region means
+        float hueWeight = 0.0f, count = 0.0f;
+        float sumV = 0.0f, sumV2 = 0.0f, sumY = 0.0f;
+        float cn = 0.0f, cs = 0.0f, cv = 0.0f, ca = 0.0f, cb = 0.0f;   // center
+        float rn = 0.0f, rs = 0.0f, rv = 0.0f, ra = 0.0f, rb = 0.0f;   // ring
+        float diff = 0.0f, pairs = 0.0f;
+        for (size_t k = 0; k < grid.size(); ++k) {
+            if (!valid[k])
+                continue;
+            const Hsv& s = px[k];
+            count += 1.0f;
+            sumV += s.v;
+            sumV2 += s.v * s.v;
+            sumY += s.y;
+            if (color) {
+                int hb = std::min(kHueBins - 1, int(s.h * (kHueBins / 6.0f)));
+                f[1 + hb] += s.s;
+                hueWeight += s.s;
+                f[9 + bin3(s.s)] += 1.0f;
+            }
+            f[12 + bin3(s.v)] += 1.0f;
+
+            // chroma as a point on the hue circle, radius = saturation
+            float angle = s.h * (3.14159265f / 3.0f);
+            float a = s.s * std::cos(angle), b = s.s * std::sin(angle);
+            if (grid[k].center) {
+                cn += 1.0f; cs += s.s; cv += s.v; ca += a; cb += b;
+            }
+            else if (grid[k].ring) {
+                rn += 1.0f; rs += s.s; rv += s.v; ra += a; rb += b;
+            }
+
+            for (int nb : { grid[k].right, grid[k].down }) {
+                if (nb >= 0 && valid[nb]) {
+                    diff += std::abs(s.y - px[nb].y);
+                    pairs += 1.0f;
+                }
+            }
+        }
+        if (count == 0.0f)
+            continue;
+
+        if (hueWeight > 0.0f) {
+            for (int i = 0; i < kHueBins; ++i)
+                f[1 + i] /= hueWeight;
+        }
+        for (int i = 9; i < 15; ++i)
+            f[i] /= count;
+
+        if (cn > 0.0f && rn > 0.0f) {
+            f[15] = rs / rn - cs / cn;
+            f[16] = rv / rn - cv / cn;
+            float da = ra / rn - ca / cn, db = rb / rn - cb / cn;
+            f[17] = std::sqrt(da * da + db * db);
+        }
+
+        float meanV = sumV / count;
+        f[18] = pairs > 0.0f ? (diff / pairs) / (sumY / count + 0.05f) : 0.0f;
+        f[19] = std::sqrt(std::max(0.0f, sumV2 / count - meanV * meanV));
+    }
+}
+
+// ------------------------------------------------------------
+// CoinClassifier
+// ------------------------------------------------------------
+
+CoinClassifier CoinClassifier::train(const cv::Mat& features, const std::vector<int>& labels,
+    std::vector<CoinClass> classes, Model model) {
+    CV_Assert(features.type() == CV_32F && features.cols == kCoinFeatures);
+    CV_Assert(size_t(features.rows) == labels.size() && !classes.empty());
+
+    CoinClassifier c;
+    c.model_ = model;
+    c.classes_ = std::move(classes);
+    const int K = int(c.classes_.size());
+    const int N = features.rows;
+    for (int label : labels)
+        CV_Assert(label >= 0 && label < K);
+
+    // standardize: per feature zero mean, unit spread
+    std::vector<double> sum(kCoinFeatures, 0.0), sum2(kCoinFeatures, 0.0);
+    for (int i = 0; i < N; ++i) {
+        const float* f = features.ptr<float>(i);
+        for (int j = 0; j < kCoinFeatures; ++j) {
+            sum[j] += f[j];
+            sum2[j] += double(f[j]) * f[j];
+        }
+    }
+    c.mean_.create(1, kCoinFeatures, CV_32F);
+    c.invStd_.create(1, kCoinFeatures, CV_32F);
+    for (int j = 0; j < kCoinFeatures; ++j) {
+        double m = N ? sum[j] / N : 0.0;
+        double var = N ? std::max(0.0, sum2[j] / N - m * m) : 0.0;
+        c.mean_.at<float>(j) = float(m);
+        c.invStd_.at<float>(j) = 1.0f / std::max(float(std::sqrt(var)), 1e-3f);
+    }
+    cv::Mat z(N, kCoinFeatures, CV_32F);
+    for (int i = 0; i < N; ++i)
+        c.standardize(features.ptr<float>(i), z.ptr<float>(i));
+
+    if (model == Model::NearestCentroid) {
+        c.params_ = cv::Mat::zeros(K, kCoinFeatures, CV_32F);
+        std::vector<int> n(K, 0);
+        for (int i = 0; i < N; ++i) {
+            float* p = c.params_.ptr<float>(labels[i]);
+            const float* zi = z.ptr<float>(i);
+            for (int j = 0; j < kCoinFeatures; ++j)
+                p[j] += zi[j];
+            n[labels[i]]++;
+        }
+        for (int k = 0; k < K; ++k) {
+            float* p = c.params_.ptr<float>(k);
+            for (int j = 0; n[k] && j < kCoinFeatures; ++j)
+                p[j] /= float(n[k]);
+        }
+    }
+    else {
+        // ridge least squares on [z 1] against +-1 one-vs-rest targets:
+        // (X^T X + lambda I) W = X^T T
+        constexpr int D = kCoinFeatures + 1;
+        cv::Mat a = cv::Mat::zeros(D, D, CV_64F);
+        cv::Mat b(D, K, CV_64F, cv::Scalar(0.0));
+        double x[D];
+        for (int i = 0; i < N; ++i) {
+            const float* zi = z.ptr<float>(i);
+            for (int j = 0; j < kCoinFeatures; ++j)
+                x[j] = zi[j];
+            x[kCoinFeatures] = 1.0;
+            for (int r = 0; r < D; ++r) {
+                double* ar = a.ptr<double>(r);
+                for (int q = 0; q < D; ++q)
+                    ar[q] += x[r] * x[q];
+                double* br = b.ptr<double>(r);
+                for (int k = 0; k < K; ++k)
+                    br[k] += x[r] * (k == labels[i] ? 1.0 : -1.0);
+            }
+        }
+        for (int r = 0; r < kCoinFeatures; ++r)
+            a.at<double>(r, r) += 1e-2 * std::max(N, 1);
+
+        cv::Mat w;  // D x K
+        cv::solve(a, b, w, cv::DECOMP_CHOLESKY);
+        c.params_.create(K, kCoinFeatures, CV_32F);
+        c.linearBias_.create(K, 1, CV_32F);
+        for (int k = 0; k < K; ++k) {
+            for (int j = 0; j < kCoinFeatures; ++j)
+                c.params_.at<float>(k, j) = float(w.at<double>(j, k));
+            c.linearBias_.at<float>(k) = float(w.at<double>(kCoinFeatures, k));
+        }
+    }
+
+    c.prepare();
+    return c;
+}
+
+void CoinClassifier::standardize(const float* f, float* z) const {
+    const float* m = mean_.ptr<float>();
+    const float* s = invStd_.ptr<float>();
+    for (int j = 0; j < kCoinFeatures; ++j)
+        z[j] = (f[j] - m[j]) * s[j];
+}
+
+void CoinClassifier::prepare() {
+    const int K = int(classes_.size());
+    weights_.create(K, kCoinFeatures, CV_32F);
+    bias_.create(1, K, CV_32F);
+    for (int k = 0; k < K; ++k) {
+        const float* p = params_.ptr<float>(k);
+        float* w = weights_.ptr<float>(k);
+        if (model_ == Model::NearestCentroid) {
+            // argmin |z - c|^2 = argmax 2 z.c - |c|^2
+            float norm = 0.0f;
+            for (int j = 0; j < kCoinFeatures; ++j) {
+                w[j] = 2.0f * p[j];
+                norm += p[j] * p[j];
+            }
+            bias_.at<float>(k) = -norm;
+        }
+        else {
+            std::copy(p, p + kCoinFeatures, w);
+            bias_.at<float>(k) = linearBias_.at<float>(k);
+        }
+    }
+}
+
+bool CoinClassifier::load(const std::string& path) {
+    try {
+        cv::FileStorage fs(path, cv::FileStorage::READ);
+        if (!fs.isOpened())
+            return false;
+
+        std::string model;
+        fs["model"] >> model;
+        Model m;
+        if (model == "centroid")
+            m = Model::NearestCentroid;
+        else if (model == "linear")
+            m = Model::Linear;
+        else
+            return false;
+
+        std::vector<CoinClass> classes;
+        for (const auto& n : fs["classes"]) {
+            CoinClass c;
+            n["name"] >> c.name;
+            n["value"] >> c.value;
+            classes.push_back(c);
+        }
+
+        cv::Mat mean, invStd, params, bias;
+        fs["mean"] >> mean;
+        fs["invStd"] >> invStd;
+        fs["params"] >> params;
+        fs["bias"] >> bias;
+
+        const int K = int(classes.size());
+        auto ok = [](const cv::Mat& x, int rows, int cols) {
+            return x.type() == CV_32F && x.rows == rows && x.cols == cols;
+        };
+        if (K == 0 || !ok(mean, 1, kCoinFeatures) || !ok(invStd, 1, kCoinFeatures) ||
+            !ok(params, K, kCoinFeatures) || (m == Model::Linear && !ok(bias, K, 1)))
+            return false;
+
+        model_ = m;
+        classes_ = std::move(classes);
+        mean_ = mean;
+        invStd_ = invStd;
+        params_ = params;
+        linearBias_ = bias;
+        prepare();
+        return true;
+    }
+    catch (const cv::Exception&) {
+        return false;
+    }
+}
+
+bool CoinClassifier::save(const std::string& path) const {
+    try {
+        cv::FileStorage fs(path, cv::FileStorage::WRITE);
+        if (!fs.isOpened())
+            return false;
+
+        fs << "model" << (model_ == Model::Linear ? "linear" : "centroid");
+        fs << "classes" << "[";
+        for (const auto& c : classes_)
+            fs << "{" << "name" << c.name << "value" << c.value << "}";
+        fs << "]";
+        fs << "mean" << mean_;
+        fs << "invStd" << invStd_;
+        fs << "params" << params_;
+        if (model_ == Model::Linear)
+            fs << "bias" << linearBias_;
+        return true;
+    }
+    catch (const cv::Exception&) {
+        return false;
+    }
+}
+
+void CoinClassifier::classify(const cv::Mat& features, std::vector<int>& classIds) const {
+    classIds.assign(size_t(features.rows), -1);
+    if (empty() || features.empty())
+        return;
+    CV_Assert(features.type() == CV_32F && features.cols == kCoinFeatures);
+
+    // a K x F by F product per coin; K and F are small enough that a
+    // plain loop beats setting up a gemm
+    const int K = weights_.rows;
+    const float* bias = bias_.ptr<float>();
+    float z[kCoinFeatures];
+    for (int i = 0; i < features.rows; ++i) {
+        standardize(features.ptr<float>(i), z);
+        int best = -1;
+        float bestScore = 0.0f;
+        for (int k = 0; k < K; ++k) {
+            const float* w = weights_.ptr<float>(k);
+            float score = bias[k];
+            for (int j = 0; j < kCoinFeatures; ++j)
+                score += w[j] * z[j];
+            if (best < 0 || score > bestScore) {
+                best = k;
+                bestScore = score;
+            }
+        }
+        classIds[i] = best;
+    }
+}
+
+std::vector<int> CoinClassifier::classify(const ImageView& image,
+    const std::vector<DetectedCircle>& circles) const {
+    thread_local cv::Mat features;
+    extractCoinFeatures(image, circles, features);
+    std::vector<int> ids;
+    classify(features, ids);
+    return ids;
+}
+
+double CoinClassifier::total(const std::vector<int>& classIds) const {
+    double sum = 0.0;
+    for (int id : classIds) {
+        if (id >= 0 && id < int(classes_.size()))
+            sum += classes_[id].value;
+    }
+    return sum;
+}
@@ -1,60 +1,874 @@
 #include "coin_detector.hpp"
+#include "thread_pool.hpp"
 #include <opencv2/imgproc.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <future>
 
 CoinDetector::CoinDetector(const Params& p) : params_(p) {}
 
 CoinDetector::CoinDetector()
     : CoinDetector(Params{}) {}
 
-std::vector<DetectedCircle> CoinDetector::detect(const cv::Mat& imgGray) const {
-    CV_Assert(imgGray.channels() == 1);
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double msSince(Clock::time_point& t) {
+    auto now = Clock::now();
+    double ms = std::chrono::duration<double, std::milli>(now - t).count();
+    t = now;
+    return ms;
+}
 
-    cv::Mat blurred;
-    int k = params_.gaussKernel | 1; // ensure odd
-    if (k < 3) k = 3;
-    cv::GaussianBlur(imgGray, blurred, cv::Size(k, k), params_.gaussSigma);
+// Snapshot of where the workspace buffers live, to tell whether a call
+// had to reallocate any of them.
+struct BufferState {
+    const void* blurred;
+    const void* coarse;
+    const void* roiBuffer;
+    const void* roiMask;
+    size_t circles, coarseCircles, roiCircles, candidates;
+    size_t order, gridHead, gridNext, out;
+
+    BufferState(const DetectorWorkspace& ws, const std::vector<DetectedCircle>& out)
+        : blurred(ws.blurred.data), coarse(ws.coarse.data),
+        roiBuffer(ws.roiBuffer.data), roiMask(ws.roiMask.data),
+        circles(ws.circles.capacity()),
+        coarseCircles(ws.coarseCircles.capacity()),
+        roiCircles(ws.roiCircles.capacity()),
+        candidates(ws.candidates.capacity()),
+        order(ws.order.capacity()), gridHead(ws.gridHead.capacity()),
+        gridNext(ws.gridNext.capacity()), out(out.capacity()) {}
+
+    bool operator!=(const BufferState& o) const {
+        return blurred != o.blurred || coarse != o.coarse
+            || roiBuffer != o.roiBuffer || roiMask != o.roiMask
+            || circles != o.circles || coarseCircles != o.coarseCircles
+            || roiCircles != o.roiCircles || candidates != o.candidates
+            || order != o.order || gridHead != o.gridHead
+            || gridNext != o.gridNext || out != o.out;
+    }
+};
+
+int blurKernel(int k) {
+    k |= 1; // ensure odd
+    return k < 3 ? 3 : k;
+}
 
-    // Canny - for internal Hough param1, also helps visualize
-    cv::Mat edges;
-    cv::Canny(blurred, edges, params_.cannyLow, params_.cannyHigh);
+// Circles as (x, y, r, votes) from the configured backend.
+void houghCircles(const cv::Mat& blurred,
+    const CoinDetector::Params& p,
+    CircleHough& engine,
+    std::vector<cv::Vec4f>& circles) {
+    if (p.backend == CoinDetector::Backend::Gradient) {
+        CircleHough::Params hp;
+        hp.dp = p.houghDp;
+        hp.minDist = p.houghMinDist;
+        hp.edgeThreshold = p.houghParam1 / 2; // Canny low threshold in OpenCV
+        hp.voteThreshold = p.houghParam2;
+        hp.minRadius = p.minRadius;
+        hp.maxRadius = p.maxRadius;
+        engine.detect(blurred, hp, circles);
+        return;
+    }
 
-    // HoughCircles requires 8-bit image; use blurred or edges (prefer blurred)
-    std::vector<cv::Vec3f> circles;
+    // HoughCircles runs its own Canny (houghParam1) on the blurred image
     cv::HoughCircles(blurred, circles, cv::HOUGH_GRADIENT,
-        params_.houghDp,
-        params_.houghMinDist,
-        params_.houghParam1,
-        params_.houghParam2,
-        params_.minRadius,
-        params_.maxRadius);
+        p.houghDp,
+        p.houghMinDist,
+        p.houghParam1,
+        p.houghParam2,
+        p.minRadius,
+        p.maxRadius);
+}
 
-    std::vector<DetectedCircle> out;
-    out.reserve(circles.size());
+void blurAndHough(const cv::Mat& gray,
+    const CoinDetector::Params& p,
+    DetectorWorkspace& ws,
+    std::vector<cv::Vec4f>& circles) {
+    auto t = Clock::now();
+    int k = blurKernel(p.gaussKernel);
+    cv::GaussianBlur(gray, ws.blurred, cv::Size(k, k), p.gaussSigma);
+    ws.timings.blur += msSince(t);
+    houghCircles(ws.blurred, p, ws.hough, circles);
+    ws.timings.hough += msSince(t);
+}
+
+// Part of the frame a detect() call works on. Candidate centers passed
+// to contains() are relative to `work`.
+struct SearchRegion {
+    cv::Rect work;                  // processed rectangle: area plus padding
+    cv::Rect area;                  // bounding rectangle of the allowed pixels
+    const cv::Mat* masks[2] = {};   // frame-sized, nonzero = allowed
+    bool restricted = false;        // false: the whole frame, nothing to test
+
+    bool contains(float x, float y) const {
+        const int fx = cvFloor(x) + work.x, fy = cvFloor(y) + work.y;
+        if (!area.contains(cv::Point(fx, fy)))
+            return false;
+        for (const cv::Mat* m : masks) {
+            if (m && !m->at<uchar>(fy, fx))
+                return false;
+        }
+        return true;
+    }
+};
+
+// Combines Params::roi, Params::roiPolygon (rasterized once into
+// ws.roiMask) and the caller's mask. `pad` pixels around the allowed
+// area are processed too, so the blur and the gradients at its edge see
+// real pixels instead of the border extrapolation. `work` is empty if
+// nothing is allowed.
+SearchRegion searchRegion(cv::Size frameSize, const cv::Mat& mask,
+    const CoinDetector::Params& p, int pad, DetectorWorkspace& ws) {
+    SearchRegion r;
+    const cv::Rect frame(0, 0, frameSize.width, frameSize.height);
+    r.area = frame;
+    int n = 0;
+
+    if (p.roi.area() > 0) {
+        r.area &= p.roi;
+        r.restricted = true;
+    }
+    if (p.roiPolygon.size() >= 3) {
+        if (ws.roiMask.size() != frameSize || ws.roiMaskPolygon != p.roiPolygon) {
+            ws.roiMask.create(frameSize, CV_8UC1);
+            ws.roiMask.setTo(cv::Scalar(0));
+            cv::fillPoly(ws.roiMask, std::vector<std::vector<cv::Point>>{ p.roiPolygon },
+                cv::Scalar(255));
+            ws.roiMaskPolygon = p.roiPolygon;
+        }
+        r.area &= cv::boundingRect(p.roiPolygon);
+        r.masks[n++] = &ws.roiMask;
+        r.restricted = true;
+    }
+    if (!mask.empty()) {
+        CV_Assert(mask.type() == CV_8UC1 && mask.size() == frameSize);
+        if (!r.area.empty())
+            r.area = cv::boundingRect(mask(r.area)) + r.area.tl();
+        r.masks[n++] = &mask;
+        r.restricted = true;
+    }
+
+    if (!r.area.empty()) {
+        r.work = cv::Rect(r.area.x - pad, r.area.y - pad,
+            r.area.width + 2 * pad, r.area.height + 2 * pad) & frame;
+    }
+    return r;
+}
+
+void keepInside(std::vector<cv::Vec4f>& circles, const SearchRegion& region) {
+    if (!region.restricted)
+        return;
+    circles.erase(std::remove_if(circles.begin(), circles.end(),
+        [&](const cv::Vec4f& c) { return !region.contains(c[0], c[1]); }),
+        circles.end());
+}
+
+void shiftCircles(std::vector<DetectedCircle>& circles, cv::Point offset) {
+    if (offset == cv::Point())
+        return;
     for (auto& c : circles) {
+        c.center.x += float(offset.x);
+        c.center.y += float(offset.y);
+    }
+}
+
+// One magnitude-weighted least-squares (Kasa) circle fit to the edge
+// points of `blurred` within `band` pixels of the circle (cx, cy, r), all
+// in `blurred` coordinates. A pixel is an edge point if its Sobel
+// gradient is strong (|dx|+|dy| >= threshold) and points along the
+// radius (within ~37 degrees, either polarity); weighting by magnitude
+// centers the fit on the middle of the blurred edge profile.
+bool fitCircle(const cv::Mat& blurred, float& cx, float& cy, float& r,
+    int band, int threshold) {
+    const float rin = std::max(0.0f, r - float(band));
+    const float rout = r + float(band);
+
+    // Weighted normal equations of x^2 + y^2 + D x + E y + F = 0 in
+    // coordinates relative to the current center.
+    double sxx = 0, sxy = 0, syy = 0, sx = 0, sy = 0, sw = 0;
+    double sxz = 0, syz = 0, sz = 0;
+    int n = 0;
+
+    const int y0 = std::max(1, int(std::ceil(cy - rout)));
+    const int y1 = std::min(blurred.rows - 2, int(std::floor(cy + rout)));
+    for (int y = y0; y <= y1; ++y) {
+        const float dy = float(y) - cy;
+        const float outer = std::sqrt(std::max(0.0f, rout * rout - dy * dy));
+        const float inner = std::abs(dy) < rin
+            ? std::sqrt(rin * rin - dy * dy) : 0.0f;
+
+        const uchar* u = blurred.ptr<uchar>(y - 1);
+        const uchar* m = blurred.ptr<uchar>(y);
+        const uchar* d = blurred.ptr<uchar>(y + 1);
+
+        // the row crosses the annulus in a left and a right segment
+        const float segs[2][2] = { { cx - outer, cx - inner }, { cx + inner, cx + outer } };
+        for (const auto& seg : segs) {
+            const int xa = std::max(1, int(std::ceil(seg[0])));
+            const int xb = std::min(blurred.cols - 2, int(std::floor(seg[1])));
+            for (int x = xa; x <= xb; ++x) {
+                const int gx = (u[x + 1] - u[x - 1]) + 2 * (m[x + 1] - m[x - 1])
+                    + (d[x + 1] - d[x - 1]);
+                const int gy = (d[x - 1] - u[x - 1]) + 2 * (d[x] - u[x])
+                    + (d[x + 1] - u[x + 1]);
+                const int mag = std::abs(gx) + std::abs(gy);
+                if (mag < threshold)
+                    continue;
+
+                const float dx = float(x) - cx;
+                const float dist2 = dx * dx + dy * dy;
+                const float radial = gx * dx + gy * dy;
+                if (radial * radial < 0.64f * float(gx * gx + gy * gy) * dist2)
+                    continue;
+
+                const double w = mag, z = dist2;
+                sxx += w * dx * dx; sxy += w * dx * dy; syy += w * dy * dy;
+                sx += w * dx; sy += w * dy; sw += w;
+                sxz += w * dx * z; syz += w * dy * z; sz += w * z;
+                n++;
+            }
+        }
+    }
+    if (n < 12)
+        return false;
+
+    // Cramer's rule on
+    //   | sxx sxy sx | |D|   |-sxz|
+    //   | sxy syy sy | |E| = |-syz|
+    //   | sx  sy  sw | |F|   |-sz |
+    const double a = sxx, b = sxy, c = sx, e = syy, f = sy, g = sw;
+    const double det = a * (e * g - f * f) - b * (b * g - f * c) + c * (b * f - e * c);
+    if (std::abs(det) < 1e-9)
+        return false;
+    const double p = -sxz, q = -syz, t = -sz;
+    const double D = (p * (e * g - f * f) - b * (q * g - f * t) + c * (q * f - e * t)) / det;
+    const double E = (a * (q * g - f * t) - p * (b * g - f * c) + c * (b * t - q * c)) / det;
+    const double F = (a * (e * t - q * f) - b * (b * t - q * c) + p * (b * f - e * c)) / det;
+
+    const double ox = -0.5 * D, oy = -0.5 * E;
+    const double rr = ox * ox + oy * oy - F;
+    if (!(rr > 0.0))
+        return false;
+
+    cx += float(ox);
+    cy += float(oy);
+    r = float(std::sqrt(rr));
+    return true;
+}
+
+// Sub-pixel refinement: two fits, the second with the annulus centered
+// on the first. Leaves the circle unchanged and returns false if a fit
+// fails or moves the circle by more than `band` pixels.
+bool refineCircle(const cv::Mat& blurred, float& cx, float& cy, float& r,
+    int band, int threshold) {
+    float x = cx, y = cy, rad = r;
+    for (int pass = 0; pass < 2; ++pass) {
+        if (!fitCircle(blurred, x, y, rad, band, threshold))
+            return false;
+    }
+    if (std::hypot(x - cx, y - cy) > float(band) || std::abs(rad - r) > float(band))
+        return false;
+    cx = x;
+    cy = y;
+    r = rad;
+    return true;
+}
+
+// Hough on a 2^levels downscaled frame, then per-circle re-detection in
+// a full-resolution ROI with a narrow radius range. Coarse hits that are
+// not confirmed at full resolution, or lie outside `region`, are dropped.
+void coarseToFine(const cv::Mat& gray,
+    const CoinDetector::Params& p,
+    const SearchRegion& region,
+    DetectorWorkspace& ws) {
+    auto t = Clock::now();
+    const int scale = 1 << std::min(p.pyramidLevels, 4);
+    cv::Size coarseSize(std::max(1, gray.cols / scale),
+        std::max(1, gray.rows / scale));
+    cv::resize(gray, ws.coarse, coarseSize, 0, 0, cv::INTER_AREA);
+    ws.timings.blur += msSince(t);
+
+    // Lengths shrink by `scale`; the vote count of a circle is roughly
+    // proportional to its circumference, so the threshold shrinks too.
+    CoinDetector::Params cp = p.scaledDown(scale);
+    cp.houghDp = 1;
+    // With the lowered threshold, the blur scaled down with the frame
+    // leaves so many noise edges that HoughCircles gets slower than at
+    // full resolution (x20 on the bundled sets at one level). Blur by
+    // sqrt(2 / scale) of the full-resolution amount instead: all of it
+    // at one level, ~0.7 of it at two.
+    const double blurScale = std::sqrt(2.0 / scale);
+    cp.gaussKernel = int(std::lround(p.gaussKernel * blurScale));
+    cp.gaussSigma = std::max(0.5, p.gaussSigma * blurScale);
+    blurAndHough(ws.coarse, cp, ws, ws.coarseCircles);
+
+    const int k = blurKernel(p.gaussKernel);
+    const int margin = scale + std::max(0, p.refineMargin);
+    const cv::Rect frame(0, 0, gray.cols, gray.rows);
+
+    ws.circles.clear();
+    t = Clock::now();
+    for (const auto& c : ws.coarseCircles) {
+        const float cx = c[0] * scale, cy = c[1] * scale, r = c[2] * scale;
+        if (region.restricted && !region.contains(cx, cy))
+            continue;
+        const int reach = int(std::ceil(r)) + margin + k / 2;
+        cv::Rect roi(int(cx) - reach, int(cy) - reach,
+            2 * reach + 1, 2 * reach + 1);
+        roi &= frame;
+        if (roi.width < 3 || roi.height < 3)
+            continue;
+
+        // Blur into the top-left corner of a grow-only buffer, so ROIs
+        // of different sizes don't reallocate.
+        if (ws.roiBuffer.rows < roi.height || ws.roiBuffer.cols < roi.width) {
+            ws.roiBuffer.create(std::max(ws.roiBuffer.rows, roi.height),
+                std::max(ws.roiBuffer.cols, roi.width), CV_8UC1);
+        }
+        cv::Mat roiBlur = ws.roiBuffer(cv::Rect(0, 0, roi.width, roi.height));
+        cv::GaussianBlur(gray(roi), roiBlur, cv::Size(k, k), p.gaussSigma);
+        ws.timings.blur += msSince(t);
+
+        CoinDetector::Params rp = p;
+        rp.houghDp = 1;
+        rp.houghMinDist = std::max(1, margin);
+        rp.minRadius = std::max(1, int(r) - margin);
+        rp.maxRadius = int(std::ceil(r)) + margin;
+        houghCircles(roiBlur, rp, ws.hough, ws.roiCircles);
+        ws.timings.hough += msSince(t);
+
+        const float px = cx - roi.x, py = cy - roi.y;
+        const cv::Vec4f* best = nullptr;
+        float bestDist = 2.0f * margin;
+        for (const auto& f : ws.roiCircles) {
+            float d = std::hypot(f[0] - px, f[1] - py);
+            if (d <= bestDist) { bestDist = d; best = &f; }
+        }
+        if (!best)
+            continue;
+
+        cv::Vec4f f = *best;
+        if (p.subpixel)
+            refineCircle(roiBlur, f[0], f[1], f[2], p.subpixelBand, p.houghParam1 / 2);
+        ws.timings.refine += msSince(t);
+        ws.circles.push_back(cv::Vec4f(f[0] + roi.x, f[1] + roi.y, f[2], f[3]));
+    }
+}
+
+// Fraction of the circumference with a strong gradient along the radius,
+// counting only the dominant polarity (coin brighter or darker than its
+// surroundings). `scale` maps image coordinates onto `blurred`.
+float edgeSupport(const cv::Mat& blurred, float scale,
+    const DetectedCircle& c, int threshold) {
+    const float cx = c.center.x * scale, cy = c.center.y * scale;
+    const float r = c.radius * scale;
+    const int n = std::clamp(int(2.0f * float(CV_PI) * r), 16, 360);
+
+    int inward = 0, outward = 0;
+    for (int i = 0; i < n; ++i) {
+        const float a = 2.0f * float(CV_PI) * i / n;
+        const float ux = std::cos(a), uy = std::sin(a);
+
+        // best radial response within a pixel of the nominal radius
+        int best = 0, bestMag = 0;
+        for (int dr = -1; dr <= 1; ++dr) {
+            const int x = cvRound(cx + (r + dr) * ux);
+            const int y = cvRound(cy + (r + dr) * uy);
+            if (x < 1 || y < 1 || x >= blurred.cols - 1 || y >= blurred.rows - 1)
+                continue;
+            const uchar* u = blurred.ptr<uchar>(y - 1) + x;
+            const uchar* m = blurred.ptr<uchar>(y) + x;
+            const uchar* d = blurred.ptr<uchar>(y + 1) + x;
+            const int gx = (u[1] - u[-1]) + 2 * (m[1] - m[-1]) + (d[1] - d[-1]);
+            const int gy = (d[-1] - u[-1]) + 2 * (d[0] - u[0]) + (d[1] - u[1]);
+            const float radial = gx * ux + gy * uy;
+            // aligned: radial component >= 0.8 of the gradient length
+            if (radial * radial < 0.64f * float(gx * gx + gy * gy))
+                continue;
+            const int mag = std::abs(gx) + std::abs(gy);
+            if (mag > bestMag) {
+                bestMag = mag;
+                best = radial > 0 ? 1 : -1;
+            }
+        }
+        if (bestMag < threshold)
+            continue;
+        if (best > 0) outward++;
+        else inward++;
+    }
+    return float(std::max(inward, outward)) / float(n);
+}
+
+// Greedy NMS in score order: a circle is dropped if a better one was
+// kept with its center closer than half the smaller radius. Kept circles
+// are bucketed in a grid whose cells are at least that distance wide, so
+// each candidate checks only its 3x3 cell neighbourhood.
+void suppressOverlaps(DetectorWorkspace& ws,
+    std::vector<DetectedCircle>& out) {
+    const auto& cand = ws.candidates;
+    out.clear();
+    if (cand.empty())
+        return;
+
+    auto& order = ws.order;
+    order.resize(cand.size());
+    for (size_t i = 0; i < cand.size(); ++i) order[i] = int(i);
+    // Total order, so the result does not depend on candidate order.
+    std::sort(order.begin(), order.end(), [&](int a, int b) {
+        const auto& p = cand[a];
+        const auto& q = cand[b];
+        if (p.score != q.score) return p.score > q.score;
+        if (p.votes != q.votes) return p.votes > q.votes;
+        if (p.radius != q.radius) return p.radius > q.radius;
+        if (p.center.y != q.center.y) return p.center.y < q.center.y;
+        return p.center.x < q.center.x;
+    });
+
+    float minX = cand[0].center.x, minY = cand[0].center.y;
+    float maxX = minX, maxY = minY, maxR = 0.0f;
+    for (const auto& c : cand) {
+        minX = std::min(minX, c.center.x); maxX = std::max(maxX, c.center.x);
+        minY = std::min(minY, c.center.y); maxY = std::max(maxY, c.center.y);
+        maxR = std::max(maxR, c.radius);
+    }
+    const float cell = std::max(1.0f, 0.5f * maxR);
+    const int gw = int((maxX - minX) / cell) + 1;
+    const int gh = int((maxY - minY) / cell) + 1;
+    ws.gridHead.assign(size_t(gw) * size_t(gh), -1);
+    ws.gridNext.resize(cand.size());
+
+    for (int i : order) {
+        const auto& c = cand[i];
+        const int gx = int((c.center.x - minX) / cell);
+        const int gy = int((c.center.y - minY) / cell);
+
+        bool suppressed = false;
+        for (int y = std::max(0, gy - 1); y <= std::min(gh - 1, gy + 1) && !suppressed; ++y) {
+            for (int x = std::max(0, gx - 1); x <= std::min(gw - 1, gx + 1) && !suppressed; ++x) {
+                for (int j = ws.gridHead[size_t(y) * gw + x]; j >= 0; j = ws.gridNext[j]) {
+                    const auto& k = cand[j];
+                    const float dx = c.center.x - k.center.x;
+                    const float dy = c.center.y - k.center.y;
+                    const float lim = std::min(c.radius, k.radius) * 0.5f;
+                    if (dx * dx + dy * dy < lim * lim) {
+                        suppressed = true;
+                        break;
+                    }
+                }
+            }
+        }
+        if (suppressed)
+            continue;
+
+        int& head = ws.gridHead[size_t(gy) * gw + gx];
+        ws.gridNext[i] = head;
+        head = i;
+        out.push_back(c);
+    }
+}
+
+// Scores ws.circles by edge support on `blurred` (`scale` maps frame
+// coordinates onto it) and writes the survivors of NMS to `out`, then
+// refines them to sub-pixel precision if `refine` is set (pyramid mode
+// refines each circle in its full-resolution ROI instead).
+void scoreAndSuppress(const cv::Mat& blurred, float scale, bool refine,
+    const CoinDetector::Params& p,
+    DetectorWorkspace& ws,
+    std::vector<DetectedCircle>& out) {
+    auto t = Clock::now();
+    const int edgeThreshold = p.houghParam1 / 2;
+
+    auto& cand = ws.candidates;
+    cand.clear();
+    for (auto& c : ws.circles) {
         DetectedCircle d;
         d.center = cv::Point2f(c[0], c[1]);
         d.radius = c[2];
-        d.score = 1.0f; // OpenCV Hough doesn't return score; placeholder
-        out.push_back(d);
-    }
-
-    // Optional: filter overlapping duplicates (simple NMS by center distance)
-    std::vector<bool> keep(out.size(), true);
-    for (size_t i = 0; i < out.size(); ++i) {
-        if (!keep[i]) continue;
-        for (size_t j = i + 1; j < out.size(); ++j) {
-            if (!keep[j]) continue;
-            float dx = out[i].center.x - out[j].center.x;
-            float dy = out[i].center.y - out[j].center.y;
-            float dist = std::sqrt(dx * dx + dy * dy);
-            if (dist < std::min(out[i].radius, out[j].radius) * 0.5f) {
-                // keep larger radius
-                if (out[i].radius >= out[j].radius) keep[j] = false;
-                else keep[i] = false;
-            }
+        d.votes = c[3];
+        d.score = edgeSupport(blurred, scale, d, edgeThreshold);
+        cand.push_back(d);
+    }
+    ws.timings.score = msSince(t);
+
+    suppressOverlaps(ws, out);
+    ws.timings.nms = msSince(t);
+
+    if (refine && p.subpixel) {
+        for (auto& c : out) {
+            refineCircle(blurred, c.center.x, c.center.y, c.radius,
+                p.subpixelBand, edgeThreshold);
+        }
+        ws.timings.refine += msSince(t);
+    }
+}
+
+const char* backendName(CoinDetector::Backend b) {
+    return b == CoinDetector::Backend::Gradient ? "gradient" : "opencv";
+}
+
+} // namespace
+
+bool CoinDetector::Params::load(const std::string& path) {
+    try {
+        cv::FileStorage fs(path, cv::FileStorage::READ);
+        if (!fs.isOpened())
+            return false;
+
+        // parsed into a copy: a file that fails halfway leaves *this
+        // untouched
+        Params p = *this;
+
+        auto get = [&](const char* key, auto& field) {
+            cv::FileNode n = fs[key];
+            if (!n.empty())
+                n >> field;
+        };
+        get("gaussKernel", p.gaussKernel);
+        get("gaussSigma", p.gaussSigma);
+        get("cannyLow", p.cannyLow);
+        get("cannyHigh", p.cannyHigh);
+        get("houghDp", p.houghDp);
+        get("houghMinDist", p.houghMinDist);
+        get("houghParam1", p.houghParam1);
+        get("houghParam2", p.houghParam2);
+        get("minRadius", p.minRadius);
+        get("maxRadius", p.maxRadius);
+        get("pyramidLevels", p.pyramidLevels);
+        get("refineMargin", p.refineMargin);
+        int sub = p.subpixel ? 1 : 0;
+        get("subpixel", sub);
+        p.subpixel = sub != 0;
+        get("subpixelBand", p.subpixelBand);
+        get("roi", p.roi);
+        get("roiPolygon", p.roiPolygon);
+        get("tileSize", p.tileSize);
+
+        std::string b;
+        get("backend", b);
+        if (b == "opencv")
+            p.backend = Backend::OpenCV;
+        else if (!b.empty())
+            return false;
+        *this = std::move(p);
+        return true;
+    }
+    catch (const cv::Exception&) {
+        return false;
+    }
+}
+
+bool CoinDetector::Params::save(const std::string& path) const {
+    try {
+        cv::FileStorage fs(path, cv::FileStorage::WRITE);
+        if (!fs.isOpened())
+            return false;
+
+        fs << "gaussKernel" << gaussKernel;
+        fs << "gaussSigma" << gaussSigma;
+        fs << "cannyLow" << cannyLow;
+        fs << "cannyHigh" << cannyHigh;
+        fs << "houghDp" << houghDp;
+        fs << "houghMinDist" << houghMinDist;
+        fs << "houghParam1" << houghParam1;
+        fs << "houghParam2" << houghParam2;
+        fs << "minRadius" << minRadius;
+        fs << "maxRadius" << maxRadius;
+        fs << "pyramidLevels" << pyramidLevels;
+        fs << "refineMargin" << refineMargin;
+        fs << "subpixel" << int(subpixel);
+        fs << "subpixelBand" << subpixelBand;
+        fs << "roi" << roi;
+        fs << "roiPolygon" << roiPolygon;
+        fs << "tileSize" << tileSize;
+        fs << "backend" << backendName(backend);
+        return true;
+    }
+    catch (const cv::Exception&) {
+        return false;
+    }
+}
+
+CoinDetector::Params CoinDetector::Params::scaledDown(int factor) const {
+    Params s = *this;
+    if (factor <= 1)
+        return s;
+    s.gaussKernel = gaussKernel / factor;
+    s.gaussSigma = std::max(0.5, gaussSigma / factor);
+    s.houghMinDist = std::max(1, houghMinDist / factor);
+    s.houghParam2 = std::max(8, houghParam2 / factor);
+    s.minRadius = std::max(1, minRadius / factor);
+    s.maxRadius = std::max(s.minRadius + 1, (maxRadius + factor - 1) / factor);
+    int log2 = 0;
+    while ((2 << log2) <= factor)
+        log2++;
+    s.pyramidLevels = std::max(0, pyramidLevels - log2);
+
+    if (roi.area() > 0) {
+        // grow to whole pixels, so the region never loses coverage
+        const int x0 = cvFloor(double(roi.x) / factor);
+        const int y0 = cvFloor(double(roi.y) / factor);
+        const int x1 = cvCeil(double(roi.x + roi.width) / factor);
+        const int y1 = cvCeil(double(roi.y + roi.height) / factor);
+        s.roi = cv::Rect(x0, y0, x1 - x0, y1 - y0);
+    }
+    for (auto& pt : s.roiPolygon)
+        pt = cv::Point(cvRound(double(pt.x) / factor), cvRound(double(pt.y) / factor));
+    if (tileSize > 0)
+        s.tileSize = std::max(1, tileSize / factor);
+    return s;
+}
+
+std::vector<DetectedCircle> CoinDetector::detect(const cv::Mat& imgGray) const {
+    return detect(imgGray, cv::Mat());
+}
+
+std::vector<DetectedCircle> CoinDetector::detect(const cv::Mat& imgGray,
+    const cv::Mat& mask) const {
+    thread_local DetectorWorkspace ws;
+    std::vector<DetectedCircle> out;
+    detect(imgGray, mask, ws, out);
+    return out;
+}
+
+void CoinDetector::detect(const cv::Mat& imgGray,
+    DetectorWorkspace& ws,
+    std::vector<DetectedCircle>& out) const {
+    detect(imgGray, cv::Mat(), ws, out);
+}
+
+void CoinDetector::detect(const cv::Mat& imgGray,
+    const cv::Mat& mask,
+    DetectorWorkspace& ws,
+    std::vector<DetectedCircle>& out) const {
+    CV_Assert(imgGray.channels() == 1);
+
+    const BufferState before(ws, out);
+    ws.timings = DetectorTimings{};
+
+    const int pad = blurKernel(params_.gaussKernel) / 2 + 2;
+    const SearchRegion region = searchRegion(imgGray.size(), mask, params_, pad, ws);
+    ws.area = region.work;
+    if (region.work.empty()) {
+        ws.circles.clear();
+        out.clear();
+    }
+    else {
+        // a view: nothing outside the region is blurred or voted on
+        const cv::Mat gray = imgGray(region.work);
+        if (params_.pyramidLevels > 0)
+            coarseToFine(gray, params_, region, ws);
+        else
+            blurAndHough(gray, params_, ws, ws.circles);
+        keepInside(ws.circles, region);
+
+        // In pyramid mode ws.blurred is the coarse level
+        const float scale = float(ws.blurred.cols) / float(gray.cols);
+        scoreAndSuppress(ws.blurred, scale, params_.pyramidLevels <= 0, params_, ws, out);
+        shiftCircles(out, region.work.tl());
+    }
+
+    ws.calls_++;
+    if (BufferState(ws, out) != before)
+        ws.growths_++;
+}
+
+void CoinDetector::detectTiled(const cv::Mat& imgGray,
+    const cv::Mat& mask,
+    ThreadPool& pool,
+    DetectorWorkspace& ws,
+    std::vector<DetectedCircle>& out) const {
+    CV_Assert(imgGray.channels() == 1);
+    CV_Assert(mask.empty() || (mask.type() == CV_8UC1 && mask.size() == imgGray.size()));
+
+    // a circle centered in a tile's own part lies inside the tile plus
+    // this margin, its blur, scoring and refinement band included
+    const int tile = params_.tileSize > 0 ? params_.tileSize : 1024;
+    const int margin = std::max(params_.maxRadius, 1)
+        + blurKernel(params_.gaussKernel) / 2
+        + std::max(params_.subpixelBand, params_.refineMargin) + 2;
+    if (imgGray.cols <= tile + 2 * margin && imgGray.rows <= tile + 2 * margin) {
+        detect(imgGray, mask, ws, out);
+        return;
+    }
+
+    const BufferState before(ws, out);
+    ws.timings = DetectorTimings{};
+    const cv::Rect frame(0, 0, imgGray.cols, imgGray.rows);
+    ws.area = frame;
+
+    struct TileResult {
+        std::vector<DetectedCircle> circles;
+        DetectorTimings timings;
+    };
+    std::vector<std::future<TileResult>> tiles;
+    std::vector<cv::Rect> cores;
+    for (int y = 0; y < imgGray.rows; y += tile) {
+        for (int x = 0; x < imgGray.cols; x += tile) {
+            const cv::Rect core = cv::Rect(x, y, tile, tile) & frame;
+            const cv::Rect rect = cv::Rect(x - margin, y - margin,
+                tile + 2 * margin, tile + 2 * margin) & frame;
+            cores.push_back(core);
+
+            tiles.push_back(pool.submit([this, &imgGray, &mask, core, rect] {
+                TileResult res;
+
+                // the search region is in frame coordinates
+                Params p = params_;
+                p.tileSize = 0;
+                if (p.roi.area() > 0) {
+                    p.roi &= rect;
+                    if (p.roi.empty())
+                        return res;
+                    p.roi.x -= rect.x;
+                    p.roi.y -= rect.y;
+                }
+                for (auto& pt : p.roiPolygon)
+                    pt -= rect.tl();
+
+                thread_local DetectorWorkspace tileWs;
+                const cv::Mat tileMask = mask.empty() ? cv::Mat() : mask(rect);
+                CoinDetector(p).detect(imgGray(rect), tileMask, tileWs, res.circles);
+                res.timings = tileWs.timings;
+
+                // the rest belongs to a neighbour
+                shiftCircles(res.circles, rect.tl());
+                res.circles.erase(std::remove_if(res.circles.begin(), res.circles.end(),
+                    [&](const DetectedCircle& c) {
+                        return !core.contains(cv::Point(cvFloor(c.center.x), cvFloor(c.center.y)));
+                    }), res.circles.end());
+                return res;
+            }));
         }
     }
-    std::vector<DetectedCircle> filtered;
-    for (size_t i = 0; i < out.size(); ++i) if (keep[i]) filtered.push_back(out[i]);
-    return filtered;
+
+    // every task borrows the frame: let them all finish before a failed
+    // one can throw out of here
+    for (auto& f : tiles)
+        f.wait();
+
+    auto& cand = ws.candidates;
+    cand.clear();
+    std::vector<int> owner;             // tile of each candidate
+    for (size_t i = 0; i < tiles.size(); ++i) {
+        TileResult res = tiles[i].get();
+        cand.insert(cand.end(), res.circles.begin(), res.circles.end());
+        owner.resize(cand.size(), int(i));
+        ws.timings.blur += res.timings.blur;
+        ws.timings.hough += res.timings.hough;
+        ws.timings.score += res.timings.score;
+        ws.timings.nms += res.timings.nms;
+        ws.timings.refine += res.timings.refine;
+    }
+
+    // HoughCircles keeps no two centers closer than houghMinDist (the
+    // one with more votes wins), but each tile only sees its own: apply
+    // the same rule to pairs from different tiles. Both centers are then
+    // within houghMinDist of their tile's edge.
+    auto t = Clock::now();
+    const float minDist = float(std::max(1, params_.houghMinDist));
+    std::vector<int> border;
+    for (size_t i = 0; i < cand.size(); ++i) {
+        const cv::Rect& r = cores[size_t(owner[i])];
+        const cv::Point2f c = cand[i].center;
+        if (c.x - r.x < minDist || r.x + r.width - c.x < minDist ||
+            c.y - r.y < minDist || r.y + r.height - c.y < minDist)
+            border.push_back(int(i));
+    }
+    std::sort(border.begin(), border.end(), [&](int a, int b) {
+        const auto& p = cand[a];
+        const auto& q = cand[b];
+        if (p.votes != q.votes) return p.votes > q.votes;
+        if (p.center.y != q.center.y) return p.center.y < q.center.y;
+        return p.center.x < q.center.x;
+    });
+    std::vector<char> dropped(cand.size(), 0);
+    for (size_t i = 0; i < border.size(); ++i) {
+        const int a = border[i];
+        if (dropped[a])
+            continue;
+        for (size_t j = i + 1; j < border.size(); ++j) {
+            const int b = border[j];
+            const float dx = cand[a].center.x - cand[b].center.x;
+            const float dy = cand[a].center.y - cand[b].center.y;
+            if (owner[a] != owner[b] && dx * dx + dy * dy < minDist * minDist)
+                dropped[b] = 1;
+        }
+    }
+    size_t kept = 0;
+    for (size_t i = 0; i < cand.size(); ++i)
+        if (!dropped[i])
+            cand[kept++] = cand[i];
+    cand.resize(kept);
+
+    // a coin on a tile border can still be found, slightly shifted, by
+    // both tiles with its center on either side
+    suppressOverlaps(ws, out);
+    ws.timings.nms += msSince(t);
+
+    ws.calls_++;
+    if (BufferState(ws, out) != before)
+        ws.growths_++;
+}
+
+void CoinDetector::detectBlurred(const cv::Mat& blurred,
+    DetectorWorkspace& ws,
+    std::vector<DetectedCircle>& out) const {
+    CV_Assert(blurred.type() == CV_8UC1);
+
+    const BufferState before(ws, out);
+    ws.timings = DetectorTimings{};
+
+    const SearchRegion region = searchRegion(blurred.size(), cv::Mat(), params_, 2, ws);
+    ws.area = region.work;
+    if (region.work.empty()) {
+        ws.circles.clear();
+        out.clear();
+    }
+    else {
+        const cv::Mat view = blurred(region.work);
+        auto t = Clock::now();
+        houghCircles(view, params_, ws.hough, ws.circles);
+        keepInside(ws.circles, region);
+        ws.timings.hough = msSince(t);
+        scoreAndSuppress(view, 1.0f, true, params_, ws, out);
+        shiftCircles(out, region.work.tl());
+    }
+
+    ws.calls_++;
+    if (BufferState(ws, out) != before)
+        ws.growths_++;
+}
+
+void CoinDetector::detect(const cv::Mat& imgGray,
+    DetectorWorkspace& ws,
+    DetectionResult& res,
+    unsigned outputs,
+    const cv::Mat& mask) const {
+    detect(imgGray, mask, ws, res.circles);
+    res.area = ws.area;
+    if (ws.area.empty())
+        outputs = OutputNone;
+
+    if (outputs & OutputBlurred)
+        ws.blurred.copyTo(res.blurred);
+    else
+        res.blurred.release();
+
+    if (outputs & OutputEdges)
+        cv::Canny(ws.blurred, res.edges, params_.cannyLow, params_.cannyHigh);
+    else
+        res.edges.release();
+
+    if (outputs & OutputGradient) {
+        cv::Sobel(ws.blurred, res.gradX, CV_16S, 1, 0);
+        cv::Sobel(ws.blurred, res.gradY, CV_16S, 0, 1);
+    }
+    else {
+        res.gradX.release();
+        res.gradY.release();
+    }
 }
@@ -0,0 +1,213 @@
+#include "dataset_pack.hpp"
+#include <opencv2/imgcodecs.hpp>
+#include <cstring>
+#include <filesystem>
+
+namespace {
+constexpr char kMagic[8] = { 'C', 'O', 'I', 'N', 'P', 'A', 'C', 'K' };
+constexpr uint32_t kVersion = 1;
+constexpr uint64_t kAlign = 64;
+
+bool inside(uint64_t offset, uint64_t size, uint64_t fileSize) {
+    return offset <= fileSize && size <= fileSize - offset;
+}
+}
+
+// ------------------------------------------------------------
+// DatasetPackWriter
+// ------------------------------------------------------------
+
+DatasetPackWriter::~DatasetPackWriter() {
+    if (f_)
+        std::fclose(f_);
+}
+
+bool DatasetPackWriter::write(const void* data, size_t size) {
+    if (size && std::fwrite(data, 1, size, f_) != size)
+        return false;
+    pos_ += size;
+    return true;
+}
+
+bool DatasetPackWriter::pad() {
+    static const char zeros[kAlign] = {};
+    size_t n = size_t((kAlign - pos_ % kAlign) % kAlign);
+    return write(zeros, n);
+}
+
+bool DatasetPackWriter::open(const std::string& path, bool compress) {
+    if (f_)
+        std::fclose(f_);
+    f_ = std::fopen(path.c_str(), "wb");
+    if (!f_)
+        return false;
+
+    compress_ = compress;
+    pos_ = 0;
+    entries_.clear();
+    circles_.clear();
+    names_.clear();
+
+    // placeholder with a zeroed magic; finish() rewrites it, so a
+    // half-written pack never opens
+    PackHeader h{};
+    return write(&h, sizeof(h));
+}
+
+bool DatasetPackWriter::add(const std::string& name, const cv::Mat& gray,
+    const std::vector<LabelCircle>* labels) {
+    if (!f_ || gray.empty() || gray.type() != CV_8UC1)
+        return false;
+    if (!pad())
+        return false;
+
+    PackEntry e{};
+    e.offset = pos_;
+    e.width = uint32_t(gray.cols);
+    e.height = uint32_t(gray.rows);
+    e.stride = uint32_t(gray.cols);
+
+    if (compress_) {
+        // fastest zlib level: the point is a cheap decode, not the ratio
+        if (!cv::imencode(".png", gray, encoded_, { cv::IMWRITE_PNG_COMPRESSION, 1 }))
+            return false;
+        e.flags |= PackEntry::Compressed;
+        if (!write(encoded_.data(), encoded_.size()))
+            return false;
+    }
+    else {
+        for (int y = 0; y < gray.rows; ++y) {
+            if (!write(gray.ptr(y), size_t(gray.cols)))
+                return false;
+        }
+    }
+    e.size = pos_ - e.offset;
+
+    if (labels) {
+        e.flags |= PackEntry::HasLabels;
+        e.firstCircle = uint32_t(circles_.size());
+        e.circleCount = uint32_t(labels->size());
+        circles_.insert(circles_.end(), labels->begin(), labels->end());
+    }
+
+    e.nameOffset = uint32_t(names_.size());
+    e.nameSize = uint32_t(name.size());
+    names_ += name;
+
+    entries_.push_back(e);
+    return true;
+}
+
+bool DatasetPackWriter::finish() {
+    if (!f_)
+        return false;
+
+    PackHeader h{};
+    h.version = kVersion;
+    h.count = uint32_t(entries_.size());
+
+    bool ok = pad();
+    h.circlesOffset = pos_;
+    h.circleCount = circles_.size();
+    ok = ok && write(circles_.data(), circles_.size() * sizeof(LabelCircle));
+
+    h.namesOffset = pos_;
+    h.namesSize = names_.size();
+    ok = ok && write(names_.data(), names_.size()) && pad();
+
+    h.indexOffset = pos_;
+    ok = ok && write(entries_.data(), entries_.size() * sizeof(PackEntry));
+
+    // header last: only a complete pack gets the magic
+    std::memcpy(h.magic, kMagic, sizeof(kMagic));
+    ok = ok && std::fseek(f_, 0, SEEK_SET) == 0 &&
+        std::fwrite(&h, sizeof(h), 1, f_) == 1;
+    ok = (std::fclose(f_) == 0) && ok;
+    f_ = nullptr;
+    return ok;
+}
+
+// ------------------------------------------------------------
+// DatasetPack
+// ------------------------------------------------------------
+
+bool DatasetPack::isPackPath(const std::string& path) {
+    return std::filesystem::path(path).extension() == ".pack";
+}
+
+bool DatasetPack::open(const std::string& path) {
+    close();
+    if (!file_.open(path))
+        return false;
+
+    const uint64_t size = file_.size();
+    if (size < sizeof(PackHeader)) {
+        close();
+        return false;
+    }
+    const char* base = file_.data();
+    auto h = reinterpret_cast<const PackHeader*>(base);
+    if (std::memcmp(h->magic, kMagic, sizeof(kMagic)) != 0 || h->version != kVersion ||
+        !inside(h->indexOffset, uint64_t(h->count) * sizeof(PackEntry), size) ||
+        !inside(h->circlesOffset, h->circleCount * sizeof(LabelCircle), size) ||
+        !inside(h->namesOffset, h->namesSize, size) ||
+        h->indexOffset % alignof(PackEntry) || h->circlesOffset % alignof(LabelCircle)) {
+        close();
+        return false;
+    }
+
+    auto entries = reinterpret_cast<const PackEntry*>(base + h->indexOffset);
+    for (uint32_t i = 0; i < h->count; ++i) {
+        const PackEntry& e = entries[i];
+        const bool raw = !(e.flags & PackEntry::Compressed);
+        if (!inside(e.offset, e.size, size) ||
+            (raw && (e.stride < e.width || e.size < uint64_t(e.stride) * e.height)) ||
+            uint64_t(e.firstCircle) + e.circleCount > h->circleCount ||
+            uint64_t(e.nameOffset) + e.nameSize > h->namesSize) {
+            close();
+            return false;
+        }
+    }
+
+    header_ = h;
+    entries_ = entries;
+    circles_ = reinterpret_cast<const LabelCircle*>(base + h->circlesOffset);
+    names_ = base + h->namesOffset;
+    return true;
+}
+
+void DatasetPack::close() {
+    file_.close();
+    header_ = nullptr;
+    entries_ = nullptr;
+    circles_ = nullptr;
+    names_ = nullptr;
+}
+
+std::string_view DatasetPack::name(size_t i) const {
+    const PackEntry& e = entries_[i];
+    return { names_ + e.nameOffset, e.nameSize };
+}
+
+cv::Mat DatasetPack::gray(size_t i) const {
+    const PackEntry& e = entries_[i];
+    // the mapping is read-only; the const_cast only satisfies cv::Mat
+    auto* p = const_cast<char*>(file_.data() + e.offset);
+    if (e.flags & PackEntry::Compressed)
+        return cv::imdecode(cv::Mat(1, int(e.size), CV_8UC1, p), cv::IMREAD_GRAYSCALE);
+    return cv::Mat(int(e.height), int(e.width), CV_8UC1, p, e.stride);
+}
+
+std::span<const LabelCircle> DatasetPack::labels(size_t i) const {
+    const PackEntry& e = entries_[i];
+    return { circles_ + e.firstCircle, e.circleCount };
+}
+
+std::vector<GTCircle> DatasetPack::groundTruth(size_t i) const {
+    std::vector<GTCircle> out;
+    auto l = labels(i);
+    out.reserve(l.size());
+    for (const auto& c : l)
+        out.push_back({ cv::Point2f(c.cx, c.cy), c.r });
+    return out;
+}
@@ -1,34 +1,475 @@
 #include "evaluator.hpp"
+#include <algorithm>
 #include <cmath>
+#include <limits>
+#include <numeric>
 
-Evaluator::Evaluator(float match_tol, float radius_tol) : match_tol_(match_tol), radius_tol_(radius_tol) {}
+namespace {
 
-EvalResult Evaluator::evaluate(const std::vector<DetectedCircle>& dets, const std::vector<GTCircle>& gts) const {
-    EvalResult res;
-    std::vector<bool> gt_used(gts.size(), false);
-    // For each detection, find best matching GT
-    for (const auto& d : dets) {
-        int best_idx = -1;
-        float best_dist = 1e9;
+constexpr float kPi = 3.14159265358979f;
+
+// A detection/GT pair that may match; quality in (0, 1], higher is better
+// (the IoU, or 1 - distance/match_tol for the tolerance criterion).
+struct Pair {
+    int det;
+    int gt;
+    float quality;
+};
+
+// Uniform grid over GT centers, stored as one sorted index array plus
+// per-cell offsets, so a lookup touches only the cells within reach.
+class GtGrid {
+public:
+    GtGrid(const std::vector<GTCircle>& gts, float cell) {
+        if (gts.empty())
+            return;
+        float x0 = gts[0].center.x, y0 = gts[0].center.y;
+        float x1 = x0, y1 = y0;
+        for (const auto& g : gts) {
+            x0 = std::min(x0, g.center.x);
+            y0 = std::min(y0, g.center.y);
+            x1 = std::max(x1, g.center.x);
+            y1 = std::max(y1, g.center.y);
+        }
+        // keep the grid small for sparse or huge coordinates
+        cell_ = std::max({ cell, 1.0f, (x1 - x0) / 256.0f, (y1 - y0) / 256.0f });
+        ox_ = x0;
+        oy_ = y0;
+        cols_ = int((x1 - x0) / cell_) + 1;
+        rows_ = int((y1 - y0) / cell_) + 1;
+
+        start_.assign(size_t(cols_) * rows_ + 1, 0);
+        std::vector<int> cellOf(gts.size());
         for (size_t i = 0; i < gts.size(); ++i) {
-            if (gt_used[i]) continue;
-            float dx = d.center.x - gts[i].center.x;
-            float dy = d.center.y - gts[i].center.y;
-            float dist = std::sqrt(dx * dx + dy * dy);
-            float radius_diff = std::abs(d.radius - gts[i].radius) / gts[i].radius;
-            if (dist <= match_tol_ && radius_diff <= radius_tol_) {
-                if (dist < best_dist) { best_dist = dist; best_idx = int(i); }
+            cellOf[i] = cellIndex(gts[i].center.x, gts[i].center.y);
+            start_[cellOf[i] + 1]++;
+        }
+        std::partial_sum(start_.begin(), start_.end(), start_.begin());
+        items_.resize(gts.size());
+        std::vector<int> fill(start_.begin(), start_.end() - 1);
+        for (size_t i = 0; i < gts.size(); ++i)
+            items_[fill[cellOf[i]]++] = int(i);
+    }
+
+    // Calls fn(gt index) for every GT whose center may lie within
+    // `reach` of (x, y).
+    template <typename Fn>
+    void near(float x, float y, float reach, Fn fn) const {
+        if (items_.empty())
+            return;
+        int cx0 = std::max(0, int(std::floor((x - reach - ox_) / cell_)));
+        int cy0 = std::max(0, int(std::floor((y - reach - oy_) / cell_)));
+        int cx1 = std::min(cols_ - 1, int(std::floor((x + reach - ox_) / cell_)));
+        int cy1 = std::min(rows_ - 1, int(std::floor((y + reach - oy_) / cell_)));
+        for (int cy = cy0; cy <= cy1; ++cy) {
+            for (int cx = cx0; cx <= cx1; ++cx) {
+                size_t c = size_t(cy) * cols_ + cx;
+                for (int k = start_[c]; k < start_[c + 1]; ++k)
+                    fn(items_[k]);
+            }
+        }
+    }
+
+private:
+    int cellIndex(float x, float y) const {
+        int cx = std::clamp(int((x - ox_) / cell_), 0, cols_ - 1);
+        int cy = std::clamp(int((y - oy_) / cell_), 0, rows_ - 1);
+        return cy * cols_ + cx;
+    }
+
+    float cell_ = 1.0f, ox_ = 0.0f, oy_ = 0.0f;
+    int cols_ = 0, rows_ = 0;
+    std::vector<int> start_;
+    std::vector<int> items_;
+};
+
+float maxRadius(const std::vector<GTCircle>& gts) {
+    float r = 0.0f;
+    for (const auto& g : gts)
+        r = std::max(r, g.radius);
+    return r;
+}
+
+// Pairs whose circles overlap with IoU >= min_iou.
+std::vector<Pair> iouPairs(const std::vector<DetectedCircle>& dets,
+    const std::vector<GTCircle>& gts, float min_iou) {
+    std::vector<Pair> pairs;
+    const float max_r = maxRadius(gts);
+    GtGrid grid(gts, 2.0f * max_r);
+    for (size_t d = 0; d < dets.size(); ++d) {
+        const auto& det = dets[d];
+        grid.near(det.center.x, det.center.y, det.radius + max_r, [&](int g) {
+            float iou = circleIoU(det.center, det.radius, gts[g].center, gts[g].radius);
+            if (iou > 0.0f && iou >= min_iou)
+                pairs.push_back({ int(d), g, iou });
+        });
+    }
+    return pairs;
+}
+
+// Detections by descending score; ties by position, so the order does
+// not depend on the order the detector produced them in.
+std::vector<int> scoreOrder(const std::vector<DetectedCircle>& dets) {
+    std::vector<int> order(dets.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&](int a, int b) {
+        const auto& p = dets[a];
+        const auto& q = dets[b];
+        if (p.score != q.score) return p.score > q.score;
+        if (p.center.x != q.center.x) return p.center.x < q.center.x;
+        if (p.center.y != q.center.y) return p.center.y < q.center.y;
+        return p.radius < q.radius;
+    });
+    return order;
+}
+
+// det -> gt (or -1). Each detection, best score first, takes its best
+// free GT.
+std::vector<int> greedyMatch(std::vector<Pair> pairs, const std::vector<int>& order,
+    size_t num_dets, size_t num_gts) {
+    std::sort(pairs.begin(), pairs.end(), [](const Pair& a, const Pair& b) {
+        if (a.det != b.det) return a.det < b.det;
+        if (a.quality != b.quality) return a.quality > b.quality;
+        return a.gt < b.gt;
+    });
+    std::vector<int> first(num_dets + 1, 0);
+    for (const auto& p : pairs)
+        first[p.det + 1]++;
+    std::partial_sum(first.begin(), first.end(), first.begin());
+
+    std::vector<int> match(num_dets, -1);
+    std::vector<bool> gt_used(num_gts, false);
+    for (int d : order) {
+        for (int k = first[d]; k < first[d + 1]; ++k) {
+            if (!gt_used[pairs[k].gt]) {
+                gt_used[pairs[k].gt] = true;
+                match[d] = pairs[k].gt;
+                break;
+            }
+        }
+    }
+    return match;
+}
+
+// Minimum-cost assignment of the n rows to distinct columns of an n x m
+// cost matrix (n <= m), Hungarian algorithm with potentials, O(n^2 m).
+// Returns the column of each row.
+std::vector<int> hungarian(const std::vector<double>& cost, int n, int m) {
+    const double inf = std::numeric_limits<double>::infinity();
+    std::vector<double> u(n + 1, 0.0), v(m + 1, 0.0);
+    std::vector<int> p(m + 1, 0), way(m + 1, 0);
+    for (int i = 1; i <= n; ++i) {
+        p[0] = i;
+        int j0 = 0;
+        std::vector<double> minv(m + 1, inf);
+        std::vector<bool> used(m + 1, false);
+        do {
+            used[j0] = true;
+            int i0 = p[j0], j1 = 0;
+            double delta = inf;
+            for (int j = 1; j <= m; ++j) {
+                if (used[j])
+                    continue;
+                double cur = cost[size_t(i0 - 1) * m + (j - 1)] - u[i0] - v[j];
+                if (cur < minv[j]) {
+                    minv[j] = cur;
+                    way[j] = j0;
+                }
+                if (minv[j] < delta) {
+                    delta = minv[j];
+                    j1 = j;
+                }
+            }
+            for (int j = 0; j <= m; ++j) {
+                if (used[j]) {
+                    u[p[j]] += delta;
+                    v[j] -= delta;
+                }
+                else {
+                    minv[j] -= delta;
+                }
+            }
+            j0 = j1;
+        } while (p[j0] != 0);
+        do {
+            int j1 = way[j0];
+            p[j0] = p[j1];
+            j0 = j1;
+        } while (j0);
+    }
+    std::vector<int> col(n, -1);
+    for (int j = 1; j <= m; ++j) {
+        if (p[j])
+            col[p[j] - 1] = j - 1;
+    }
+    return col;
+}
+
+int findRoot(std::vector<int>& parent, int x) {
+    while (parent[x] != x) {
+        parent[x] = parent[parent[x]];
+        x = parent[x];
+    }
+    return x;
+}
+
+// det -> gt (or -1) with the most matches and, among those, the highest
+// total quality. The pair graph splits into small connected components
+// (a few detections around each coin); each gets its own dense
+// Hungarian problem.
+std::vector<int> optimalMatch(const std::vector<Pair>& pairs,
+    size_t num_dets, size_t num_gts) {
+    std::vector<int> match(num_dets, -1);
+    if (pairs.empty())
+        return match;
+
+    const int nd = int(num_dets);
+    std::vector<int> parent(num_dets + num_gts);
+    std::iota(parent.begin(), parent.end(), 0);
+    for (const auto& p : pairs)
+        parent[findRoot(parent, p.det)] = findRoot(parent, nd + p.gt);
+
+    // group pairs by component
+    std::vector<int> order(pairs.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::vector<int> comp(pairs.size());
+    for (size_t k = 0; k < pairs.size(); ++k)
+        comp[k] = findRoot(parent, pairs[k].det);
+    std::sort(order.begin(), order.end(), [&](int a, int b) { return comp[a] < comp[b]; });
+
+    std::vector<int> dets, gts;
+    std::vector<int> local(num_dets + num_gts, -1);
+    std::vector<double> cost;
+    for (size_t begin = 0; begin < order.size();) {
+        size_t end = begin;
+        while (end < order.size() && comp[order[end]] == comp[order[begin]])
+            ++end;
+
+        if (end - begin == 1) {
+            const Pair& p = pairs[order[begin]];
+            match[p.det] = p.gt;
+            begin = end;
+            continue;
+        }
+
+        dets.clear();
+        gts.clear();
+        for (size_t k = begin; k < end; ++k) {
+            const Pair& p = pairs[order[k]];
+            if (local[p.det] < 0) {
+                local[p.det] = int(dets.size());
+                dets.push_back(p.det);
+            }
+            if (local[nd + p.gt] < 0) {
+                local[nd + p.gt] = int(gts.size());
+                gts.push_back(p.gt);
             }
         }
-        if (best_idx >= 0) {
-            res.TP++;
-            gt_used[best_idx] = true;
+
+        // rows = the smaller side; a missing pair costs more than all
+        // real pairs together, so the count of matches comes first
+        const bool rows_are_dets = dets.size() <= gts.size();
+        const int n = int(rows_are_dets ? dets.size() : gts.size());
+        const int m = int(rows_are_dets ? gts.size() : dets.size());
+        const double missing = double(n) + 1.0;
+        cost.assign(size_t(n) * m, missing);
+        for (size_t k = begin; k < end; ++k) {
+            const Pair& p = pairs[order[k]];
+            int di = local[p.det], gi = local[nd + p.gt];
+            int r = rows_are_dets ? di : gi, c = rows_are_dets ? gi : di;
+            cost[size_t(r) * m + c] = 1.0 - p.quality;
         }
-        else {
-            res.FP++;
+
+        std::vector<int> col = hungarian(cost, n, m);
+        for (int r = 0; r < n; ++r) {
+            int c = col[r];
+            if (c < 0 || cost[size_t(r) * m + c] >= missing)
+                continue;
+            int d = rows_are_dets ? dets[r] : dets[c];
+            int g = rows_are_dets ? gts[c] : gts[r];
+            match[d] = g;
         }
+
+        for (int d : dets) local[d] = -1;
+        for (int g : gts) local[nd + g] = -1;
+        begin = end;
+    }
+    return match;
+}
+
+std::vector<int> matchPairs(const std::vector<Pair>& pairs, Evaluator::Matching matching,
+    const std::vector<int>& order, size_t num_dets, size_t num_gts) {
+    if (matching == Evaluator::Matching::Optimal)
+        return optimalMatch(pairs, num_dets, num_gts);
+    return greedyMatch(pairs, order, num_dets, num_gts);
+}
+
+} // namespace
+
+float circleIoU(cv::Point2f c1, float r1, cv::Point2f c2, float r2) {
+    if (r1 <= 0.0f || r2 <= 0.0f)
+        return 0.0f;
+    const float dx = c1.x - c2.x, dy = c1.y - c2.y;
+    const float d = std::sqrt(dx * dx + dy * dy);
+    if (d >= r1 + r2)
+        return 0.0f;
+
+    const float a1 = kPi * r1 * r1, a2 = kPi * r2 * r2;
+    float inter;
+    if (d <= std::abs(r1 - r2)) {
+        inter = std::min(a1, a2);   // one inside the other
+    }
+    else {
+        float alpha = std::acos(std::clamp((d * d + r1 * r1 - r2 * r2) / (2 * d * r1), -1.0f, 1.0f));
+        float beta = std::acos(std::clamp((d * d + r2 * r2 - r1 * r1) / (2 * d * r2), -1.0f, 1.0f));
+        float k = (-d + r1 + r2) * (d + r1 - r2) * (d - r1 + r2) * (d + r1 + r2);
+        inter = r1 * r1 * alpha + r2 * r2 * beta - 0.5f * std::sqrt(std::max(0.0f, k));
+    }
+    return inter / (a1 + a2 - inter);
+}
+
+Evaluator::Evaluator(float match_tol, float radius_tol) : match_tol_(match_tol), radius_tol_(radius_tol) {}
+
+EvalResult Evaluator::evaluate(const std::vector<DetectedCircle>& dets, const std::vector<GTCircle>& gts) const {
+    EvalResult res;
+
+    // candidate pairs from a grid over the GT centers instead of all D x G
+    std::vector<Pair> pairs;
+    if (iou_ > 0.0f) {
+        pairs = iouPairs(dets, gts, iou_);
+    }
+    else {
+        GtGrid grid(gts, match_tol_);
+        for (size_t d = 0; d < dets.size(); ++d) {
+            const auto& det = dets[d];
+            grid.near(det.center.x, det.center.y, match_tol_, [&](int i) {
+                float dx = det.center.x - gts[i].center.x;
+                float dy = det.center.y - gts[i].center.y;
+                float dist = std::sqrt(dx * dx + dy * dy);
+                float radius_diff = std::abs(det.radius - gts[i].radius) / gts[i].radius;
+                if (dist <= match_tol_ && radius_diff <= radius_tol_)
+                    pairs.push_back({ int(d), i, 1.0f - 0.5f * dist / match_tol_ });
+            });
+        }
+    }
+
+    std::vector<int> order;
+    if (matching_ == Matching::Greedy)
+        order = scoreOrder(dets);
+    std::vector<int> match = matchPairs(pairs, matching_, order, dets.size(), gts.size());
+
+    for (int g : match) {
+        if (g >= 0) res.TP++;
+        else res.FP++;
     }
     // remaining unmatched GT are FN
-    for (size_t i = 0; i < gts.size(); ++i) if (!gt_used[i]) res.FN++;
+    res.FN = int(gts.size()) - res.TP;
     return res;
 }
+
+// ------------------------------------------------------------
+// APAccumulator
+// ------------------------------------------------------------
+
+APAccumulator::APAccumulator(std::vector<float> ious, Evaluator::Matching matching)
+    : ious_(std::move(ious)), matching_(matching) {
+    if (ious_.empty()) {
+        for (int i = 0; i < 10; ++i)
+            ious_.push_back(0.5f + 0.05f * float(i));
+    }
+    tp_.resize(ious_.size());
+}
+
+void APAccumulator::add(const std::vector<DetectedCircle>& dets, const std::vector<GTCircle>& gts) {
+    num_gt_ += gts.size();
+    if (dets.empty())
+        return;
+
+    // overlap pairs once, at the loosest threshold
+    const float min_iou = *std::min_element(ious_.begin(), ious_.end());
+    const std::vector<Pair> all = iouPairs(dets, gts, min_iou);
+    const std::vector<int> order = scoreOrder(dets);
+
+    // detections are stored in score order, so the curves do not depend
+    // on the order the detector produced them in
+    for (int d : order)
+        scores_.push_back(dets[d].score);
+
+    std::vector<Pair> pairs;
+    for (size_t t = 0; t < ious_.size(); ++t) {
+        pairs.clear();
+        for (const auto& p : all) {
+            if (p.quality >= ious_[t])
+                pairs.push_back(p);
+        }
+        std::vector<int> match = matchPairs(pairs, matching_, order, dets.size(), gts.size());
+        for (int d : order)
+            tp_[t].push_back(match[d] >= 0 ? 1 : 0);
+    }
+}
+
+void APAccumulator::merge(const APAccumulator& other) {
+    if (other.ious_ != ious_)
+        return;
+    scores_.insert(scores_.end(), other.scores_.begin(), other.scores_.end());
+    for (size_t t = 0; t < tp_.size(); ++t)
+        tp_[t].insert(tp_[t].end(), other.tp_[t].begin(), other.tp_[t].end());
+    num_gt_ += other.num_gt_;
+}
+
+std::vector<PRCurve> APAccumulator::curves(bool points) const {
+    // one sort by score for every threshold
+    std::vector<size_t> order(scores_.size());
+    std::iota(order.begin(), order.end(), size_t(0));
+    std::stable_sort(order.begin(), order.end(),
+        [&](size_t a, size_t b) { return scores_[a] > scores_[b]; });
+
+    std::vector<PRCurve> out(ious_.size());
+    std::vector<float> precision(order.size()), recall(order.size());
+    for (size_t t = 0; t < ious_.size(); ++t) {
+        PRCurve& c = out[t];
+        c.iou = ious_[t];
+
+        size_t tp = 0;
+        for (size_t k = 0; k < order.size(); ++k) {
+            tp += tp_[t][order[k]];
+            precision[k] = float(tp) / float(k + 1);
+            recall[k] = num_gt_ ? float(tp) / float(num_gt_) : 0.0f;
+        }
+        if (points) {
+            c.precision = precision;
+            c.recall = recall;
+            c.score.resize(order.size());
+            for (size_t k = 0; k < order.size(); ++k)
+                c.score[k] = scores_[order[k]];
+        }
+
+        if (num_gt_ == 0 || order.empty())
+            continue;
+
+        // precision envelope (best precision at this recall or higher),
+        // sampled at recall 0, 0.01, .. 1
+        std::vector<float> envelope(precision);
+        for (size_t k = envelope.size() - 1; k > 0; --k)
+            envelope[k - 1] = std::max(envelope[k - 1], envelope[k]);
+        double sum = 0.0;
+        for (int i = 0; i <= 100; ++i) {
+            float r = float(i) / 100.0f;
+            auto it = std::lower_bound(recall.begin(), recall.end(), r);
+            if (it != recall.end())
+                sum += envelope[size_t(it - recall.begin())];
+        }
+        c.ap = sum / 101.0;
+    }
+    return out;
+}
+
+double APAccumulator::meanAP() const {
+    auto c = curves();
+    if (c.empty())
+        return 0.0;
+    double sum = 0.0;
+    for (const auto& x : c)
+        sum += x.ap;
+    return sum / double(c.size());
+}
@@ -0,0 +1,75 @@
+#include "image_io.hpp"
+#include "mapped_file.hpp"
+#include <opencv2/imgcodecs.hpp>
+#include <climits>
+
+namespace {
+
+int grayFlags(int reduce) {
+    switch (supportedReduction(reduce)) {
+    case 2: return cv::IMREAD_REDUCED_GRAYSCALE_2;
+    case 4: return cv::IMREAD_REDUCED_GRAYSCALE_4;
+    case 8: return cv::IMREAD_REDUCED_GRAYSCALE_8;
+    default: return cv::IMREAD_GRAYSCALE;
+    }
+}
+
+cv::Mat decode(const void* data, size_t size, int flags) {
+    if (!data || size == 0 || size > size_t(INT_MAX))
+        return cv::Mat();
+    try {
+        // imdecode only reads the buffer; the const_cast satisfies cv::Mat
+        cv::Mat buf(1, int(size), CV_8UC1, const_cast<void*>(data));
+        return cv::imdecode(buf, flags);
+    }
+    catch (const cv::Exception&) {
+        return cv::Mat();
+    }
+}
+
+cv::Mat readFile(const std::string& path, int flags) {
+    MappedFile file;
+    if (!file.open(path))
+        return cv::Mat();
+    return decode(file.data(), file.size(), flags);
+}
+
+} // namespace
+
+int supportedReduction(int factor) {
+    if (factor >= 8)
+        return 8;
+    if (factor >= 4)
+        return 4;
+    if (factor >= 2)
+        return 2;
+    return 1;
+}
+
+cv::Mat readGray(const std::string& path, int reduce) {
+    return readFile(path, grayFlags(reduce));
+}
+
+cv::Mat decodeGray(const void* data, size_t size, int reduce) {
+    return decode(data, size, grayFlags(reduce));
+}
+
+cv::Mat decodeGray(const std::vector<uchar>& bytes, int reduce) {
+    return decode(bytes.data(), bytes.size(), grayFlags(reduce));
+}
+
+cv::Mat readColor(const std::string& path) {
+    return readFile(path, cv::IMREAD_COLOR);
+}
+
+void toFullResolution(std::vector<DetectedCircle>& circles, int factor) {
+    if (factor <= 1)
+        return;
+    const float s = float(factor);
+    const float shift = 0.5f * (s - 1.0f);
+    for (auto& c : circles) {
+        c.center.x = c.center.x * s + shift;
+        c.center.y = c.center.y * s + shift;
+        c.radius *= s;
+    }
+}
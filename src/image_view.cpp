@@ -0,0 +1,49 @@
+#include "image_view.hpp"
+#include <opencv2/imgproc.hpp>
+
+ImageView ImageView::fromMat(const cv::Mat& m) {
+    CV_Assert(m.depth() == CV_8U);
+    ImageView v;
+    v.data = m.data;
+    v.width = m.cols;
+    v.height = m.rows;
+    v.stride = m.step;
+    switch (m.channels()) {
+    case 1: v.format = Format::Gray; break;
+    case 3: v.format = Format::BGR; break;
+    case 4: v.format = Format::BGRA; break;
+    default: CV_Error(cv::Error::StsBadArg, "unsupported channel count");
+    }
+    return v;
+}
+
+int ImageView::channels() const {
+    switch (format) {
+    case Format::Gray: return 1;
+    case Format::BGR:
+    case Format::RGB: return 3;
+    default: return 4;
+    }
+}
+
+cv::Mat ImageView::mat() const {
+    // cv::Mat has no const-data constructor; the header is only read
+    return cv::Mat(height, width, CV_8UC(channels()),
+        const_cast<unsigned char*>(data),
+        stride ? stride : size_t(width) * size_t(channels()));
+}
+
+void toGray(const ImageView& src, cv::Mat& dst) {
+    if (src.empty()) {
+        dst.release();
+        return;
+    }
+
+    switch (src.format) {
+    case ImageView::Format::Gray: dst = src.mat(); break;
+    case ImageView::Format::BGR: cv::cvtColor(src.mat(), dst, cv::COLOR_BGR2GRAY); break;
+    case ImageView::Format::RGB: cv::cvtColor(src.mat(), dst, cv::COLOR_RGB2GRAY); break;
+    case ImageView::Format::BGRA: cv::cvtColor(src.mat(), dst, cv::COLOR_BGRA2GRAY); break;
+    case ImageView::Format::RGBA: cv::cvtColor(src.mat(), dst, cv::COLOR_RGBA2GRAY); break;
+    }
+}
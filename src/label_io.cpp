@@ -0,0 +1,580 @@
+#include "label_io.hpp"
+#include "mapped_file.hpp"
+#include <algorithm>
+#include <charconv>
+#include <cstdio>
+#include <filesystem>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+bool isSpace(char c) { return c == ' ' || c == '\t' || c == '\r' || c == '\n'; }
+bool isSeparator(char c) { return c == ' ' || c == '\t' || c == '\r' || c == ',' || c == ';'; }
+
+char lower(char c) { return (c >= 'A' && c <= 'Z') ? char(c - 'A' + 'a') : c; }
+
+bool equalsNoCase(std::string_view a, std::string_view b) {
+    if (a.size() != b.size())
+        return false;
+    for (size_t i = 0; i < a.size(); ++i) {
+        if (lower(a[i]) != lower(b[i]))
+            return false;
+    }
+    return true;
+}
+
+// Whole token as a number; from_chars rejects a leading '+', skip it.
+bool toFloat(std::string_view s, float& v) {
+    if (!s.empty() && s.front() == '+')
+        s.remove_prefix(1);
+    if (s.empty())
+        return false;
+    auto [end, ec] = std::from_chars(s.data(), s.data() + s.size(), v);
+    return ec == std::errc() && end == s.data() + s.size();
+}
+
+// Which LabelCircle field a column or key names; -1 if none.
+enum Field { FieldNone = -1, FieldX, FieldY, FieldR, FieldScore };
+
+Field fieldFor(std::string_view key) {
+    for (const char* k : { "cx", "x" })
+        if (equalsNoCase(key, k)) return FieldX;
+    for (const char* k : { "cy", "y" })
+        if (equalsNoCase(key, k)) return FieldY;
+    for (const char* k : { "r", "radius" })
+        if (equalsNoCase(key, k)) return FieldR;
+    for (const char* k : { "score", "confidence" })
+        if (equalsNoCase(key, k)) return FieldScore;
+    return FieldNone;
+}
+
+void setField(LabelCircle& c, Field f, float v) {
+    switch (f) {
+    case FieldX: c.cx = v; break;
+    case FieldY: c.cy = v; break;
+    case FieldR: c.r = v; break;
+    case FieldScore: c.score = v; break;
+    default: break;
+    }
+}
+
+// ------------------------------------------------------------
+// Txt / Csv: line by line, tokens split on blanks, ',' and ';'
+// ------------------------------------------------------------
+struct LineParser {
+    bool csv = false;               // a header must name the cx, cy, r columns
+    std::vector<Field> columns;     // from a header row, if any
+    bool sawData = false;
+    bool failed = false;            // Csv header that doesn't name them
+    std::vector<std::string_view> tokens;   // reused between lines
+
+    void parse(std::string_view line, std::vector<LabelCircle>& out) {
+        if (size_t hash = line.find('#'); hash != std::string_view::npos)
+            line = line.substr(0, hash);
+
+        tokens.clear();
+        size_t i = 0;
+        while (i < line.size()) {
+            while (i < line.size() && isSeparator(line[i]))
+                ++i;
+            size_t start = i;
+            while (i < line.size() && !isSeparator(line[i]))
+                ++i;
+            if (start == i)
+                break;
+            tokens.push_back(line.substr(start, i - start));
+        }
+        if (tokens.empty())
+            return;
+        if (!columns.empty()) {
+            parseColumns(out);
+            return;
+        }
+
+        float nums[4];
+        int numCount = 0;
+        bool keyed = false, words = false;
+        LabelCircle kv;
+        int kvFields = 0;
+        std::vector<Field> header;
+
+        for (std::string_view tok : tokens) {
+            if (size_t eq = tok.find('='); eq != std::string_view::npos) {
+                // key=value, e.g. "cx=12.5"; unknown keys (TP=3) are ignored
+                keyed = true;
+                Field f = fieldFor(tok.substr(0, eq));
+                float v;
+                if (f != FieldNone && toFloat(tok.substr(eq + 1), v)) {
+                    setField(kv, f, v);
+                    if (f != FieldScore)
+                        ++kvFields;
+                }
+                continue;
+            }
+
+            float v;
+            if (toFloat(tok, v)) {
+                if (numCount < 4)
+                    nums[numCount] = v;
+                ++numCount;
+            }
+            else {
+                words = true;
+                header.push_back(fieldFor(tok));
+            }
+        }
+
+        if (keyed) {
+            if (kvFields == 3)
+                out.push_back(kv);
+            return;
+        }
+        if (words) {
+            // A header row before the first data row names the columns;
+            // columns it doesn't know (e.g. an image name) are skipped.
+            // In a Txt file other text lines are just ignored.
+            if (!sawData && numCount == 0) {
+                if (namesCircle(header))
+                    columns = std::move(header);
+                else if (csv)
+                    failed = true;
+            }
+            return;
+        }
+        if (numCount < 3)
+            return;
+
+        sawData = true;
+        LabelCircle c;
+        c.cx = nums[0];
+        c.cy = nums[1];
+        c.r = nums[2];
+        if (numCount >= 4)
+            c.score = nums[3];
+        out.push_back(c);
+    }
+
+    static bool namesCircle(const std::vector<Field>& header) {
+        for (Field f : { FieldX, FieldY, FieldR })
+            if (std::find(header.begin(), header.end(), f) == header.end())
+                return false;
+        return true;
+    }
+
+    // A row under a header: each named column must hold a number; rows
+    // where one doesn't are skipped.
+    void parseColumns(std::vector<LabelCircle>& out) {
+        LabelCircle c;
+        unsigned found = 0;
+        for (size_t k = 0; k < tokens.size() && k < columns.size(); ++k) {
+            if (columns[k] == FieldNone)
+                continue;
+            float v;
+            if (!toFloat(tokens[k], v))
+                return;
+            setField(c, columns[k], v);
+            found |= 1u << columns[k];
+        }
+        const unsigned circle = (1u << FieldX) | (1u << FieldY) | (1u << FieldR);
+        if ((found & circle) != circle)
+            return;
+        sawData = true;
+        out.push_back(c);
+    }
+};
+
+// False only for a Csv file whose header doesn't name the circle columns.
+bool parseLines(std::string_view text, std::vector<LabelCircle>& out, bool csv) {
+    LineParser lp;
+    lp.csv = csv;
+    while (!text.empty() && !lp.failed) {
+        size_t nl = text.find('\n');
+        std::string_view line = text.substr(0, nl);
+        lp.parse(line, out);
+        if (nl == std::string_view::npos)
+            break;
+        text.remove_prefix(nl + 1);
+    }
+    return !lp.failed;
+}
+
+// ------------------------------------------------------------
+// Json: a small tolerant recursive parser. Objects with x/y/r keys and
+// arrays of 3 or 4 numbers become circles, wherever they are nested.
+// ------------------------------------------------------------
+class JsonParser {
+public:
+    JsonParser(std::string_view text, std::vector<LabelCircle>& out)
+        : p_(text.data()), end_(text.data() + text.size()), out_(out) {}
+
+    bool run() {
+        if (!value(nullptr))
+            return false;
+        skipSpace();
+        return p_ == end_;
+    }
+
+private:
+    static constexpr int kMaxDepth = 64;
+
+    void skipSpace() {
+        while (p_ < end_ && isSpace(*p_))
+            ++p_;
+    }
+
+    bool string(std::string_view* s) {
+        if (p_ >= end_ || *p_ != '"')
+            return false;
+        const char* start = ++p_;
+        while (p_ < end_ && *p_ != '"') {
+            if (*p_ == '\\')
+                ++p_;
+            ++p_;
+        }
+        if (p_ >= end_)
+            return false;
+        if (s)
+            *s = std::string_view(start, size_t(p_ - start));
+        ++p_;
+        return true;
+    }
+
+    // Parses one value; if it is a number and `num` is set, stores it.
+    bool value(float* num, int depth = 0) {
+        if (depth > kMaxDepth)
+            return false;
+        skipSpace();
+        if (p_ >= end_)
+            return false;
+
+        switch (*p_) {
+        case '{': return object(depth);
+        case '[': return array(depth);
+        case '"': return string(nullptr);
+        case 't': case 'f': case 'n':
+            while (p_ < end_ && *p_ >= 'a' && *p_ <= 'z')
+                ++p_;
+            return true;
+        default: {
+            float v = 0.0f;
+            auto [next, ec] = std::from_chars(p_, end_, v);
+            if (ec != std::errc() || next == p_)
+                return false;
+            p_ = next;
+            if (num)
+                *num = v;
+            return true;
+        }
+        }
+    }
+
+    bool object(int depth) {
+        ++p_;   // '{'
+        LabelCircle c;
+        int fields = 0;
+        for (bool first = true;; first = false) {
+            skipSpace();
+            if (p_ < end_ && *p_ == '}') {
+                ++p_;
+                break;
+            }
+            if (!first) {
+                if (p_ >= end_ || *p_ != ',')
+                    return false;
+                ++p_;
+                skipSpace();
+            }
+            std::string_view key;
+            if (!string(&key))
+                return false;
+            skipSpace();
+            if (p_ >= end_ || *p_ != ':')
+                return false;
+            ++p_;
+
+            float v = 0.0f;
+            bool isNumber = false;
+            skipSpace();
+            if (p_ < end_ && (*p_ == '-' || (*p_ >= '0' && *p_ <= '9')))
+                isNumber = true;
+            if (!value(&v, depth + 1))
+                return false;
+
+            Field f = fieldFor(key);
+            if (isNumber && f != FieldNone) {
+                setField(c, f, v);
+                if (f != FieldScore)
+                    ++fields;
+            }
+        }
+        if (fields == 3)
+            out_.push_back(c);
+        return true;
+    }
+
+    bool array(int depth) {
+        ++p_;   // '['
+        float nums[4];
+        int count = 0;
+        bool allNumbers = true;
+        for (bool first = true;; first = false) {
+            skipSpace();
+            if (p_ < end_ && *p_ == ']') {
+                ++p_;
+                break;
+            }
+            if (!first) {
+                if (p_ >= end_ || *p_ != ',')
+                    return false;
+                ++p_;
+                skipSpace();
+            }
+            if (p_ < end_ && !(*p_ == '-' || (*p_ >= '0' && *p_ <= '9')))
+                allNumbers = false;
+            float v = 0.0f;
+            if (!value(&v, depth + 1))
+                return false;
+            if (count < 4)
+                nums[count] = v;
+            ++count;
+        }
+        if (allNumbers && (count == 3 || count == 4)) {
+            LabelCircle c;
+            c.cx = nums[0];
+            c.cy = nums[1];
+            c.r = nums[2];
+            if (count == 4)
+                c.score = nums[3];
+            out_.push_back(c);
+        }
+        return true;
+    }
+
+    const char* p_;
+    const char* end_;
+    std::vector<LabelCircle>& out_;
+};
+
+} // namespace
+
+LabelFormat detectLabelFormat(std::string_view text) {
+    size_t i = 0;
+    while (i < text.size() && isSpace(text[i]))
+        ++i;
+    if (i < text.size() && (text[i] == '[' || text[i] == '{'))
+        return LabelFormat::Json;
+
+    // first line that is not a comment
+    while (i < text.size()) {
+        size_t nl = text.find('\n', i);
+        std::string_view line = text.substr(i, nl == std::string_view::npos ? nl : nl - i);
+        if (size_t hash = line.find('#'); hash != std::string_view::npos)
+            line = line.substr(0, hash);
+        if (line.find_first_not_of(" \t\r") != std::string_view::npos)
+            return line.find_first_of(",;") != std::string_view::npos
+                ? LabelFormat::Csv : LabelFormat::Txt;
+        if (nl == std::string_view::npos)
+            break;
+        i = nl + 1;
+    }
+    return LabelFormat::Txt;
+}
+
+LabelFormat labelFormatFor(const std::string& path) {
+    std::string ext = fs::path(path).extension().string();
+    if (equalsNoCase(ext, ".txt")) return LabelFormat::Txt;
+    if (equalsNoCase(ext, ".csv")) return LabelFormat::Csv;
+    if (equalsNoCase(ext, ".json")) return LabelFormat::Json;
+    return LabelFormat::Auto;
+}
+
+bool parseLabels(std::string_view text, std::vector<LabelCircle>& out,
+    LabelFormat format) {
+    // a UTF-8 BOM from Windows editors
+    if (text.size() >= 3 && text.substr(0, 3) == "\xEF\xBB\xBF")
+        text.remove_prefix(3);
+    if (format == LabelFormat::Auto)
+        format = detectLabelFormat(text);
+
+    if (format == LabelFormat::Json) {
+        // a bad file adds nothing rather than half of its circles
+        size_t before = out.size();
+        if (!JsonParser(text, out).run()) {
+            out.resize(before);
+            return false;
+        }
+        return true;
+    }
+    // Txt and Csv only differ in separators, which the line parser
+    // accepts either way, and in how strictly a header is read
+    size_t before = out.size();
+    if (!parseLines(text, out, format == LabelFormat::Csv)) {
+        out.resize(before);
+        return false;
+    }
+    return true;
+}
+
+bool readLabels(const std::string& path, std::vector<LabelCircle>& out,
+    LabelFormat format) {
+    out.clear();
+    MappedFile file;
+    if (!file.open(path))
+        return false;
+    return parseLabels(file.view(), out, format);
+}
+
+std::string findLabelsFor(const std::string& imagePath) {
+    fs::path img(imagePath);
+    const std::string stem = img.stem().string();
+    std::error_code ec;
+    for (const char* suffix : { "_labels.txt", ".txt", ".csv", ".json" }) {
+        fs::path p = img.parent_path() / (stem + suffix);
+        if (fs::is_regular_file(p, ec))
+            return p.string();
+    }
+    return {};
+}
+
+std::vector<GTCircle> readGroundTruth(const std::string& path) {
+    std::vector<LabelCircle> labels;
+    if (path.empty() || !readLabels(path, labels))
+        return {};
+    return toGroundTruth(labels);
+}
+
+std::vector<GTCircle> toGroundTruth(const std::vector<LabelCircle>& labels) {
+    std::vector<GTCircle> out;
+    out.reserve(labels.size());
+    for (const auto& l : labels)
+        out.push_back({ cv::Point2f(l.cx, l.cy), l.r });
+    return out;
+}
+
+std::vector<LabelCircle> toLabels(const std::vector<DetectedCircle>& dets) {
+    std::vector<LabelCircle> out;
+    out.reserve(dets.size());
+    for (const auto& d : dets)
+        out.push_back({ d.center.x, d.center.y, d.radius, std::max(0.0f, d.score) });
+    return out;
+}
+
+// ------------------------------------------------------------
+// LabelWriter
+// ------------------------------------------------------------
+
+LabelWriter::LabelWriter(LabelFormat format)
+    : format_(format == LabelFormat::Auto ? LabelFormat::Txt : format) {
+    clear();
+}
+
+void LabelWriter::clear(LabelFormat format) {
+    if (format != LabelFormat::Auto)
+        format_ = format;
+    buf_.clear();
+    count_ = 0;
+    finished_ = false;
+    if (format_ == LabelFormat::Json)
+        buf_ += '[';
+}
+
+void LabelWriter::number(float v) {
+    char tmp[32];
+    auto [end, ec] = std::to_chars(tmp, tmp + sizeof(tmp), v);
+    buf_.append(tmp, ec == std::errc() ? end : tmp);
+}
+
+void LabelWriter::add(const LabelCircle& c) {
+    const bool scored = c.score >= 0.0f;
+    switch (format_) {
+    case LabelFormat::Json:
+        buf_ += count_ ? ",\n  {\"cx\":" : "\n  {\"cx\":";
+        number(c.cx);
+        buf_ += ",\"cy\":";
+        number(c.cy);
+        buf_ += ",\"r\":";
+        number(c.r);
+        if (scored) {
+            buf_ += ",\"score\":";
+            number(c.score);
+        }
+        buf_ += '}';
+        break;
+    default: {
+        const char sep = format_ == LabelFormat::Csv ? ',' : ' ';
+        number(c.cx);
+        buf_ += sep;
+        number(c.cy);
+        buf_ += sep;
+        number(c.r);
+        if (scored) {
+            buf_ += sep;
+            number(c.score);
+        }
+        buf_ += '\n';
+        break;
+    }
+    }
+    ++count_;
+}
+
+void LabelWriter::add(const std::vector<LabelCircle>& circles) {
+    buf_.reserve(buf_.size() + circles.size() * 32);
+    for (const auto& c : circles)
+        add(c);
+}
+
+void LabelWriter::comment(std::string_view text) {
+    if (format_ != LabelFormat::Txt)
+        return;
+    buf_ += "# ";
+    buf_ += text;
+    buf_ += '\n';
+}
+
+void LabelWriter::finish() {
+    if (finished_)
+        return;
+    if (format_ == LabelFormat::Json)
+        buf_ += count_ ? "\n]\n" : "]\n";
+    finished_ = true;
+}
+
+std::string_view LabelWriter::str() {
+    finish();
+    return buf_;
+}
+
+bool LabelWriter::writeTo(const std::string& path) {
+    finish();
+    // One write of the whole buffer into a sibling file, then a rename
+    // over the target: readers that map label files (the editor's
+    // prefetch, MappedFile) see the old or the new file, never a
+    // truncated one.
+    const std::string tmp = path + ".tmp";
+    std::FILE* f = std::fopen(tmp.c_str(), "wb");
+    if (!f)
+        return false;
+    bool ok = std::fwrite(buf_.data(), 1, buf_.size(), f) == buf_.size();
+    ok = (std::fflush(f) == 0) && ok;
+    ok = (std::fclose(f) == 0) && ok;
+
+    std::error_code ec;
+    if (ok)
+        fs::rename(tmp, path, ec);
+    if (!ok || ec) {
+        fs::remove(tmp, ec);
+        return false;
+    }
+    return true;
+}
+
+bool writeLabels(const std::string& path, const std::vector<LabelCircle>& circles,
+    LabelFormat format) {
+    if (format == LabelFormat::Auto)
+        format = labelFormatFor(path);
+    LabelWriter w(format);
+    w.add(circles);
+    return w.writeTo(path);
+}
@@ -1,92 +1,700 @@
 #include <iostream>
-#include <fstream>
 #include <chrono>
 #include <string>
 #include <vector>
+#include <map>
+#include <cstdio>
+#include <cstdlib>
+#include <atomic>
+#include <thread>
+#include <memory>
+#include <optional>
+#include <algorithm>
+#include <charconv>
 #include <filesystem>
+#include <string_view>
 
 #include <opencv2/opencv.hpp>
 #include "coin_detector.hpp"
 #include "evaluator.hpp"
+#include "label_io.hpp"
+#include "dataset_pack.hpp"
+#include "image_io.hpp"
+#include "bounded_queue.hpp"
+#include "thread_pool.hpp"
 
 namespace fs = std::filesystem;
 
-// ============================================================
-// Ground truth reader
-// ============================================================
-std::vector<GTCircle> read_gt_file(const std::string& path) {
-    std::vector<GTCircle> out;
-    std::ifstream in(path);
-    if (!in.is_open()) return out;
-
-    float cx, cy, r;
-    while (in >> cx >> cy >> r) {
-        GTCircle g;
-        g.center = cv::Point2f(cx, cy);
-        g.radius = r;
-        out.push_back(g);
-    }
-    return out;
-}
-
 // ============================================================
 // Visualization
+// `img` may be a frame decoded at 1/scale resolution; `dets` are in
+// full-resolution coordinates and are drawn scaled down onto it. With
+// maxEdge > 0 the frame is first shrunk so its long edge is at most
+// maxEdge, and only that thumbnail is converted to color and drawn on.
 // ============================================================
-void draw_and_save(const cv::Mat& img,
+enum class VisFormat { Png, Jpeg, None };
+
+cv::Mat render_overlay(const cv::Mat& img,
     const std::vector<DetectedCircle>& dets,
-    const std::string& outpath) {
+    int scale = 1,
+    int maxEdge = 0) {
+    float s = float(std::max(1, scale));
+    cv::Mat small = img;
+    const int edge = std::max(img.cols, img.rows);
+    if (maxEdge > 0 && edge > maxEdge) {
+        const double f = double(maxEdge) / double(edge);
+        cv::Size size(std::max(1, cvRound(img.cols * f)),
+            std::max(1, cvRound(img.rows * f)));
+        cv::resize(img, small, size, 0, 0, cv::INTER_AREA);
+        s *= float(img.cols) / float(small.cols);
+    }
+
     cv::Mat vis;
-    if (img.channels() == 1)
-        cv::cvtColor(img, vis, cv::COLOR_GRAY2BGR);
-    else
+    if (small.channels() == 1)
+        cv::cvtColor(small, vis, cv::COLOR_GRAY2BGR);
+    else if (small.data == img.data)
         vis = img.clone();
+    else
+        vis = small;
 
     for (const auto& d : dets) {
-        cv::circle(vis, d.center,
-            static_cast<int>(std::round(d.radius)),
+        cv::Point2f c((d.center.x + 0.5f) / s - 0.5f,
+            (d.center.y + 0.5f) / s - 0.5f);
+        cv::circle(vis, c,
+            static_cast<int>(std::round(d.radius / s)),
             cv::Scalar(0, 0, 255), 2);
-        cv::circle(vis, d.center, 2,
+        cv::circle(vis, c, 2,
             cv::Scalar(0, 255, 0), -1);
     }
-    cv::imwrite(outpath, vis);
+    return vis;
+}
+
+bool write_image(const cv::Mat& vis, const std::string& outpath,
+    VisFormat format, int jpegQuality) {
+    std::vector<int> params;
+    if (format == VisFormat::Jpeg)
+        params = { cv::IMWRITE_JPEG_QUALITY, jpegQuality };
+    try {
+        if (cv::imwrite(outpath, vis, params))
+            return true;
+    }
+    catch (const cv::Exception&) {
+    }
+    std::cerr << "Cannot write image: " << outpath << "\n";
+    return false;
 }
 
 // ============================================================
 // Save detections + evaluation (if available)
+// Returns the written path, or an empty path on failure.
 // ============================================================
-void save_detections_txt(const std::vector<DetectedCircle>& dets,
+fs::path save_detections_txt(const std::vector<DetectedCircle>& dets,
     const std::string& imgpath,
     const EvalResult* res) {
     fs::path p(imgpath);
     fs::path txtPath =
         p.parent_path() / (p.stem().string() + "_detected.txt");
 
-    std::ofstream out(txtPath.string());
-    if (!out.is_open()) {
+    // one buffer per worker thread, reused for every image it writes;
+    // "cx cy r score" lines, so the file reads back as labels
+    thread_local LabelWriter out;
+    out.clear(LabelFormat::Txt);
+    out.comment("detected circles: " + std::to_string(dets.size()));
+    out.add(toLabels(dets));
+
+    if (res) {
+        char line[128];
+        std::snprintf(line, sizeof(line), "TP=%d FP=%d FN=%d", res->TP, res->FP, res->FN);
+        out.comment(line);
+        std::snprintf(line, sizeof(line), "Precision=%g Recall=%g F1=%g",
+            res->precision(), res->recall(), res->f1());
+        out.comment(line);
+    }
+
+    if (!out.writeTo(txtPath.string())) {
         std::cerr << "Cannot open file for writing: "
             << txtPath << "\n";
+        return {};
+    }
+    return txtPath;
+}
+
+// ============================================================
+// Per-image pipeline record
+// ============================================================
+using Clock = std::chrono::high_resolution_clock;
+
+static double ms_between(Clock::time_point a, Clock::time_point b) {
+    return std::chrono::duration<double, std::milli>(b - a).count();
+}
+
+struct StageTimes {
+    double decode = 0.0;
+    double gray = 0.0;
+    double detect = 0.0;
+    double evaluate = 0.0;
+    double write = 0.0;
+
+    StageTimes& operator+=(const StageTimes& o) {
+        decode += o.decode;
+        gray += o.gray;
+        detect += o.detect;
+        evaluate += o.evaluate;
+        write += o.write;
+        return *this;
+    }
+};
+
+// One record per image: filled once by decode/detect/evaluate and then
+// consumed by the console report, the file writers and the batch totals.
+struct ImageResult {
+    size_t index = 0;           // position in the batch, for ordered output
+    fs::path imgPath;
+    fs::path gtPath;            // empty if there is no ground truth
+    fs::path outImg;            // _detected.png/.jpg (empty with --vis none or on failure)
+    bool outImgQueued = false;  // outImg is still being written on the encoder
+    fs::path outTxt;            // written _detected.txt (empty on failure)
+    cv::Mat img;                // decoded gray frame, released after writing
+    int scale = 1;              // full-resolution pixels per pixel of img
+    const DatasetPack* pack = nullptr;  // set: gray plane and labels come from here
+    size_t packIndex = 0;
+    std::vector<DetectedCircle> dets;
+    std::vector<GTCircle> gts;  // kept for the batch AP
+    EvalResult evalRes;
+    bool hasEval = false;
+    bool ok = false;
+    StageTimes times;
+};
+
+// ============================================================
+// Consolidated results (--results)
+//
+// One file for the whole run instead of a _detected.txt per image:
+//   .csv    header "image,cx,cy,r,score,status", then one row per
+//           circle with status "ok"; an image without circles gets one
+//           row with empty cx..score and status "none", one that could
+//           not be read "error"
+//   .jsonl  one object per image: {"image":..,"circles":[[cx,cy,r,score],..]}
+//           plus "tp", "fp", "fn" if it was evaluated, or "error" if it
+//           could not be read
+// Records are added by the report step, so they follow filename order.
+// They are formatted into one buffer that is written in large blocks.
+// ============================================================
+class ResultsFile {
+public:
+    ResultsFile() = default;
+    ResultsFile(const ResultsFile&) = delete;
+    ResultsFile& operator=(const ResultsFile&) = delete;
+    ~ResultsFile() { close(); }
+
+    // False if the file can't be created or the extension is not
+    // .csv or .jsonl.
+    bool open(const std::string& path) {
+        const std::string ext = fs::path(path).extension().string();
+        if (ext != ".csv" && ext != ".jsonl")
+            return false;
+        jsonl_ = ext == ".jsonl";
+        f_ = std::fopen(path.c_str(), "wb");
+        if (!f_)
+            return false;
+        if (!jsonl_)
+            buf_ += "image,cx,cy,r,score,status\n";
+        return true;
+    }
+
+    void add(const ImageResult& r) {
+        if (!f_)
+            return;
+        const std::string name = r.imgPath.generic_string();
+        if (jsonl_) {
+            buf_ += "{\"image\":";
+            jsonString(name);
+            if (!r.ok) {
+                buf_ += ",\"error\":\"cannot open image\"}\n";
+            }
+            else {
+                buf_ += ",\"circles\":[";
+                for (size_t i = 0; i < r.dets.size(); ++i) {
+                    const auto& d = r.dets[i];
+                    buf_ += i ? ",[" : "[";
+                    number(d.center.x);
+                    buf_ += ',';
+                    number(d.center.y);
+                    buf_ += ',';
+                    number(d.radius);
+                    buf_ += ',';
+                    number(d.score);
+                    buf_ += ']';
+                }
+                buf_ += ']';
+                if (r.hasEval) {
+                    buf_ += ",\"tp\":" + std::to_string(r.evalRes.TP);
+                    buf_ += ",\"fp\":" + std::to_string(r.evalRes.FP);
+                    buf_ += ",\"fn\":" + std::to_string(r.evalRes.FN);
+                }
+                buf_ += "}\n";
+            }
+        }
+        else if (!r.ok || r.dets.empty()) {
+            csvString(name);
+            buf_ += r.ok ? ",,,,,none\n" : ",,,,,error\n";
+        }
+        else {
+            for (const auto& d : r.dets) {
+                csvString(name);
+                buf_ += ',';
+                number(d.center.x);
+                buf_ += ',';
+                number(d.center.y);
+                buf_ += ',';
+                number(d.radius);
+                buf_ += ',';
+                number(d.score);
+                buf_ += ",ok\n";
+            }
+        }
+        if (buf_.size() >= (1u << 20))
+            flush();
+    }
+
+    // False if any write failed.
+    bool close() {
+        if (!f_)
+            return ok_;
+        flush();
+        ok_ = (std::fclose(f_) == 0) && ok_;
+        f_ = nullptr;
+        return ok_;
+    }
+
+private:
+    void flush() {
+        if (!buf_.empty() && std::fwrite(buf_.data(), 1, buf_.size(), f_) != buf_.size())
+            ok_ = false;
+        buf_.clear();
+    }
+
+    void number(float v) {
+        char tmp[32];
+        auto [end, ec] = std::to_chars(tmp, tmp + sizeof(tmp), v);
+        buf_.append(tmp, ec == std::errc() ? end : tmp);
+    }
+
+    void jsonString(std::string_view s) {
+        buf_ += '"';
+        for (char c : s) {
+            if (c == '"' || c == '\\') {
+                buf_ += '\\';
+                buf_ += c;
+            }
+            else if (static_cast<unsigned char>(c) < 0x20) {
+                char esc[8];
+                std::snprintf(esc, sizeof(esc), "\\u%04x", unsigned(c));
+                buf_ += esc;
+            }
+            else {
+                buf_ += c;
+            }
+        }
+        buf_ += '"';
+    }
+
+    // quoted only if it has to be (RFC 4180)
+    void csvString(std::string_view s) {
+        if (s.find_first_of(",\"\r\n") == std::string_view::npos) {
+            buf_ += s;
+            return;
+        }
+        buf_ += '"';
+        for (char c : s) {
+            if (c == '"')
+                buf_ += '"';
+            buf_ += c;
+        }
+        buf_ += '"';
+    }
+
+    std::FILE* f_ = nullptr;
+    bool jsonl_ = false;
+    bool ok_ = true;
+    std::string buf_;
+};
+
+// How the outputs of each image are written, fixed for the whole run.
+struct OutputSetup {
+    VisFormat vis = VisFormat::Png;     // --vis
+    int jpegQuality = 90;               // --quality
+    int thumb = 0;                      // --thumb: long edge of the overlay, 0 = frame size
+    bool labelFiles = true;             // a _detected.txt per image; off with --results
+    ThreadPool* encoder = nullptr;      // set: overlays are encoded and written on it
+    ResultsFile* results = nullptr;     // --results
+    std::atomic<int>* failedWrites = nullptr;   // outputs that could not be written
+};
+
+// What the detect stage runs with, fixed for the whole run.
+struct DetectSetup {
+    const CoinDetector& detector;   // built with Params::scaledDown(reduce)
+    cv::Mat mask;               // --mask; empty = whole frame
+    ThreadPool* tiles = nullptr;    // tileSize > 0: tiled detection on this pool
+    int reduce = 1;             // --reduce: decode at 1/reduce resolution
+};
+
+// Decodes straight to gray (see image_io.hpp), at 1/reduce resolution
+// if requested.
+bool decode_image(ImageResult& r, int reduce) {
+    auto t0 = Clock::now();
+    r.scale = supportedReduction(reduce);
+    if (r.pack) {
+        r.img = r.pack->gray(r.packIndex);   // a view of the mapping, no decode
+        if (r.scale > 1 && !r.img.empty()) {
+            // same size as a reduced JPEG decode (rounded up)
+            cv::Size size((r.img.cols + r.scale - 1) / r.scale,
+                (r.img.rows + r.scale - 1) / r.scale);
+            cv::Mat reduced;
+            cv::resize(r.img, reduced, size, 0, 0, cv::INTER_AREA);
+            r.img = reduced;
+        }
+    }
+    else {
+        r.img = readGray(r.imgPath.string(), r.scale);
+    }
+    r.times.decode = ms_between(t0, Clock::now());
+    return !r.img.empty();
+}
+
+// The --mask image at `size` (a mask drawn at another resolution is
+// scaled, nearest neighbour); empty without --mask.
+const cv::Mat& mask_for(const cv::Mat& mask, cv::Size size) {
+    if (mask.empty() || mask.size() == size)
+        return mask;
+    thread_local cv::Mat scaled;
+    if (scaled.size() != size)
+        cv::resize(mask, scaled, size, 0, 0, cv::INTER_NEAREST);
+    return scaled;
+}
+
+void detect_image(ImageResult& r,
+    const DetectSetup& setup,
+    const Evaluator& eval) {
+    auto t0 = Clock::now();
+    cv::Mat gray;
+    if (r.img.channels() == 1)
+        gray = r.img;
+    else
+        cv::cvtColor(r.img, gray, cv::COLOR_BGR2GRAY);
+    auto t1 = Clock::now();
+    const cv::Mat& mask = mask_for(setup.mask, gray.size());
+    if (setup.tiles) {
+        thread_local DetectorWorkspace ws;
+        setup.detector.detectTiled(gray, mask, *setup.tiles, ws, r.dets);
+    }
+    else {
+        r.dets = setup.detector.detect(gray, mask);
+    }
+    toFullResolution(r.dets, r.scale);
+    auto t2 = Clock::now();
+
+    if (r.pack) {
+        if (r.pack->hasLabels(r.packIndex)) {
+            r.gts = r.pack->groundTruth(r.packIndex);
+            r.hasEval = true;
+        }
+    }
+    else if (!r.gtPath.empty()) {
+        r.gts = readGroundTruth(r.gtPath.string());
+        r.hasEval = true;
+    }
+    if (r.hasEval)
+        r.evalRes = eval.evaluate(r.dets, r.gts);
+    auto t3 = Clock::now();
+
+    r.times.gray = ms_between(t0, t1);
+    r.times.detect = ms_between(t1, t2);
+    r.times.evaluate = ms_between(t2, t3);
+    r.ok = true;
+}
+
+void print_result(const ImageResult& r) {
+    if (!r.ok) {
+        std::cerr << "Cannot open image: " << r.imgPath << "\n";
         return;
     }
 
-    out << "Detected circles: " << dets.size() << "\n";
-    for (size_t i = 0; i < dets.size(); ++i) {
-        out << i << ": cx=" << dets[i].center.x
-            << " cy=" << dets[i].center.y
-            << " r=" << dets[i].radius << "\n";
+    std::cout << "\nImage: " << r.imgPath << "\n";
+    std::cout << "Detected circles: " << r.dets.size() << "\n";
+    for (size_t i = 0; i < r.dets.size(); ++i) {
+        std::cout << i << ": cx=" << r.dets[i].center.x
+            << " cy=" << r.dets[i].center.y
+            << " r=" << r.dets[i].radius
+            << " score=" << r.dets[i].score << "\n";
+    }
+    std::cout << "Detection time (ms): " << r.times.detect << "\n";
+
+    if (r.hasEval) {
+        std::cout << "TP=" << r.evalRes.TP
+            << " FP=" << r.evalRes.FP
+            << " FN=" << r.evalRes.FN << "\n";
+        std::cout << "Precision=" << r.evalRes.precision()
+            << " Recall=" << r.evalRes.recall()
+            << " F1=" << r.evalRes.f1() << "\n";
     }
 
-    if (res) {
-        out << "\n=== Evaluation ===\n";
-        out << "TP=" << res->TP << "\n";
-        out << "FP=" << res->FP << "\n";
-        out << "FN=" << res->FN << "\n";
-        out << "Precision=" << res->precision() << "\n";
-        out << "Recall=" << res->recall() << "\n";
-        out << "F1=" << res->f1() << "\n";
+    if (!r.outTxt.empty())
+        std::cout << "Saved detections to " << r.outTxt << "\n";
+    if (!r.outImg.empty())
+        std::cout << (r.outImgQueued ? "Writing visualization to " : "Saved visualization to ")
+            << r.outImg << "\n";
+}
+
+void write_outputs(ImageResult& r, const OutputSetup& out) {
+    // a pack run only evaluates: there is no folder to write next to
+    if (r.pack) {
+        r.img.release();
+        return;
+    }
+
+    auto t0 = Clock::now();
+    std::atomic<int>* failed = out.failedWrites;
+    if (out.vis != VisFormat::None) {
+        r.outImg =
+            r.imgPath.parent_path() /
+            (r.imgPath.stem().string() +
+                (out.vis == VisFormat::Jpeg ? "_detected.jpg" : "_detected.png"));
+
+        // only the overlay (thumbnail-sized with --thumb) is kept for
+        // the encoder; the frame is released below
+        cv::Mat vis = render_overlay(r.img, r.dets, r.scale, out.thumb);
+        if (out.encoder) {
+            // the future is dropped: write_image prints its own error and
+            // the failure is counted for the exit code
+            out.encoder->submit([vis, path = r.outImg.string(),
+                format = out.vis, quality = out.jpegQuality, failed] {
+                if (!write_image(vis, path, format, quality) && failed)
+                    failed->fetch_add(1);
+            });
+            r.outImgQueued = true;
+        }
+        else if (!write_image(vis, r.outImg.string(), out.vis, out.jpegQuality)) {
+            r.outImg.clear();
+            if (failed)
+                failed->fetch_add(1);
+        }
+    }
+    if (out.labelFiles) {
+        r.outTxt = save_detections_txt(
+            r.dets,
+            r.imgPath.string(),
+            r.hasEval ? &r.evalRes : nullptr
+        );
+        if (r.outTxt.empty() && failed)
+            failed->fetch_add(1);
+    }
+    r.img.release();
+    r.times.write = ms_between(t0, Clock::now());
+}
+
+// Console report, then the consolidated results file; called in
+// filename order.
+void report_result(const ImageResult& r, const OutputSetup& out) {
+    print_result(r);
+    if (out.results)
+        out.results->add(r);
+}
+
+// Runs every stage for one image, in order.
+void process_image(ImageResult& r,
+    const DetectSetup& setup,
+    const OutputSetup& out,
+    const Evaluator& eval) {
+    if (decode_image(r, setup.reduce)) {
+        detect_image(r, setup, eval);
+        write_outputs(r, out);
     }
+    report_result(r, out);
+}
+
+// ============================================================
+// Batch aggregate
+// ============================================================
+struct BatchTotals {
+    int TP = 0, FP = 0, FN = 0;
+    int evaluated = 0;
+    int processed = 0;
+    int failed = 0;
+    StageTimes times;
+    APAccumulator ap;           // IoU 0.50:0.05:0.95 over all detections
+
+    explicit BatchTotals(Evaluator::Matching matching)
+        : ap({}, matching) {}
+
+    void add(const ImageResult& r) {
+        if (!r.ok) {
+            failed++;
+            return;
+        }
+        processed++;
+        times += r.times;
+        if (r.hasEval) {
+            TP += r.evalRes.TP;
+            FP += r.evalRes.FP;
+            FN += r.evalRes.FN;
+            ap.add(r.dets, r.gts);
+            evaluated++;
+        }
+    }
+
+    void print(double wallMs) const {
+        if (evaluated > 0) {
+            EvalResult total;
+            total.TP = TP;
+            total.FP = FP;
+            total.FN = FN;
+
+            std::cout << "\nBatch evaluation ("
+                << evaluated << " images):\n";
+            std::cout << "Precision=" << total.precision()
+                << " Recall=" << total.recall()
+                << " F1=" << total.f1() << "\n";
+
+            // thresholds are 0.50, 0.55, ..: index 0 is AP50, 5 is AP75
+            auto curves = ap.curves();
+            double mAP = 0.0;
+            for (const auto& c : curves)
+                mAP += c.ap;
+            mAP /= double(curves.size());
+            std::cout << "mAP@[.50:.95]=" << mAP
+                << " AP50=" << curves[0].ap
+                << " AP75=" << curves[5].ap << "\n";
+        }
+
+        std::cout << "\nBatch timing (" << processed << " images";
+        if (failed > 0)
+            std::cout << ", " << failed << " failed";
+        std::cout << "):\n";
+        std::cout << "Total wall time (ms): " << wallMs << "\n";
+        std::cout << "Stage time (ms): decode=" << times.decode
+            << " gray=" << times.gray
+            << " detect=" << times.detect
+            << " evaluate=" << times.evaluate
+            << " write=" << times.write << "\n";
+    }
+};
+
+// ============================================================
+// Multi-threaded batch engine
+//
+// decode (D threads) -> detect (N threads) -> write (W threads)
+//   -> report (calling thread)
+//
+// Stages are connected by bounded queues, so at most a few frames per
+// stage are alive at once. Workers finish out of order; the report stage
+// holds finished records (without pixels) until every earlier index has
+// been printed, so console output and totals follow filename order.
+// ============================================================
+using ResultPtr = std::unique_ptr<ImageResult>;
+using ResultQueue = BoundedQueue<ResultPtr>;
+
+// Starts n workers running fn(); the last one to return closes `next`.
+template <typename Fn>
+void start_stage(std::vector<std::thread>& threads, int n,
+    ResultQueue& next, Fn fn) {
+    auto remaining = std::make_shared<std::atomic<int>>(n);
+    for (int i = 0; i < n; ++i) {
+        threads.emplace_back([remaining, &next, fn] {
+            fn();
+            if (remaining->fetch_sub(1) == 1)
+                next.close();
+        });
+    }
+}
+
+void run_batch_parallel(std::vector<ImageResult>& jobs,
+    const DetectSetup& setup,
+    const OutputSetup& out,
+    const Evaluator& eval,
+    int numJobs,
+    BatchTotals& totals) {
+    const int decoders = std::max(1, numJobs / 2);
+    const int detectors = numJobs;
+    const int writers = std::max(1, numJobs / 2);
+    const size_t cap = size_t(numJobs) * 2;
+
+    ResultQueue toDetect(cap);
+    ResultQueue toWrite(cap);
+    ResultQueue toReport(cap);
+
+    std::vector<std::thread> threads;
+    std::atomic<size_t> nextJob{ 0 };
+
+    start_stage(threads, decoders, toDetect, [&] {
+        for (;;) {
+            size_t i = nextJob.fetch_add(1);
+            if (i >= jobs.size())
+                break;
+            auto r = std::make_unique<ImageResult>(std::move(jobs[i]));
+            decode_image(*r, setup.reduce);
+            toDetect.push(std::move(r));
+        }
+    });
+
+    start_stage(threads, detectors, toWrite, [&] {
+        while (auto r = toDetect.pop()) {
+            if (!(*r)->img.empty())
+                detect_image(**r, setup, eval);
+            toWrite.push(std::move(*r));
+        }
+    });
 
-    out.close();
-    std::cout << "Saved detections to " << txtPath << "\n";
+    start_stage(threads, writers, toReport, [&] {
+        while (auto r = toWrite.pop()) {
+            if ((*r)->ok)
+                write_outputs(**r, out);
+            toReport.push(std::move(*r));
+        }
+    });
+
+    std::map<size_t, ResultPtr> pending;
+    size_t nextReport = 0;
+    while (auto r = toReport.pop()) {
+        pending.emplace((*r)->index, std::move(*r));
+        for (auto it = pending.find(nextReport); it != pending.end();
+            it = pending.find(++nextReport)) {
+            report_result(*it->second, out);
+            totals.add(*it->second);
+            pending.erase(it);
+        }
+    }
+
+    for (auto& t : threads)
+        t.join();
+}
+
+// ============================================================
+// Numeric options: the whole argument must parse and be in [lo, hi],
+// otherwise an error is printed and the value is left unchanged
+// ============================================================
+bool parse_option(const std::string& flag, std::string_view s, int lo, int hi, int& v) {
+    int x = 0;
+    auto [end, ec] = std::from_chars(s.data(), s.data() + s.size(), x);
+    if (ec != std::errc() || end != s.data() + s.size() || x < lo || x > hi) {
+        std::cerr << "Invalid " << flag << ": " << s
+            << " (expected an integer in " << lo << ".." << hi << ")\n";
+        return false;
+    }
+    v = x;
+    return true;
+}
+
+bool parse_option(const std::string& flag, std::string_view s, float lo, float hi, float& v) {
+    float x = 0.0f;
+    auto [end, ec] = std::from_chars(s.data(), s.data() + s.size(), x);
+    if (ec != std::errc() || end != s.data() + s.size() || !(x >= lo && x <= hi)) {
+        std::cerr << "Invalid " << flag << ": " << s
+            << " (expected a number in " << lo << ".." << hi << ")\n";
+        return false;
+    }
+    v = x;
+    return true;
 }
 
 // ============================================================
@@ -95,163 +703,318 @@ void save_detections_txt(const std::vector<DetectedCircle>& dets,
 int main(int argc, char** argv) {
     if (argc < 2) {
         std::cout << "Usage:\n"
-            << "  coin_detector <image> [gt_file]\n"
-            << "  coin_detector <folder> --batch\n";
+            << "  coin_detector <image> [gt_file] [options]\n"
+            << "  coin_detector <folder> --batch [--jobs N] [--recursive] [options]\n"
+            << "  coin_detector <file.pack> --batch [--jobs N] [options]\n"
+            << "    (a folder packed by coins_pack: no decoding; only --results\n"
+            << "    is written)\n"
+            << "  --recursive also reads images in subfolders (as coins_pack\n"
+            << "    --recursive packs them)\n"
+            << "Ground truth (gt_file, or found next to each image as\n"
+            << "<stem>_labels.txt, .txt, .csv or .json) may be txt, csv or json.\n"
+            << "Options:\n"
+            << "  --config F    detector params file (.yml/.json/.xml); --tile\n"
+            << "                and --pyramid override its values\n"
+            << "  --pyramid L   coarse-to-fine detection at 1/2^L scale\n"
+            << "  --reduce N    decode and detect at 1/N resolution (2, 4 or 8;\n"
+            << "                JPEGs are scaled while decoding); results are\n"
+            << "                in full-resolution coordinates\n"
+            << "  --tile N      split large images into NxN tiles detected in\n"
+            << "                parallel (--jobs threads, default all cores;\n"
+            << "                also in single image mode)\n"
+            << "  --mask F      only detect where this image is nonzero (e.g. the\n"
+            << "                tray); a fixed region can also be set in the\n"
+            << "                config (roi, roiPolygon)\n"
+            << "  --iou T       match on circle IoU >= T instead of the\n"
+            << "                center/radius tolerances\n"
+            << "  --match M     greedy (default: by score) or optimal\n"
+            << "                (most matches; Hungarian per overlap group)\n"
+            << "Output options:\n"
+            << "  --vis V       overlay image per input: png (default, lossless),\n"
+            << "                jpg or none\n"
+            << "  --quality Q   JPEG quality for --vis jpg (default 90)\n"
+            << "  --thumb N     draw the overlay on a thumbnail whose long edge\n"
+            << "                is at most N pixels\n"
+            << "  --results F   write all detections to one .csv (a row per\n"
+            << "                circle; images without any get one row with a\n"
+            << "                status) or .jsonl (a line per image) instead of\n"
+            << "                a _detected.txt per image\n";
         return 0;
     }
 
     CoinDetector::Params params;
-    CoinDetector detector(params);
     Evaluator eval(25.0f, 0.5f);
+    Evaluator::Matching matching = Evaluator::Matching::Greedy;
 
     std::string input = argv[1];
     bool batch = (argc >= 3 && std::string(argv[2]) == "--batch");
 
-    // --------------------------------------------------------
-    // Image processing function
-    // --------------------------------------------------------
-    auto process_image =
-        [&](const fs::path& imgPath, const fs::path* gtPath) {
-
-        cv::Mat img = cv::imread(imgPath.string(), cv::IMREAD_COLOR);
-        if (img.empty()) {
-            std::cerr << "Cannot open image: " << imgPath << "\n";
-            return;
+    fs::path gtArg;
+    int numJobs = 1;
+    bool jobsSet = false;
+    bool recursive = false;
+    int reduce = 1;
+    // Detector flags override --config wherever they appear, so they are
+    // kept aside and applied once the config is loaded.
+    std::string configPath;
+    std::optional<int> tileSize, pyramidLevels;
+    cv::Mat mask;
+    OutputSetup out;
+    std::atomic<int> failedWrites{ 0 };
+    out.failedWrites = &failedWrites;
+    std::string resultsPath;
+    for (int i = 2; i < argc; ++i) {
+        std::string a = argv[i];
+        if (a == "--batch" && i == 2) {
+            continue;
         }
-
-        cv::Mat gray;
-        cv::cvtColor(img, gray, cv::COLOR_BGR2GRAY);
-
-        auto t0 = std::chrono::high_resolution_clock::now();
-        auto dets = detector.detect(gray);
-        auto t1 = std::chrono::high_resolution_clock::now();
-
-        double elapsed =
-            std::chrono::duration<double, std::milli>(t1 - t0).count();
-
-        std::cout << "\nImage: " << imgPath << "\n";
-        std::cout << "Detected circles: " << dets.size() << "\n";
-        for (size_t i = 0; i < dets.size(); ++i) {
-            std::cout << i << ": cx=" << dets[i].center.x
-                << " cy=" << dets[i].center.y
-                << " r=" << dets[i].radius << "\n";
+        else if (a == "--jobs" && i + 1 < argc) {
+            if (!parse_option(a, argv[++i], 0, 1024, numJobs))
+                return -1;
+            if (numJobs == 0)
+                numJobs = int(std::max(1u, std::thread::hardware_concurrency()));
+            jobsSet = true;
         }
-        std::cout << "Detection time (ms): " << elapsed << "\n";
-
-        EvalResult evalRes;
-        bool hasEval = false;
-
-        if (gtPath && fs::exists(*gtPath)) {
-            auto gts = read_gt_file(gtPath->string());
-            evalRes = eval.evaluate(dets, gts);
-            hasEval = true;
-
-            std::cout << "TP=" << evalRes.TP
-                << " FP=" << evalRes.FP
-                << " FN=" << evalRes.FN << "\n";
-            std::cout << "Precision=" << evalRes.precision()
-                << " Recall=" << evalRes.recall()
-                << " F1=" << evalRes.f1() << "\n";
+        else if (a == "--recursive" && batch) {
+            recursive = true;
         }
+        else if (a == "--tile" && i + 1 < argc) {
+            int n = 0;
+            if (!parse_option(a, argv[++i], 64, 1 << 16, n))
+                return -1;
+            tileSize = n;
+        }
+        else if (a == "--config" && i + 1 < argc) {
+            configPath = argv[++i];
+        }
+        else if (a == "--pyramid" && i + 1 < argc) {
+            int levels = 0;
+            if (!parse_option(a, argv[++i], 0, 8, levels))
+                return -1;
+            pyramidLevels = levels;
+        }
+        else if (a == "--reduce" && i + 1 < argc) {
+            if (!parse_option(a, argv[++i], 1, 8, reduce))
+                return -1;
+            if (supportedReduction(reduce) != reduce) {
+                std::cerr << "Invalid --reduce: " << reduce << " (expected 1, 2, 4 or 8)\n";
+                return -1;
+            }
+        }
+        else if (a == "--mask" && i + 1 < argc) {
+            std::string path = argv[++i];
+            mask = readGray(path);
+            if (mask.empty()) {
+                std::cerr << "Cannot read mask: " << path << "\n";
+                return -1;
+            }
+        }
+        else if (a == "--vis" && i + 1 < argc) {
+            std::string v = argv[++i];
+            if (v == "png")
+                out.vis = VisFormat::Png;
+            else if (v == "jpg" || v == "jpeg")
+                out.vis = VisFormat::Jpeg;
+            else if (v == "none")
+                out.vis = VisFormat::None;
+            else {
+                std::cerr << "Unknown --vis: " << v << "\n";
+                return -1;
+            }
+        }
+        else if (a == "--quality" && i + 1 < argc) {
+            if (!parse_option(a, argv[++i], 1, 100, out.jpegQuality))
+                return -1;
+        }
+        else if (a == "--thumb" && i + 1 < argc) {
+            if (!parse_option(a, argv[++i], 0, 1 << 16, out.thumb))
+                return -1;
+        }
+        else if (a == "--results" && i + 1 < argc) {
+            resultsPath = argv[++i];
+        }
+        else if (a == "--iou" && i + 1 < argc) {
+            float iou = 0.0f;
+            if (!parse_option(a, argv[++i], 0.0f, 1.0f, iou))
+                return -1;
+            eval.setIoU(iou);
+        }
+        else if (a == "--match" && i + 1 < argc) {
+            std::string m = argv[++i];
+            if (m == "greedy")
+                matching = Evaluator::Matching::Greedy;
+            else if (m == "optimal")
+                matching = Evaluator::Matching::Optimal;
+            else {
+                std::cerr << "Unknown matching: " << m << "\n";
+                return -1;
+            }
+            eval.setMatching(matching);
+        }
+        else if (!batch && i == 2 && a.rfind("--", 0) != 0) {
+            gtArg = a;
+        }
+        else {
+            std::cerr << "Unknown arg: " << a << "\n";
+            return -1;
+        }
+    }
 
-        fs::path outImg =
-            imgPath.parent_path() /
-            (imgPath.stem().string() + "_detected.png");
-
-        draw_and_save(img, dets, outImg.string());
-        save_detections_txt(
-            dets,
-            imgPath.string(),
-            hasEval ? &evalRes : nullptr
-        );
+    if (!configPath.empty() && !params.load(configPath)) {
+        std::cerr << "Cannot read config: " << configPath << "\n";
+        return -1;
+    }
+    if (tileSize)
+        params.tileSize = *tileSize;
+    if (pyramidLevels)
+        params.pyramidLevels = *pyramidLevels;
+
+    // with --reduce the config still describes the full-resolution frame
+    CoinDetector detector(params.scaledDown(reduce));
+    DetectSetup setup{ detector, mask };
+    setup.reduce = reduce;
+
+    // tiles of all images share one pool; in batch mode the detect
+    // threads wait on it, so it never runs their own tasks
+    std::unique_ptr<ThreadPool> tilePool;
+    if (params.tileSize > 0) {
+        int threads = jobsSet ? numJobs : int(std::max(1u, std::thread::hardware_concurrency()));
+        tilePool = std::make_unique<ThreadPool>(size_t(threads), size_t(threads) * 4);
+        setup.tiles = tilePool.get();
+    }
 
-        std::cout << "Saved visualization to "
-            << outImg << "\n";
-        };
+    ResultsFile results;
+    if (!resultsPath.empty()) {
+        if (!results.open(resultsPath)) {
+            std::cerr << "Cannot create results file (.csv or .jsonl): "
+                << resultsPath << "\n";
+            return -1;
+        }
+        out.results = &results;
+        out.labelFiles = false;
+    }
 
     // --------------------------------------------------------
     // Single image mode
     // --------------------------------------------------------
     if (!batch) {
-        fs::path imgPath = input;
-        fs::path gtPath;
-        fs::path* gtPtr = nullptr;
+        ImageResult r;
+        r.imgPath = input;
 
-        if (argc >= 3) {
-            gtPath = argv[2];
-            gtPtr = &gtPath;
-        }
+        if (!gtArg.empty() && fs::exists(gtArg))
+            r.gtPath = gtArg;
+        else if (gtArg.empty())
+            r.gtPath = findLabelsFor(input);
 
-        process_image(imgPath, gtPtr);
+        process_image(r, setup, out, eval);
     }
     // --------------------------------------------------------
     // Batch mode
     // --------------------------------------------------------
     else {
         fs::path folder = input;
-        if (!fs::is_directory(folder)) {
+        DatasetPack pack;
+        const bool fromPack = DatasetPack::isPackPath(input);
+        if (fromPack) {
+            if (!pack.open(input)) {
+                std::cerr << "Cannot open pack: " << input << "\n";
+                return -1;
+            }
+        }
+        else if (!fs::is_directory(folder)) {
             std::cerr << "Not a directory: " << folder << "\n";
             return -1;
         }
 
-        int totalTP = 0, totalFP = 0, totalFN = 0, count = 0;
-
-        for (const auto& p : fs::directory_iterator(folder)) {
-            if (!p.is_regular_file())
-                continue;
-
-            std::string ext = p.path().extension().string();
-            if (ext != ".jpg" && ext != ".png" && ext != ".jpeg")
-                continue;
-
-            // Skip already generated result images (_detected)
-            std::string stem = p.path().stem().string();
-            if (stem.size() >= 9 &&
-                stem.compare(stem.size() - 9, 9, "_detected") == 0)
-                continue;
-
-            fs::path gtPath = p.path();
-            gtPath.replace_extension(".txt");
-
-            process_image(
-                p.path(),
-                fs::exists(gtPath) ? &gtPath : nullptr
-            );
+        BatchTotals totals{ matching };
+        auto wall0 = Clock::now();
+
+        std::vector<ImageResult> jobs;
+        if (fromPack) {
+            // entries are in name order already
+            for (size_t i = 0; i < pack.size(); ++i) {
+                ImageResult r;
+                r.imgPath = fs::path(std::string(pack.name(i)));
+                r.pack = &pack;
+                r.packIndex = i;
+                jobs.push_back(std::move(r));
+            }
+        }
+        else {
+            auto add = [&](const fs::directory_entry& p) {
+                if (!p.is_regular_file())
+                    return;
+
+                std::string ext = p.path().extension().string();
+                if (ext != ".jpg" && ext != ".png" && ext != ".jpeg")
+                    return;
+
+                // Skip already generated result images (_detected)
+                std::string stem = p.path().stem().string();
+                if (stem.size() >= 9 &&
+                    stem.compare(stem.size() - 9, 9, "_detected") == 0)
+                    return;
+
+                ImageResult r;
+                r.imgPath = p.path();
+
+                r.gtPath = findLabelsFor(p.path().string());
+
+                jobs.push_back(std::move(r));
+            };
+            if (recursive) {
+                for (const auto& p : fs::recursive_directory_iterator(folder))
+                    add(p);
+            }
+            else {
+                for (const auto& p : fs::directory_iterator(folder))
+                    add(p);
+            }
 
-            if (fs::exists(gtPath)) {
-                cv::Mat img = cv::imread(p.path().string(),
-                    cv::IMREAD_GRAYSCALE);
-                auto dets = detector.detect(img);
-                auto gts = read_gt_file(gtPath.string());
-                auto res = eval.evaluate(dets, gts);
+            // directory_iterator order is unspecified; sort so that output
+            // is stable across runs and job counts. All paths start with
+            // the folder, so this is the name order of a pack's entries.
+            std::sort(jobs.begin(), jobs.end(),
+                [](const ImageResult& a, const ImageResult& b) {
+                    return a.imgPath.generic_string() < b.imgPath.generic_string();
+                });
+        }
+        for (size_t i = 0; i < jobs.size(); ++i)
+            jobs[i].index = i;
 
-                totalTP += res.TP;
-                totalFP += res.FP;
-                totalFN += res.FN;
-                count++;
+        if (numJobs > 1) {
+            run_batch_parallel(jobs, setup, out, eval, numJobs, totals);
+        }
+        else {
+            // overlays are encoded on a thread of their own while the
+            // next image is decoded and detected
+            std::unique_ptr<ThreadPool> encoder;
+            if (out.vis != VisFormat::None && !fromPack) {
+                encoder = std::make_unique<ThreadPool>(1, 2);
+                out.encoder = encoder.get();
             }
+            for (auto& r : jobs) {
+                process_image(r, setup, out, eval);
+                totals.add(r);
+            }
+            encoder.reset();    // the last overlays are written before timing stops
+            out.encoder = nullptr;
         }
 
-        if (count > 0) {
-            double precision =
-                (totalTP + totalFP)
-                ? double(totalTP) / (totalTP + totalFP)
-                : 0.0;
-            double recall =
-                (totalTP + totalFN)
-                ? double(totalTP) / (totalTP + totalFN)
-                : 0.0;
-            double f1 =
-                (precision + recall)
-                ? 2.0 * precision * recall / (precision + recall)
-                : 0.0;
+        totals.print(ms_between(wall0, Clock::now()));
+    }
 
-            std::cout << "\nBatch evaluation ("
-                << count << " images):\n";
-            std::cout << "Precision=" << precision
-                << " Recall=" << recall
-                << " F1=" << f1 << "\n";
+    if (out.results) {
+        if (!results.close()) {
+            std::cerr << "Cannot write results file: " << resultsPath << "\n";
+            return -1;
         }
+        std::cout << "Saved results to " << resultsPath << "\n";
+    }
+    if (failedWrites > 0) {
+        std::cerr << "Cannot write " << failedWrites.load()
+            << " output file(s), see above\n";
+        return -1;
     }
 
     return 0;
@@ -0,0 +1,106 @@
+#include "mapped_file.hpp"
+#include <filesystem>
+#include <utility>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+bool MappedFile::open(const std::string& path) {
+    close();
+
+#ifdef _WIN32
+    // wide path, so names outside the ANSI code page open too
+    HANDLE file = CreateFileW(std::filesystem::path(path).c_str(), GENERIC_READ,
+        FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr,
+        OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER size{};
+    if (!GetFileSizeEx(file, &size)) {
+        CloseHandle(file);
+        return false;
+    }
+    if (size.QuadPart == 0) {
+        CloseHandle(file);
+        open_ = true;
+        return true;
+    }
+
+    // the mapping keeps the file open; the handle is not needed anymore
+    HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    CloseHandle(file);
+    if (!mapping)
+        return false;
+    void* p = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!p) {
+        CloseHandle(mapping);
+        return false;
+    }
+    mapping_ = mapping;
+    data_ = static_cast<const char*>(p);
+    size_ = size_t(size.QuadPart);
+#else
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+
+    struct stat st {};
+    if (::fstat(fd, &st) != 0) {
+        ::close(fd);
+        return false;
+    }
+    if (st.st_size == 0) {
+        ::close(fd);
+        open_ = true;
+        return true;
+    }
+
+    void* p = ::mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED)
+        return false;
+    ::madvise(p, size_t(st.st_size), MADV_SEQUENTIAL);
+    data_ = static_cast<const char*>(p);
+    size_ = size_t(st.st_size);
+#endif
+
+    open_ = true;
+    return true;
+}
+
+void MappedFile::close() {
+    if (data_) {
+#ifdef _WIN32
+        UnmapViewOfFile(data_);
+        CloseHandle(static_cast<HANDLE>(mapping_));
+        mapping_ = nullptr;
+#else
+        ::munmap(const_cast<char*>(data_), size_);
+#endif
+    }
+    data_ = nullptr;
+    size_ = 0;
+    open_ = false;
+}
+
+void MappedFile::swap(MappedFile& o) noexcept {
+    std::swap(data_, o.data_);
+    std::swap(size_, o.size_);
+    std::swap(open_, o.open_);
+#ifdef _WIN32
+    std::swap(mapping_, o.mapping_);
+#endif
+}
@@ -0,0 +1,52 @@
+#include "params_watcher.hpp"
+#include <iostream>
+#include <system_error>
+
+ParamsWatcher::ParamsWatcher(std::string path,
+    const CoinDetector::Params& base,
+    Callback onChange,
+    std::chrono::milliseconds interval)
+    : path_(std::move(path)), base_(base), onChange_(std::move(onChange)),
+    interval_(interval) {
+    // the caller loaded the file already; only later edits are reloads
+    stamp(loaded_);
+    thread_ = std::thread([this] { run(); });
+}
+
+ParamsWatcher::~ParamsWatcher() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    wake_.notify_all();
+    thread_.join();
+}
+
+bool ParamsWatcher::stamp(Stamp& s) const {
+    std::error_code ec;
+    s.time = std::filesystem::last_write_time(path_, ec);
+    if (ec)
+        return false;
+    s.size = std::filesystem::file_size(path_, ec);
+    return !ec;
+}
+
+void ParamsWatcher::run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!wake_.wait_for(lock, interval_, [this] { return stop_; })) {
+        Stamp now;
+        if (!stamp(now) || now == loaded_ || now == failed_)
+            continue;
+
+        CoinDetector::Params p = base_;
+        if (!p.load(path_)) {
+            failed_ = now;
+            std::cerr << "Config reload failed, keeping previous params: "
+                << path_ << "\n";
+            continue;
+        }
+        loaded_ = now;
+        std::cerr << "Reloaded config: " << path_ << "\n";
+        onChange_(p);
+    }
+}
@@ -0,0 +1,528 @@
+#include "coin_detector.hpp"
+#include "evaluator.hpp"
+#include "image_io.hpp"
+#include "label_io.hpp"
+#include "dataset_pack.hpp"
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <future>
+#include <iostream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+// ============================================================
+// Parameter autotuner
+//
+// Searches a grid of CoinDetector::Params against Evaluator F1 over a
+// labelled folder. With --search halving (the default) every config is
+// first scored on a few images, the best 1/eta move on to eta times as
+// many images, and so on until the survivors have seen the whole set.
+//
+// Each image is decoded once. Trials only run Hough + scoring + NMS
+// (CoinDetector::detectBlurred): the blurred images are cached per
+// (gaussKernel, gaussSigma) pair and shared by every config with that
+// pair, and a pair's cache is dropped once no surviving config uses it.
+//
+// HoughCircles time varies by orders of magnitude over the grid (tens
+// of seconds per image for low Canny thresholds with a light blur). A config that
+// takes longer than --max-ms on one image is dropped there: it is not
+// run on further images and ranks below every config within budget.
+// ============================================================
+
+using Params = CoinDetector::Params;
+
+struct Axis {
+    std::string name;
+    std::vector<double> values;
+    std::function<void(Params&, double)> set;
+};
+
+static std::vector<Axis> defaultAxes() {
+    return {
+        { "gaussKernel", { 5, 7, 9, 11 },
+            [](Params& p, double v) { p.gaussKernel = int(v); } },
+        { "gaussSigma", { 1.5, 2.0, 2.5 },
+            [](Params& p, double v) { p.gaussSigma = v; } },
+        { "houghDp", { 1.0, 1.5, 2.0 },
+            [](Params& p, double v) { p.houghDp = v; } },
+        { "houghParam1", { 150, 200, 250 },
+            [](Params& p, double v) { p.houghParam1 = int(v); } },
+        { "houghParam2", { 24, 28, 32, 36, 40 },
+            [](Params& p, double v) { p.houghParam2 = int(v); } },
+        { "houghMinDist", { 30, 47, 60 },
+            [](Params& p, double v) { p.houghMinDist = int(v); } },
+        { "minRadius", { 10, 20 },
+            [](Params& p, double v) { p.minRadius = int(v); } },
+        { "maxRadius", { 150, 200, 250 },
+            [](Params& p, double v) { p.maxRadius = int(v); } },
+    };
+}
+
+struct Options {
+    fs::path data = "data";
+    std::string search = "halving";  // halving | grid
+    int eta = 3;
+    size_t maxConfigs = 729;         // random subset of a larger grid
+    unsigned seed = 1;
+    int jobs = 0;                    // 0 = one per hardware thread
+    double maxMs = 1000.0;           // per image and config, 0 = no limit
+    size_t top = 10;
+    fs::path out;                    // ranked list (CSV)
+    fs::path paramsOut;              // best params (FileStorage)
+    Params base;
+    std::vector<Axis> axes = defaultAxes();
+};
+
+struct LabelledImage {
+    fs::path path;
+    cv::Mat gray;
+    std::vector<GTCircle> gts;
+};
+
+struct Trial {
+    Params params;
+    EvalResult res;
+    size_t images = 0;   // images the last score was computed on
+    int rung = 0;        // last rung the config reached
+    double ms = 0.0;     // mean detect time per image
+    bool tooSlow = false;
+};
+
+// Labelled images of a pack (see coins_pack): raw planes are views of
+// the mapping, so nothing is decoded or copied. `pack` must outlive them.
+static std::vector<LabelledImage> loadPack(const DatasetPack& pack) {
+    std::vector<LabelledImage> out;
+    for (size_t i = 0; i < pack.size(); ++i) {
+        if (!pack.hasLabels(i) || pack.labels(i).empty())
+            continue;
+        LabelledImage img;
+        img.path = fs::path(std::string(pack.name(i)));
+        img.gray = pack.gray(i);
+        img.gts = pack.groundTruth(i);
+        if (img.gray.empty())
+            std::cerr << "Cannot open image: " << img.path << "\n";
+        else
+            out.push_back(std::move(img));
+    }
+    return out;
+}
+
+// Decodes every labelled image under `root` once, in parallel.
+static std::vector<LabelledImage> loadImages(const fs::path& root,
+    ThreadPool& pool) {
+    std::vector<LabelledImage> out;
+    for (const auto& e : fs::recursive_directory_iterator(root)) {
+        if (!e.is_regular_file())
+            continue;
+        std::string ext = e.path().extension().string();
+        if (ext != ".jpg" && ext != ".png" && ext != ".jpeg")
+            continue;
+        std::string stem = e.path().stem().string();
+        if (stem.size() >= 9 &&
+            stem.compare(stem.size() - 9, 9, "_detected") == 0)
+            continue;
+
+        LabelledImage img;
+        img.path = e.path();
+        img.gts = readGroundTruth(findLabelsFor(e.path().string()));
+        if (!img.gts.empty())
+            out.push_back(std::move(img));
+    }
+    std::sort(out.begin(), out.end(),
+        [](const LabelledImage& a, const LabelledImage& b) { return a.path < b.path; });
+
+    std::vector<std::future<void>> done;
+    for (auto& img : out) {
+        done.push_back(pool.submit([&img] {
+            // same decode as the coin_detector batch mode
+            img.gray = readGray(img.path.string());
+        }));
+    }
+    for (auto& f : done)
+        f.get();
+
+    out.erase(std::remove_if(out.begin(), out.end(), [](const LabelledImage& i) {
+        if (i.gray.empty())
+            std::cerr << "Cannot open image: " << i.path << "\n";
+        return i.gray.empty();
+    }), out.end());
+    return out;
+}
+
+// Cartesian product of the axes; a random `maxConfigs` subset if larger.
+static std::vector<Params> makeConfigs(const Options& opt) {
+    std::vector<Params> all{ opt.base };
+    for (const auto& axis : opt.axes) {
+        std::vector<Params> next;
+        next.reserve(all.size() * axis.values.size());
+        for (const auto& p : all) {
+            for (double v : axis.values) {
+                Params q = p;
+                axis.set(q, v);
+                next.push_back(q);
+            }
+        }
+        all = std::move(next);
+    }
+    all.erase(std::remove_if(all.begin(), all.end(),
+        [](const Params& p) { return p.minRadius >= p.maxRadius; }), all.end());
+
+    if (opt.search != "grid" && all.size() > opt.maxConfigs) {
+        std::mt19937 rng(opt.seed);
+        std::shuffle(all.begin(), all.end(), rng);
+        all.resize(opt.maxConfigs);
+    }
+    return all;
+}
+
+// Blur settings as CoinDetector applies them (odd kernel, at least 3).
+using BlurKey = std::pair<int, double>;
+
+static BlurKey blurKey(const Params& p) {
+    int k = p.gaussKernel | 1;
+    return { k < 3 ? 3 : k, p.gaussSigma };
+}
+
+class BlurCache {
+public:
+    explicit BlurCache(const std::vector<LabelledImage>& images)
+        : images_(images) {}
+
+    // Makes sure the first `n` images are blurred for every key used by
+    // `trials`, and forgets keys no longer used.
+    void prepare(const std::vector<Trial*>& trials, size_t n, ThreadPool& pool) {
+        std::map<BlurKey, std::vector<cv::Mat>> keep;
+        for (const Trial* t : trials) {
+            BlurKey key = blurKey(t->params);
+            if (keep.count(key))
+                continue;
+            auto it = cache_.find(key);
+            keep[key] = it != cache_.end() ? std::move(it->second)
+                : std::vector<cv::Mat>(images_.size());
+        }
+        cache_ = std::move(keep);
+
+        std::vector<std::future<void>> done;
+        for (auto& [key, mats] : cache_) {
+            for (size_t i = 0; i < n; ++i) {
+                if (!mats[i].empty())
+                    continue;
+                const int k = key.first;
+                const double sigma = key.second;
+                cv::Mat* dst = &mats[i];
+                const cv::Mat* src = &images_[i].gray;
+                done.push_back(pool.submit([=] {
+                    cv::GaussianBlur(*src, *dst, cv::Size(k, k), sigma);
+                }));
+            }
+        }
+        for (auto& f : done)
+            f.get();
+    }
+
+    const std::vector<cv::Mat>& blurred(const Params& p) const {
+        return cache_.at(blurKey(p));
+    }
+
+private:
+    const std::vector<LabelledImage>& images_;
+    std::map<BlurKey, std::vector<cv::Mat>> cache_;
+};
+
+// Scores every trial on the first `n` images, one task per trial. A
+// trial over `maxMs` on an image stops there and is marked tooSlow.
+static void runRung(const std::vector<Trial*>& trials, size_t n,
+    const std::vector<LabelledImage>& images, const BlurCache& cache,
+    const Evaluator& eval, double maxMs, ThreadPool& pool) {
+    std::vector<std::future<void>> done;
+    done.reserve(trials.size());
+    for (Trial* t : trials) {
+        done.push_back(pool.submit([t, n, maxMs, &images, &cache, &eval] {
+            thread_local DetectorWorkspace ws;
+            thread_local std::vector<DetectedCircle> dets;
+            const CoinDetector detector(t->params);
+            const auto& blurred = cache.blurred(t->params);
+
+            EvalResult total;
+            double totalMs = 0.0;
+            size_t i = 0;
+            t->tooSlow = false;
+            while (i < n && !t->tooSlow) {
+                auto t0 = std::chrono::steady_clock::now();
+                detector.detectBlurred(blurred[i], ws, dets);
+                const double ms = std::chrono::duration<double, std::milli>(
+                    std::chrono::steady_clock::now() - t0).count();
+                totalMs += ms;
+                t->tooSlow = maxMs > 0.0 && ms > maxMs;
+                EvalResult r = eval.evaluate(dets, images[i].gts);
+                total.TP += r.TP;
+                total.FP += r.FP;
+                total.FN += r.FN;
+                ++i;
+            }
+            t->res = total;
+            t->images = i;
+            t->ms = i > 0 ? totalMs / double(i) : 0.0;
+        }));
+    }
+    for (auto& f : done)
+        f.get();
+}
+
+// Better first: within the time budget, deeper rung, then F1, then
+// precision.
+static bool better(const Trial& a, const Trial& b) {
+    if (a.tooSlow != b.tooSlow) return b.tooSlow;
+    if (a.rung != b.rung) return a.rung > b.rung;
+    if (a.res.f1() != b.res.f1()) return a.res.f1() > b.res.f1();
+    return a.res.precision() > b.res.precision();
+}
+
+static std::vector<Trial> search(const std::vector<Params>& configs,
+    const std::vector<LabelledImage>& images, const Options& opt,
+    ThreadPool& pool) {
+    std::vector<Trial> trials(configs.size());
+    for (size_t i = 0; i < configs.size(); ++i)
+        trials[i].params = configs[i];
+
+    const size_t n = images.size();
+    const size_t eta = size_t(std::max(2, opt.eta));
+
+    // Rung r runs on n / eta^(rungs-1-r) images; stop adding rungs once
+    // the first one would have fewer than one image or one survivor.
+    int rungs = 1;
+    if (opt.search != "grid") {
+        size_t f = eta;
+        while (f <= configs.size() && f <= n) {
+            rungs++;
+            f *= eta;
+        }
+    }
+
+    std::vector<Trial*> alive;
+    for (auto& t : trials)
+        alive.push_back(&t);
+
+    const Evaluator eval(25.0f, 0.5f);
+    BlurCache cache(images);
+
+    for (int r = 0; r < rungs; ++r) {
+        size_t div = 1;
+        for (int i = r + 1; i < rungs; ++i)
+            div *= eta;
+        const size_t count = std::max<size_t>(1, (n + div - 1) / div);
+
+        cache.prepare(alive, count, pool);
+        runRung(alive, count, images, cache, eval, opt.maxMs, pool);
+        for (Trial* t : alive)
+            t->rung = r;
+
+        std::sort(alive.begin(), alive.end(),
+            [](const Trial* a, const Trial* b) { return better(*a, *b); });
+        const size_t fast = size_t(std::count_if(alive.begin(), alive.end(),
+            [](const Trial* t) { return !t->tooSlow; }));
+        std::cerr << "Rung " << r << ": " << alive.size() << " configs x "
+            << count << " images, best F1=" << alive.front()->res.f1()
+            << ", " << alive.size() - fast << " over " << opt.maxMs << " ms\n";
+
+        // slow configs never move on, unless nothing else is left
+        if (r + 1 < rungs)
+            alive.resize(std::max<size_t>(1,
+                std::min(fast, (alive.size() + eta - 1) / eta)));
+    }
+
+    std::sort(trials.begin(), trials.end(), better);
+    return trials;
+}
+
+static void writeRow(std::ostream& os, size_t rank, const Trial& t) {
+    const auto& p = t.params;
+    os << rank << "," << t.res.f1() << "," << t.res.precision() << ","
+        << t.res.recall() << "," << t.res.TP << "," << t.res.FP << ","
+        << t.res.FN << "," << t.images << "," << t.ms << ","
+        << (t.tooSlow ? 1 : 0) << "," << p.gaussKernel << ","
+        << p.gaussSigma << "," << p.houghDp << "," << p.houghParam1 << ","
+        << p.houghParam2 << "," << p.houghMinDist << "," << p.minRadius << ","
+        << p.maxRadius << "\n";
+}
+
+static const char* kHeader =
+    "rank,f1,precision,recall,TP,FP,FN,images,ms_per_image,too_slow,"
+    "gaussKernel,gaussSigma,houghDp,houghParam1,houghParam2,houghMinDist,"
+    "minRadius,maxRadius\n";
+
+static void usage() {
+    std::cout
+        << "Usage:\n"
+        << "  coins_autotune <labelled_folder|file.pack> [options]\n"
+        << "Options:\n"
+        << "  --search S        halving (default) or grid (every config on every image)\n"
+        << "  --eta N           halving keeps the best 1/N per rung (default 3)\n"
+        << "  --max-configs N   halving: random subset of the grid (default 729)\n"
+        << "  --seed N          subset seed (default 1)\n"
+        << "  --set name=v,v,.. replace the values searched for one field\n"
+        << "  --base <file>     starting params (FileStorage); fields not searched keep these\n"
+        << "  --jobs N          worker threads (default: all cores)\n"
+        << "  --max-ms N        drop configs slower than N ms on an image\n"
+        << "                    (default 1000, 0 = no limit)\n"
+        << "  --top N           configs printed (default 10)\n"
+        << "  --out <csv>       write the full ranked list\n"
+        << "  --params <file>   write the best params (.yml/.json/.xml)\n";
+}
+
+int main(int argc, char** argv) {
+    Options opt;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string a = argv[i];
+        if (a == "--search" && i + 1 < argc) {
+            opt.search = argv[++i];
+            if (opt.search != "halving" && opt.search != "grid") {
+                std::cerr << "Unknown search: " << opt.search << "\n";
+                return 2;
+            }
+        }
+        else if (a == "--eta" && i + 1 < argc) {
+            opt.eta = std::max(2, std::atoi(argv[++i]));
+        }
+        else if (a == "--max-configs" && i + 1 < argc) {
+            opt.maxConfigs = size_t(std::max(1, std::atoi(argv[++i])));
+        }
+        else if (a == "--seed" && i + 1 < argc) {
+            opt.seed = unsigned(std::atoi(argv[++i]));
+        }
+        else if (a == "--set" && i + 1 < argc) {
+            std::string spec = argv[++i];
+            auto eq = spec.find('=');
+            std::string name = spec.substr(0, eq);
+            auto axis = std::find_if(opt.axes.begin(), opt.axes.end(),
+                [&](const Axis& ax) { return ax.name == name; });
+            if (eq == std::string::npos || axis == opt.axes.end()) {
+                std::cerr << "Unknown field in --set: " << spec << "\n";
+                return 2;
+            }
+            axis->values.clear();
+            std::stringstream ss(spec.substr(eq + 1));
+            std::string item;
+            while (std::getline(ss, item, ','))
+                axis->values.push_back(std::atof(item.c_str()));
+            if (axis->values.empty()) {
+                std::cerr << "No values in --set: " << spec << "\n";
+                return 2;
+            }
+        }
+        else if (a == "--base" && i + 1 < argc) {
+            std::string path = argv[++i];
+            if (!opt.base.load(path)) {
+                std::cerr << "Error: can't read params: " << path << "\n";
+                return 3;
+            }
+        }
+        else if (a == "--jobs" && i + 1 < argc) {
+            opt.jobs = std::atoi(argv[++i]);
+        }
+        else if (a == "--max-ms" && i + 1 < argc) {
+            opt.maxMs = std::max(0.0, std::atof(argv[++i]));
+        }
+        else if (a == "--top" && i + 1 < argc) {
+            opt.top = size_t(std::max(0, std::atoi(argv[++i])));
+        }
+        else if (a == "--out" && i + 1 < argc) {
+            opt.out = argv[++i];
+        }
+        else if (a == "--params" && i + 1 < argc) {
+            opt.paramsOut = argv[++i];
+        }
+        else if (a == "--help" || a == "-h") {
+            usage();
+            return 0;
+        }
+        else if (a.rfind("--", 0) != 0) {
+            opt.data = a;
+        }
+        else {
+            std::cerr << "Unknown arg: " << a << "\n";
+            usage();
+            return 2;
+        }
+    }
+
+    DatasetPack pack;
+    const bool fromPack = DatasetPack::isPackPath(opt.data.string());
+    if (fromPack) {
+        if (!pack.open(opt.data.string())) {
+            std::cerr << "Cannot open pack: " << opt.data << "\n";
+            return 2;
+        }
+    }
+    else if (!fs::is_directory(opt.data)) {
+        std::cerr << "Not a directory: " << opt.data << "\n";
+        return 2;
+    }
+    // trials use detectBlurred, which has no pyramid mode
+    opt.base.pyramidLevels = 0;
+
+    const int jobs = opt.jobs > 0
+        ? opt.jobs
+        : int(std::max(1u, std::thread::hardware_concurrency()));
+    ThreadPool pool{ size_t(jobs), size_t(jobs) * 4 };
+
+    auto images = fromPack ? loadPack(pack) : loadImages(opt.data, pool);
+    if (images.empty()) {
+        std::cerr << "No labelled images under " << opt.data << "\n";
+        return 3;
+    }
+
+    // Halving feeds images to rungs in this order: shuffle so the small
+    // early rungs are not all from one camera folder.
+    std::mt19937 rng(opt.seed);
+    std::shuffle(images.begin(), images.end(), rng);
+
+    auto configs = makeConfigs(opt);
+    if (configs.empty()) {
+        std::cerr << "Empty search space\n";
+        return 2;
+    }
+    std::cerr << "Tuning " << configs.size() << " configs on "
+        << images.size() << " images with " << jobs << " threads ("
+        << opt.search << ")\n";
+
+    auto ranked = search(configs, images, opt, pool);
+
+    std::cout << kHeader;
+    for (size_t i = 0; i < ranked.size() && i < opt.top; ++i)
+        writeRow(std::cout, i + 1, ranked[i]);
+
+    if (!opt.out.empty()) {
+        std::ofstream f(opt.out);
+        if (!f) {
+            std::cerr << "Error: can't open out file: " << opt.out << "\n";
+            return 4;
+        }
+        f << kHeader;
+        for (size_t i = 0; i < ranked.size(); ++i)
+            writeRow(f, i + 1, ranked[i]);
+    }
+
+    if (!opt.paramsOut.empty()) {
+        if (!ranked.front().params.save(opt.paramsOut.string())) {
+            std::cerr << "Error: can't write params: " << opt.paramsOut << "\n";
+            return 4;
+        }
+        std::cerr << "Saved best params to " << opt.paramsOut << "\n";
+    }
+    return 0;
+}
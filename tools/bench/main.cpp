@@ -0,0 +1,745 @@
+#include "coin_detector.hpp"
+#include "evaluator.hpp"
+#include "image_io.hpp"
+#include "label_io.hpp"
+#include "thread_pool.hpp"
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+namespace fs = std::filesystem;
+
+// ============================================================
+// Benchmark over a labelled folder
+//
+// Every image is read from disk once, then for each scale it is
+// resized and re-encoded in memory, so the decode stage measures the
+// codec and not the disk, and the detector's radius range follows the
+// coins (paramsAtScale). Each iteration runs the same stages as the
+// coin_detector batch mode and times them separately:
+//
+//   decode -> gray -> blur -> hough -> score -> nms -> refine
+//     -> evaluate -> visualize -> encode
+//
+// blur..refine come from DetectorWorkspace::timings. Frames decode
+// straight to gray (image_io.hpp), so the gray stage is only kept for
+// comparison with older reports.
+//
+// The detector workspace is reused for every call. Since the frame size
+// changes from image to image, the timed passes only report how often
+// it grew. The steady-state check afterwards runs detect() on each frame
+// kSteadyCalls times in a row (after one untimed call); if any of those
+// calls grew the workspace, the run fails with exit code 5. It also
+// reports the heap allocations of those calls, counted by the replaced
+// global operator new below. They are not zero: OpenCV's GaussianBlur
+// and HoughCircles allocate internally on every call.
+//
+// --verify-simd instead runs the gradient Hough transform on every image
+// once per voting kernel (scalar, SSE4.1, AVX2 as the CPU allows) and
+// compares each accumulator and circle list with the scalar one; any
+// difference fails with exit code 6. It also times each path.
+// ============================================================
+
+using Clock = std::chrono::steady_clock;
+
+// ============================================================
+// Heap allocation counter
+//
+// Counts every C++ allocation of the process. cv::Mat data comes from
+// cv::fastMalloc (malloc), so OpenCV's internal Mats are not seen; its
+// std::vectors are.
+// ============================================================
+
+static std::atomic<size_t> g_allocations{ 0 };
+
+void* operator new(std::size_t n) {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(n ? n : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t n) {
+    return ::operator new(n);
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+
+// detect() calls per frame counted by the steady-state check
+constexpr int kSteadyCalls = 3;
+
+static double msSince(Clock::time_point& t) {
+    auto now = Clock::now();
+    double ms = std::chrono::duration<double, std::milli>(now - t).count();
+    t = now;
+    return ms;
+}
+
+enum Stage {
+    Decode, Gray, Blur, Hough, Score, Nms, Refine, Evaluate, Visualize, Encode,
+    Total, StageCount
+};
+
+static const char* kStageNames[StageCount] = {
+    "decode", "gray", "blur", "hough", "score", "nms", "refine", "evaluate",
+    "visualize", "encode", "total",
+};
+
+struct Options {
+    fs::path data = "data";
+    std::vector<double> scales = { 0.5, 1.0, 2.0 };
+    int iters = 5;
+    int warmup = 1;
+    fs::path json;
+    int jobs = 0;                   // tile threads, 0 = all cores
+    int reduce = 1;                 // decode at 1/reduce resolution
+    std::string vis = "png";        // overlay encoding: png, jpg or none
+    int quality = 90;               // JPEG quality
+    int thumb = 0;                  // overlay long edge, 0 = frame size
+    CoinDetector::Params params;    // tileSize > 0: detectTiled
+    bool verifySimd = false;        // compare Hough kernels, no benchmark
+};
+
+struct BenchImage {
+    fs::path path;
+    std::vector<uchar> bytes;       // file contents
+    std::vector<GTCircle> gts;      // empty if unlabelled
+};
+
+struct Summary {
+    double median = 0.0;
+    double p99 = 0.0;
+    double mean = 0.0;
+};
+
+struct ScaleResult {
+    double scale = 1.0;
+    size_t images = 0;
+    double megapixels = 0.0;        // per pass over all images
+    Summary stages[StageCount];
+    double imagesPerSec = 0.0;
+    double megapixelsPerSec = 0.0;
+    EvalResult eval;                // totals over one pass
+    // DetectorWorkspace counters over the timed passes (frame sizes vary)
+    size_t detectCalls = 0;
+    size_t workspaceGrowths = 0;
+    // steady state: kSteadyCalls repeated calls on each frame
+    size_t steadyCalls = 0;
+    size_t steadyAllocations = 0;   // operator new calls, OpenCV's included
+    size_t steadyGrowths = 0;
+};
+
+static std::vector<BenchImage> loadImages(const fs::path& root) {
+    std::vector<BenchImage> out;
+    for (const auto& e : fs::recursive_directory_iterator(root)) {
+        if (!e.is_regular_file())
+            continue;
+        std::string ext = e.path().extension().string();
+        if (ext != ".jpg" && ext != ".png" && ext != ".jpeg")
+            continue;
+        std::string stem = e.path().stem().string();
+        if (stem.size() >= 9 &&
+            stem.compare(stem.size() - 9, 9, "_detected") == 0)
+            continue;
+
+        BenchImage img;
+        img.path = e.path();
+        std::ifstream f(e.path(), std::ios::binary);
+        img.bytes.assign(std::istreambuf_iterator<char>(f),
+            std::istreambuf_iterator<char>());
+        img.gts = readGroundTruth(findLabelsFor(e.path().string()));
+        out.push_back(std::move(img));
+    }
+    std::sort(out.begin(), out.end(),
+        [](const BenchImage& a, const BenchImage& b) { return a.path < b.path; });
+    return out;
+}
+
+static Summary summarize(std::vector<double> v) {
+    Summary s;
+    if (v.empty())
+        return s;
+    std::sort(v.begin(), v.end());
+    // nearest-rank percentiles
+    auto rank = [&](double q) {
+        size_t i = size_t(std::ceil(q * double(v.size())));
+        return v[std::min(v.size() - 1, i > 0 ? i - 1 : 0)];
+    };
+    s.median = rank(0.5);
+    s.p99 = rank(0.99);
+    double sum = 0.0;
+    for (double x : v) sum += x;
+    s.mean = sum / double(v.size());
+    return s;
+}
+
+// Peak resident set size of this process, in KiB.
+static long peakRssKb() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS pmc{};
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)))
+        return 0;
+    return long(pmc.PeakWorkingSetSize / 1024);
+#else
+    rusage ru{};
+    if (getrusage(RUSAGE_SELF, &ru) != 0)
+        return 0;
+#ifdef __APPLE__
+    return long(ru.ru_maxrss / 1024);  // bytes on macOS
+#else
+    return long(ru.ru_maxrss);         // KiB on Linux
+#endif
+#endif
+}
+
+// The detector for a frame resized by `scale`: radii and minDist follow
+// the coins (at 2x most of the bundled ones are past maxRadius), and
+// upscaled frames raise the vote threshold with the circumference.
+// Downscaled ones keep it: lowered, the noise edges of the small frame
+// pass it too and Hough gets slower and less precise.
+static CoinDetector::Params paramsAtScale(const CoinDetector::Params& p,
+    double scale) {
+    CoinDetector::Params s = p;
+    if (scale == 1.0)
+        return s;
+    auto len = [scale](int v) { return int(std::lround(v * scale)); };
+    s.houghMinDist = std::max(1, len(p.houghMinDist));
+    s.houghParam2 = std::max(p.houghParam2, len(p.houghParam2));
+    s.minRadius = std::max(1, len(p.minRadius));
+    s.maxRadius = std::max(s.minRadius + 1, len(p.maxRadius));
+    return s;
+}
+
+static ScaleResult runScale(const std::vector<BenchImage>& images,
+    double scale, const Options& opt) {
+    const CoinDetector detector(
+        paramsAtScale(opt.params, scale).scaledDown(opt.reduce));
+    const Evaluator eval(25.0f * float(scale), 0.5f);
+    DetectorWorkspace ws;
+    std::vector<DetectedCircle> dets;
+
+    // blur..refine are then summed over the tiles (CPU time, not wall)
+    std::unique_ptr<ThreadPool> tilePool;
+    if (opt.params.tileSize > 0) {
+        size_t threads = opt.jobs > 0 ? size_t(opt.jobs)
+            : std::max<size_t>(1, std::thread::hardware_concurrency());
+        tilePool = std::make_unique<ThreadPool>(threads, threads * 4);
+    }
+
+    // Re-encode every image at this scale, in its original format.
+    struct Input {
+        std::vector<uchar> bytes;
+        std::vector<GTCircle> gts;
+        std::string ext;
+    };
+    std::vector<Input> inputs;
+    ScaleResult out;
+    out.scale = scale;
+    for (const auto& img : images) {
+        cv::Mat src = cv::imdecode(img.bytes, cv::IMREAD_COLOR);
+        if (src.empty()) {
+            std::cerr << "Cannot decode image: " << img.path << "\n";
+            continue;
+        }
+        Input in;
+        in.ext = img.path.extension().string();
+        if (scale == 1.0) {
+            in.bytes = img.bytes;
+        }
+        else {
+            cv::Mat scaled;
+            cv::resize(src, scaled, cv::Size(), scale, scale,
+                scale < 1.0 ? cv::INTER_AREA : cv::INTER_LINEAR);
+            cv::imencode(in.ext, scaled, in.bytes);
+            src = scaled;
+        }
+        for (auto g : img.gts) {
+            g.center *= float(scale);
+            g.radius *= float(scale);
+            in.gts.push_back(g);
+        }
+        out.megapixels += double(src.total()) / 1e6;
+        inputs.push_back(std::move(in));
+    }
+    out.images = inputs.size();
+
+    std::vector<double> samples[StageCount];
+    double totalMs = 0.0;
+    std::vector<uchar> encoded;
+    cv::Mat gray, small, vis;
+    const std::vector<int> encodeParams = opt.vis == "jpg"
+        ? std::vector<int>{ cv::IMWRITE_JPEG_QUALITY, opt.quality }
+        : std::vector<int>{};
+
+    auto detect = [&] {
+        if (tilePool)
+            detector.detectTiled(gray, cv::Mat(), *tilePool, ws, dets);
+        else
+            detector.detect(gray, ws, dets);
+    };
+
+    size_t callsBefore = 0, growthsBefore = 0;
+    for (int it = -opt.warmup; it < opt.iters; ++it) {
+        const bool record = it >= 0;
+        if (it == 0) {
+            callsBefore = ws.calls();
+            growthsBefore = ws.workspaceGrowths();
+        }
+        for (const auto& in : inputs) {
+            double ms[StageCount] = {};
+            auto t0 = Clock::now();
+            auto t = t0;
+
+            gray = decodeGray(in.bytes, opt.reduce);
+            ms[Decode] = msSince(t);
+            ms[Gray] = msSince(t);
+
+            detect();
+            toFullResolution(dets, opt.reduce);
+            msSince(t);
+            ms[Blur] = ws.timings.blur;
+            ms[Hough] = ws.timings.hough;
+            ms[Score] = ws.timings.score;
+            ms[Nms] = ws.timings.nms;
+            ms[Refine] = ws.timings.refine;
+
+            EvalResult er;
+            if (!in.gts.empty())
+                er = eval.evaluate(dets, in.gts);
+            ms[Evaluate] = msSince(t);
+
+            // drawn on the decoded frame (or its --thumb thumbnail), like
+            // coin_detector does
+            float rs = float(opt.reduce);
+            small = gray;
+            const int edge = std::max(gray.cols, gray.rows);
+            if (opt.thumb > 0 && edge > opt.thumb) {
+                const double f = double(opt.thumb) / double(edge);
+                cv::resize(gray, small, cv::Size(std::max(1, cvRound(gray.cols * f)),
+                    std::max(1, cvRound(gray.rows * f))), 0, 0, cv::INTER_AREA);
+                rs *= float(gray.cols) / float(small.cols);
+            }
+            cv::cvtColor(small, vis, cv::COLOR_GRAY2BGR);
+            for (const auto& d : dets) {
+                cv::Point2f c((d.center.x + 0.5f) / rs - 0.5f,
+                    (d.center.y + 0.5f) / rs - 0.5f);
+                cv::circle(vis, c,
+                    static_cast<int>(std::round(d.radius / rs)),
+                    cv::Scalar(0, 0, 255), 2);
+                cv::circle(vis, c, 2, cv::Scalar(0, 255, 0), -1);
+            }
+            ms[Visualize] = msSince(t);
+
+            if (opt.vis != "none")
+                cv::imencode(opt.vis == "jpg" ? ".jpg" : ".png", vis, encoded, encodeParams);
+            ms[Encode] = msSince(t);
+
+            ms[Total] = std::chrono::duration<double, std::milli>(
+                t - t0).count();
+
+            if (!record)
+                continue;
+            for (int s = 0; s < StageCount; ++s)
+                samples[s].push_back(ms[s]);
+            totalMs += ms[Total];
+            if (it == 0) {
+                out.eval.TP += er.TP;
+                out.eval.FP += er.FP;
+                out.eval.FN += er.FN;
+            }
+        }
+    }
+
+    out.detectCalls = ws.calls() - callsBefore;
+    out.workspaceGrowths = ws.workspaceGrowths() - growthsBefore;
+
+    // Steady state at a fixed frame size: the first call on a frame may
+    // resize the workspace, the next ones should allocate nothing.
+    for (const auto& in : inputs) {
+        gray = decodeGray(in.bytes, opt.reduce);
+        detect();
+        const size_t allocations = g_allocations.load();
+        const size_t growths = ws.workspaceGrowths();
+        for (int i = 0; i < kSteadyCalls; ++i)
+            detect();
+        out.steadyAllocations += g_allocations.load() - allocations;
+        out.steadyGrowths += ws.workspaceGrowths() - growths;
+        out.steadyCalls += kSteadyCalls;
+    }
+    for (int s = 0; s < StageCount; ++s)
+        out.stages[s] = summarize(std::move(samples[s]));
+    if (totalMs > 0.0) {
+        const double passes = double(opt.iters);
+        out.imagesPerSec = double(out.images) * passes / (totalMs / 1000.0);
+        out.megapixelsPerSec = out.megapixels * passes / (totalMs / 1000.0);
+    }
+    return out;
+}
+
+static void printScale(const ScaleResult& r) {
+    std::cout << "\nScale " << r.scale << " (" << r.images << " images, "
+        << r.megapixels << " MP):\n";
+    std::cout << std::left << std::setw(12) << "stage"
+        << std::right << std::setw(12) << "median ms"
+        << std::setw(12) << "p99 ms"
+        << std::setw(12) << "mean ms" << "\n";
+    for (int s = 0; s < StageCount; ++s) {
+        std::cout << std::left << std::setw(12) << kStageNames[s]
+            << std::right << std::fixed << std::setprecision(3)
+            << std::setw(12) << r.stages[s].median
+            << std::setw(12) << r.stages[s].p99
+            << std::setw(12) << r.stages[s].mean << "\n";
+    }
+    std::cout.unsetf(std::ios::floatfield);
+    std::cout << std::setprecision(6)
+        << "Throughput: " << r.imagesPerSec << " images/s, "
+        << r.megapixelsPerSec << " MP/s\n";
+    if (r.eval.TP + r.eval.FP + r.eval.FN > 0)
+        std::cout << "F1=" << r.eval.f1() << "\n";
+    std::cout << "Workspace growths: " << r.workspaceGrowths << " in "
+        << r.detectCalls << " timed detect calls\n";
+    std::cout << "Steady state (same frame, " << r.steadyCalls << " calls): "
+        << r.steadyAllocations << " heap allocations, " << r.steadyGrowths
+        << " workspace growths\n";
+}
+
+static std::string jsonString(const std::string& s) {
+    std::string out = "\"";
+    for (char c : s) {
+        if (c == '"' || c == '\\') out += '\\';
+        out += c;
+    }
+    return out + "\"";
+}
+
+static bool writeJson(const fs::path& path, const Options& opt,
+    const std::vector<ScaleResult>& results, long rssKb) {
+    std::ofstream f(path);
+    if (!f)
+        return false;
+
+    const auto& p = opt.params;
+    f << "{\n";
+    f << "  \"data\": " << jsonString(opt.data.generic_string()) << ",\n";
+    f << "  \"iters\": " << opt.iters << ",\n";
+    f << "  \"warmup\": " << opt.warmup << ",\n";
+    f << "  \"backend\": \""
+        << (p.backend == CoinDetector::Backend::Gradient ? "gradient" : "opencv")
+        << "\",\n";
+    f << "  \"pyramid\": " << p.pyramidLevels << ",\n";
+    f << "  \"tile\": " << p.tileSize << ",\n";
+    f << "  \"jobs\": " << opt.jobs << ",\n";
+    f << "  \"reduce\": " << opt.reduce << ",\n";
+    f << "  \"vis\": " << jsonString(opt.vis) << ",\n";
+    f << "  \"quality\": " << opt.quality << ",\n";
+    f << "  \"thumb\": " << opt.thumb << ",\n";
+    f << "  \"simd\": \"" << CircleHough::simdPath() << "\",\n";
+    f << "  \"peak_rss_kb\": " << rssKb << ",\n";
+    f << "  \"scales\": [\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const auto& r = results[i];
+        f << "    {\n";
+        f << "      \"scale\": " << r.scale << ",\n";
+        f << "      \"images\": " << r.images << ",\n";
+        f << "      \"megapixels\": " << r.megapixels << ",\n";
+        f << "      \"images_per_sec\": " << r.imagesPerSec << ",\n";
+        f << "      \"megapixels_per_sec\": " << r.megapixelsPerSec << ",\n";
+        f << "      \"f1\": " << r.eval.f1() << ",\n";
+        f << "      \"detect_calls\": " << r.detectCalls << ",\n";
+        f << "      \"workspace_growths\": " << r.workspaceGrowths << ",\n";
+        f << "      \"steady_calls\": " << r.steadyCalls << ",\n";
+        f << "      \"steady_allocations\": " << r.steadyAllocations << ",\n";
+        f << "      \"steady_workspace_growths\": " << r.steadyGrowths << ",\n";
+        f << "      \"stages\": {\n";
+        for (int s = 0; s < StageCount; ++s) {
+            f << "        \"" << kStageNames[s] << "\": { \"median_ms\": "
+                << r.stages[s].median << ", \"p99_ms\": " << r.stages[s].p99
+                << ", \"mean_ms\": " << r.stages[s].mean << " }"
+                << (s + 1 < StageCount ? "," : "") << "\n";
+        }
+        f << "      }\n";
+        f << "    }" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    f << "  ]\n";
+    f << "}\n";
+    return bool(f);
+}
+
+// Runs CircleHough on every image with each voting kernel this CPU has
+// and compares the results with the scalar kernel's. Returns the number
+// of images where some path differs.
+static size_t verifySimd(const std::vector<BenchImage>& images,
+    const Options& opt) {
+    const CoinDetector::Params p = opt.params.scaledDown(opt.reduce);
+    CircleHough::Params hp;
+    hp.dp = p.houghDp;
+    hp.minDist = p.houghMinDist;
+    hp.edgeThreshold = p.houghParam1 / 2;
+    hp.voteThreshold = p.houghParam2;
+    hp.minRadius = p.minRadius;
+    hp.maxRadius = p.maxRadius;
+    const int k = std::max(3, p.gaussKernel | 1);
+
+    const CircleHough::Simd paths[] = {
+        CircleHough::Simd::Scalar, CircleHough::Simd::SSE41, CircleHough::Simd::AVX2,
+    };
+    const int pathCount = int(std::size(paths));
+    std::vector<CircleHough> engines(std::size(paths));
+    std::vector<double> ms(std::size(paths), 0.0);
+    std::vector<bool> available(std::size(paths), false);
+    for (int i = 0; i < pathCount; ++i)
+        available[i] = engines[i].setSimd(paths[i]);
+
+    size_t mismatched = 0;
+    cv::Mat blurred, ref, acc;
+    std::vector<cv::Vec4f> refCircles, circles;
+    for (const auto& img : images) {
+        cv::Mat gray = decodeGray(img.bytes, opt.reduce);
+        if (gray.empty()) {
+            std::cerr << "Warning: can't decode " << img.path << "\n";
+            continue;
+        }
+        cv::GaussianBlur(gray, blurred, cv::Size(k, k), p.gaussSigma);
+
+        bool same = true;
+        for (int i = 0; i < pathCount; ++i) {
+            if (!available[i])
+                continue;
+            auto& engine = engines[i];
+            auto& out = i == 0 ? refCircles : circles;
+            for (int it = 0; it < opt.warmup; ++it)
+                engine.detect(blurred, hp, out);
+            auto t = Clock::now();
+            for (int it = 0; it < opt.iters; ++it)
+                engine.detect(blurred, hp, out);
+            ms[i] += msSince(t) / opt.iters;
+
+            if (i == 0) {
+                engine.accumulator(ref);
+                continue;
+            }
+            engine.accumulator(acc);
+            size_t cells = 0;
+            if (acc.size() != ref.size()) {
+                cells = ref.total();
+            }
+            else {
+                for (int y = 0; y < acc.rows; ++y) {
+                    const int32_t* a = acc.ptr<int32_t>(y);
+                    const int32_t* b = ref.ptr<int32_t>(y);
+                    for (int x = 0; x < acc.cols; ++x)
+                        cells += a[x] != b[x];
+                }
+            }
+            if (cells > 0 || circles != refCircles) {
+                std::cerr << "Mismatch: " << engine.path() << " vs scalar on "
+                    << img.path << ": " << cells << " accumulator cells, "
+                    << circles.size() << " vs " << refCircles.size()
+                    << " circles\n";
+                same = false;
+            }
+        }
+        if (!same)
+            ++mismatched;
+    }
+
+    std::cout << "Hough detect per pass over " << images.size()
+        << " images (mean of " << opt.iters << " runs each):\n";
+    for (int i = 0; i < pathCount; ++i) {
+        if (!available[i])
+            continue;
+        std::cout << "  " << std::left << std::setw(8) << engines[i].path()
+            << std::right << std::fixed << std::setprecision(3)
+            << std::setw(10) << ms[i] << " ms";
+        if (i > 0 && ms[i] > 0.0)
+            std::cout << std::setprecision(2) << "  x" << ms[0] / ms[i];
+        std::cout << "\n";
+    }
+    std::cout.unsetf(std::ios::floatfield);
+    std::cout << std::setprecision(6);
+    return mismatched;
+}
+
+static void usage() {
+    std::cout
+        << "Usage:\n"
+        << "  coins_bench [data_dir] [options]\n"
+        << "Options:\n"
+        << "  --scales S,S,..  image scales to run (default 0.5,1,2)\n"
+        << "  --iters N        timed passes over the folder (default 5)\n"
+        << "  --warmup N       untimed passes first (default 1)\n"
+        << "  --json <path>    also write results as JSON\n"
+        << "  --pyramid L      coarse-to-fine detection at 1/2^L scale\n"
+        << "  --backend B      Hough backend: opencv (default) or gradient\n"
+        << "                   (experimental, not selectable elsewhere)\n"
+        << "  --tile N         tiled detection with NxN tiles\n"
+        << "  --jobs N         tile threads (default: all cores)\n"
+        << "  --reduce N       decode and detect at 1/N resolution (2, 4, 8)\n"
+        << "  --vis V          overlay encoding: png (default), jpg or none\n"
+        << "  --quality Q      JPEG quality for --vis jpg (default 90)\n"
+        << "  --thumb N        draw the overlay on a thumbnail, long edge <= N\n"
+        << "  --verify-simd    check the Hough SIMD kernels against scalar\n";
+}
+
+int main(int argc, char** argv) {
+    Options opt;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string a = argv[i];
+        if (a == "--scales" && i + 1 < argc) {
+            opt.scales.clear();
+            std::stringstream ss(argv[++i]);
+            std::string item;
+            while (std::getline(ss, item, ',')) {
+                double s = std::atof(item.c_str());
+                if (s > 0.0)
+                    opt.scales.push_back(s);
+            }
+        }
+        else if (a == "--iters" && i + 1 < argc) {
+            opt.iters = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (a == "--warmup" && i + 1 < argc) {
+            opt.warmup = std::max(0, std::atoi(argv[++i]));
+        }
+        else if (a == "--json" && i + 1 < argc) {
+            opt.json = argv[++i];
+        }
+        else if (a == "--pyramid" && i + 1 < argc) {
+            opt.params.pyramidLevels = std::max(0, std::atoi(argv[++i]));
+        }
+        else if (a == "--tile" && i + 1 < argc) {
+            opt.params.tileSize = std::max(64, std::atoi(argv[++i]));
+        }
+        else if (a == "--jobs" && i + 1 < argc) {
+            opt.jobs = std::max(0, std::atoi(argv[++i]));
+        }
+        else if (a == "--reduce" && i + 1 < argc) {
+            opt.reduce = supportedReduction(std::atoi(argv[++i]));
+        }
+        else if (a == "--vis" && i + 1 < argc) {
+            opt.vis = argv[++i];
+            if (opt.vis == "jpeg")
+                opt.vis = "jpg";
+            if (opt.vis != "png" && opt.vis != "jpg" && opt.vis != "none") {
+                std::cerr << "Unknown --vis: " << opt.vis << "\n";
+                return 2;
+            }
+        }
+        else if (a == "--quality" && i + 1 < argc) {
+            opt.quality = std::clamp(std::atoi(argv[++i]), 1, 100);
+        }
+        else if (a == "--thumb" && i + 1 < argc) {
+            opt.thumb = std::max(0, std::atoi(argv[++i]));
+        }
+        else if (a == "--backend" && i + 1 < argc) {
+            std::string b = argv[++i];
+            if (b == "opencv")
+                opt.params.backend = CoinDetector::Backend::OpenCV;
+            else if (b == "gradient")
+                opt.params.backend = CoinDetector::Backend::Gradient;
+            else {
+                std::cerr << "Unknown backend: " << b << "\n";
+                return 2;
+            }
+        }
+        else if (a == "--verify-simd") {
+            opt.verifySimd = true;
+        }
+        else if (a == "--help" || a == "-h") {
+            usage();
+            return 0;
+        }
+        else if (a.rfind("--", 0) != 0) {
+            opt.data = a;
+        }
+        else {
+            std::cerr << "Unknown arg: " << a << "\n";
+            usage();
+            return 2;
+        }
+    }
+
+    if (!fs::is_directory(opt.data)) {
+        std::cerr << "Not a directory: " << opt.data << "\n";
+        return 2;
+    }
+    if (opt.scales.empty()) {
+        std::cerr << "No valid --scales\n";
+        return 2;
+    }
+
+    auto images = loadImages(opt.data);
+    if (images.empty()) {
+        std::cerr << "No images under " << opt.data << "\n";
+        return 3;
+    }
+    if (opt.verifySimd) {
+        const size_t bad = verifySimd(images, opt);
+        if (bad > 0) {
+            std::cerr << "Error: SIMD and scalar Hough voting differ on "
+                << bad << " of " << images.size() << " images\n";
+            return 6;
+        }
+        std::cout << "All Hough kernels agree on " << images.size()
+            << " images\n";
+        return 0;
+    }
+
+    std::cout << "Benchmarking " << images.size() << " images from "
+        << opt.data << ", " << opt.iters << " iterations, hough simd="
+        << CircleHough::simdPath() << "\n";
+
+    std::vector<ScaleResult> results;
+    for (double s : opt.scales) {
+        results.push_back(runScale(images, s, opt));
+        printScale(results.back());
+    }
+
+    const long rss = peakRssKb();
+    std::cout << "\nPeak RSS: " << rss << " KiB\n";
+
+    if (!opt.json.empty()) {
+        if (!writeJson(opt.json, opt, results, rss)) {
+            std::cerr << "Error: can't write " << opt.json << "\n";
+            return 4;
+        }
+        std::cout << "Wrote " << opt.json << "\n";
+    }
+
+    for (const auto& r : results) {
+        if (r.steadyGrowths > 0) {
+            std::cerr << "Error: repeated detect() on the same frame grew "
+                << "its workspace on " << r.steadyGrowths << " of "
+                << r.steadyCalls << " calls (scale " << r.scale << ")\n";
+            return 5;
+        }
+    }
+    return 0;
+}
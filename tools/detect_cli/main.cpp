@@ -1,31 +1,251 @@
 #include "Detector.hpp"
-#include <opencv2/imgcodecs.hpp>
+#include "atomic_shared.hpp"
+#include "coin_detector.hpp"
+#include "circle_tracker.hpp"
+#include "image_io.hpp"
+#include "label_io.hpp"
+#include "params_watcher.hpp"
+#include "server.hpp"
+#include <opencv2/imgproc.hpp>
+#include <opencv2/videoio.hpp>
 #include <iostream>
 #include <fstream>
+#include <sstream>
 #include <string>
 #include <vector>
 #include <algorithm>
+#include <chrono>
+#include <cctype>
+#include <cstdlib>
+#include <memory>
 
 static void usage() {
     std::cout
         << "Usage:\n"
-        << "  coin_detect_cli --image <path> [--out <labels.txt>]\n"
+        << "  coin_detect_cli --image <path> [--out <labels.txt|.csv|.json>]\n"
+        << "  coin_detect_cli --video <file|device> [--out <tracks.txt>] [--full-scan N]\n"
+        << "  coin_detect_cli --serve [--socket <path>] [--workers N]\n"
+        << "  coin_detect_cli --connect <socket> --image <path> [--send-bytes]\n"
         << "\n"
-        << "Output format (stdout and --out): cx cy r\n";
+        << "  --config <file>  detector params (.yml/.json/.xml, see\n"
+        << "                   CoinDetector::Params::load); --video and --serve\n"
+        << "                   reload it when it changes\n"
+        << "  --classifier <model>  coin classifier trained by coins_train\n"
+        << "                   (--image: adds \"# classes\" and \"# total\" lines)\n"
+        << "\n"
+        << "Output format (stdout and --out):\n"
+        << "  --image: one line per circle: cx cy r\n"
+        << "  --video: one line per frame: frame n [id cx cy r score]*n\n"
+        << "           (confirmed tracks only; fps summary on stderr)\n"
+        << "  --serve: requests \"PATH <p>\" or \"DATA <n>\" + n bytes on stdin\n"
+        << "           or the socket; replies \"OK <n> <ms>\" + n lines\n"
+        << "           \"cx cy r score\" (see tools/detect_cli/server.cpp)\n";
+}
+
+static int runImage(const std::string& imagePath, const std::string& outPath,
+    const CoinDetector::Params& params, const std::string& classifierPath) {
+    // the classifier reads color; detection alone needs only the gray
+    // plane, which is decoded directly
+    cv::Mat img = classifierPath.empty() ? readGray(imagePath) : readColor(imagePath);
+    if (img.empty()) {
+        std::cerr << "Error: failed to read image: " << imagePath << "\n";
+        return 3;
+    }
+
+    Detector det(params);
+    std::shared_ptr<CoinClassifier> classifier;
+    if (!classifierPath.empty()) {
+        classifier = std::make_shared<CoinClassifier>();
+        if (!classifier->load(classifierPath)) {
+            std::cerr << "Error: can't read classifier: " << classifierPath << "\n";
+            return 3;
+        }
+        det.setClassifier(classifier);
+    }
+    auto detections = det.run(img);
+
+    std::vector<LabelCircle> labels;
+    labels.reserve(detections.size());
+    for (const auto& d : detections)
+        labels.push_back({ d.center.x, d.center.y, d.radius });
+
+    // stdout: "cx cy r" lines
+    LabelWriter out(LabelFormat::Txt);
+    out.add(labels);
+    if (classifier) {
+        // class names in circle order, then the sum of their values
+        std::vector<int> ids;
+        std::string names = "classes";
+        for (const auto& d : detections) {
+            ids.push_back(d.class_id);
+            names += ' ';
+            names += d.class_id >= 0 ? classifier->classes()[d.class_id].name : "?";
+        }
+        out.comment(names);
+        out.comment("total " + std::to_string(classifier->total(ids)));
+    }
+    std::cout << out.str();
+
+    // file: txt, csv or json by extension
+    if (!outPath.empty()) {
+        LabelFormat fmt = labelFormatFor(outPath);
+        if (fmt != LabelFormat::Txt && fmt != LabelFormat::Auto) {
+            out.clear(fmt);
+            out.add(labels);
+        }
+        if (!out.writeTo(outPath)) {
+            std::cerr << "Error: can't open out file: " << outPath << "\n";
+            return 4;
+        }
+    }
+
+    return 0;
+}
+
+static bool isDeviceIndex(const std::string& s) {
+    return !s.empty() && std::all_of(s.begin(), s.end(),
+        [](unsigned char c) { return std::isdigit(c) != 0; });
+}
+
+static int runVideo(const std::string& source, const std::string& outPath,
+    int fullScanInterval, const CoinDetector::Params& params,
+    const std::string& configPath) {
+    cv::VideoCapture cap;
+    bool opened = isDeviceIndex(source)
+        ? cap.open(std::stoi(source))
+        : cap.open(source);
+    if (!opened) {
+        std::cerr << "Error: failed to open video: " << source << "\n";
+        return 3;
+    }
+
+    std::ofstream f;
+    if (!outPath.empty()) {
+        f.open(outPath);
+        if (!f) {
+            std::cerr << "Error: can't open out file: " << outPath << "\n";
+            return 4;
+        }
+    }
+
+    // The watcher thread publishes a new detector; the loop below picks
+    // it up between frames, so a reload never stalls or drops a frame.
+    auto active = std::make_shared<const CoinDetector>(params);
+    AtomicShared<const CoinDetector> latest{ active };
+    std::unique_ptr<ParamsWatcher> watcher;
+    if (!configPath.empty()) {
+        // reloads start from the startup params: a key deleted from the
+        // file goes back to its value at startup
+        watcher = std::make_unique<ParamsWatcher>(configPath,
+            params,
+            [&latest](const CoinDetector::Params& p) {
+                latest.store(std::make_shared<const CoinDetector>(p));
+            });
+    }
+
+    CircleTracker::Params tp;
+    if (fullScanInterval > 0)
+        tp.fullScanInterval = fullScanInterval;
+    CircleTracker tracker(*active, tp);
+
+    cv::Mat frame, gray;
+    int frames = 0, fullScans = 0;
+    auto t0 = std::chrono::steady_clock::now();
+
+    while (cap.read(frame)) {
+        if (frame.channels() == 3)
+            cv::cvtColor(frame, gray, cv::COLOR_BGR2GRAY);
+        else if (frame.channels() == 4)
+            cv::cvtColor(frame, gray, cv::COLOR_BGRA2GRAY);
+        else
+            gray = frame;
+
+        if (auto next = latest.load(); next != active) {
+            active = std::move(next);
+            tracker.setDetector(*active);
+        }
+
+        tracker.update(gray);
+        fullScans += tracker.lastWasFullScan() ? 1 : 0;
+
+        std::ostringstream line;
+        int n = 0;
+        for (const auto& t : tracker.tracks())
+            if (t.confirmed) n++;
+        line << frames << " " << n;
+        for (const auto& t : tracker.tracks()) {
+            if (!t.confirmed) continue;
+            line << " " << t.id << " " << t.center.x << " " << t.center.y
+                << " " << t.radius << " " << t.score;
+        }
+        line << "\n";
+
+        std::cout << line.str() << std::flush;
+        if (f) f << line.str();
+        frames++;
+    }
+
+    double sec = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - t0).count();
+    std::cerr << "frames=" << frames
+        << " fps=" << (sec > 0 ? frames / sec : 0.0)
+        << " full_scans=" << fullScans
+        << " coins=" << tracker.confirmedCount() << "\n";
+    return 0;
 }
 
 int main(int argc, char** argv) {
     std::string imagePath;
+    std::string videoSource;
     std::string outPath;
+    int fullScanInterval = 0;
+    bool serve = false;
+    bool sendBytes = false;
+    std::string connectPath;
+    std::string configPath;
+    std::string classifierPath;
+    CoinDetector::Params params;
+    ServerOptions server;
 
     for (int i = 1; i < argc; ++i) {
         std::string a = argv[i];
         if (a == "--image" && i + 1 < argc) {
             imagePath = argv[++i];
         }
+        else if (a == "--video" && i + 1 < argc) {
+            videoSource = argv[++i];
+        }
         else if (a == "--out" && i + 1 < argc) {
             outPath = argv[++i];
         }
+        else if (a == "--full-scan" && i + 1 < argc) {
+            fullScanInterval = std::atoi(argv[++i]);
+        }
+        else if (a == "--serve") {
+            serve = true;
+        }
+        else if (a == "--socket" && i + 1 < argc) {
+            server.socketPath = argv[++i];
+        }
+        else if (a == "--workers" && i + 1 < argc) {
+            server.workers = std::atoi(argv[++i]);
+        }
+        else if (a == "--connect" && i + 1 < argc) {
+            connectPath = argv[++i];
+        }
+        else if (a == "--send-bytes") {
+            sendBytes = true;
+        }
+        else if (a == "--config" && i + 1 < argc) {
+            configPath = argv[++i];
+            if (!params.load(configPath)) {
+                std::cerr << "Error: can't read config: " << configPath << "\n";
+                return 3;
+            }
+        }
+        else if (a == "--classifier" && i + 1 < argc) {
+            classifierPath = argv[++i];
+        }
         else if (a == "--help" || a == "-h") {
             usage();
             return 0;
@@ -37,51 +257,23 @@ int main(int argc, char** argv) {
         }
     }
 
-    if (imagePath.empty()) {
-        std::cerr << "Error: --image is required\n";
-        usage();
-        return 2;
+    if (serve) {
+        server.params = params;
+        server.configPath = configPath;
+        return runServer(server);
     }
 
-    cv::Mat img = cv::imread(imagePath, cv::IMREAD_COLOR);
-    if (img.empty()) {
-        std::cerr << "Error: failed to read image: " << imagePath << "\n";
-        return 3;
-    }
-
-    Detector det;
-    auto detections = det.run(img);
-
-    // Detection(bbox) -> Circle(cx,cy,r)
-    struct CircleOut { double cx, cy, r; };
-    std::vector<CircleOut> circles;
-    circles.reserve(detections.size());
+    if (!videoSource.empty())
+        return runVideo(videoSource, outPath, fullScanInterval, params, configPath);
 
-    for (const auto& d : detections) {
-        double cx = d.bbox.x + d.bbox.width * 0.5;
-        double cy = d.bbox.y + d.bbox.height * 0.5;
-        double r = 0.5 * std::min(d.bbox.width, d.bbox.height);
-        circles.push_back({ cx, cy, r });
+    if (imagePath.empty()) {
+        std::cerr << "Error: --image, --video or --serve is required\n";
+        usage();
+        return 2;
     }
 
-    auto dump = [&](std::ostream& os) {
-        for (const auto& c : circles) {
-            os << c.cx << " " << c.cy << " " << c.r << "\n";
-        }
-        };
-
-    // stdout
-    dump(std::cout);
-
-    // file
-    if (!outPath.empty()) {
-        std::ofstream f(outPath);
-        if (!f) {
-            std::cerr << "Error: can't open out file: " << outPath << "\n";
-            return 4;
-        }
-        dump(f);
-    }
+    if (!connectPath.empty())
+        return runClient(connectPath, imagePath, sendBytes);
 
-    return 0;
+    return runImage(imagePath, outPath, params, classifierPath);
 }
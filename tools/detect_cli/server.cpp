@@ -0,0 +1,509 @@
+#include "server.hpp"
+#include "Detector.hpp"
+#include "bounded_queue.hpp"
+#include "image_io.hpp"
+#include "params_watcher.hpp"
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <iostream>
+#include <iterator>
+#include <list>
+#include <memory>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <cerrno>
+#include <csignal>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+// ============================================================
+// Protocol
+//
+// Requests (any number per connection; replies come back in order):
+//   PATH <image path>\n
+//   DATA <n>\n<n bytes of an encoded image (jpg/png/...)>
+//   QUIT\n
+// Reply:
+//   OK <count> <latency_ms>\n followed by <count> lines "cx cy r score"
+//   ERR <message>\n
+//
+// Latency is measured from the moment the request was fully read to
+// the moment its reply is ready, so it includes time queued for a
+// worker.
+// ============================================================
+
+namespace {
+
+constexpr size_t kMaxPayload = size_t(256) << 20;
+// Longest request line; real ones ("PATH <p>", "DATA <n>") are far
+// shorter. A client that sends more without a newline is dropped.
+constexpr size_t kMaxLine = size_t(1) << 20;
+
+using Clock = std::chrono::steady_clock;
+
+// Byte stream a client talks over.
+class Channel {
+public:
+    virtual ~Channel() = default;
+    virtual bool readLine(std::string& line) = 0;
+    virtual bool readExact(std::vector<uchar>& buf, size_t n) = 0;
+    virtual bool write(const std::string& s) = 0;
+};
+
+class StdioChannel : public Channel {
+public:
+    StdioChannel() {
+#ifdef _WIN32
+        _setmode(_fileno(stdin), _O_BINARY);
+        _setmode(_fileno(stdout), _O_BINARY);
+#endif
+    }
+
+    bool readLine(std::string& line) override {
+        return bool(std::getline(std::cin, line));
+    }
+
+    bool readExact(std::vector<uchar>& buf, size_t n) override {
+        buf.resize(n);
+        return bool(std::cin.read(reinterpret_cast<char*>(buf.data()),
+            std::streamsize(n)));
+    }
+
+    bool write(const std::string& s) override {
+        std::cout.write(s.data(), std::streamsize(s.size()));
+        std::cout.flush();
+        return bool(std::cout);
+    }
+};
+
+#ifndef _WIN32
+// A peer that went away must surface as a failed send, not SIGPIPE.
+// macOS has no MSG_NOSIGNAL; both ends also ignore SIGPIPE.
+#ifdef MSG_NOSIGNAL
+constexpr int kSendFlags = MSG_NOSIGNAL;
+#else
+constexpr int kSendFlags = 0;
+#endif
+
+class SocketChannel : public Channel {
+public:
+    // owns = false: the caller closes fd (after it is done with the
+    // channel), so it can also shut the socket down from another thread
+    explicit SocketChannel(int fd, bool owns = true) : fd_(fd), owns_(owns) {}
+    ~SocketChannel() override {
+        if (owns_)
+            ::close(fd_);
+    }
+
+    bool readLine(std::string& line) override {
+        line.clear();
+        size_t scanned = 0;     // bytes after pos_ known to hold no '\n'
+        for (;;) {
+            auto nl = std::find(buf_.begin() + pos_ + scanned, buf_.end(), '\n');
+            if (nl != buf_.end()) {
+                line.assign(buf_.begin() + pos_, nl);
+                pos_ = size_t(nl - buf_.begin()) + 1;
+                return true;
+            }
+            scanned = buf_.size() - pos_;
+            if (scanned > kMaxLine || !fill())
+                return false;
+        }
+    }
+
+    bool readExact(std::vector<uchar>& out, size_t n) override {
+        out.clear();
+        out.reserve(n);
+        while (out.size() < n) {
+            if (pos_ == buf_.size() && !fill())
+                return false;
+            size_t take = std::min(n - out.size(), buf_.size() - pos_);
+            out.insert(out.end(), buf_.begin() + pos_, buf_.begin() + pos_ + take);
+            pos_ += take;
+        }
+        return true;
+    }
+
+    bool write(const std::string& s) override {
+        size_t off = 0;
+        while (off < s.size()) {
+            ssize_t n = ::send(fd_, s.data() + off, s.size() - off, kSendFlags);
+            if (n <= 0)
+                return false;
+            off += size_t(n);
+        }
+        return true;
+    }
+
+private:
+    // Drops consumed bytes and appends whatever the socket has.
+    bool fill() {
+        buf_.erase(buf_.begin(), buf_.begin() + pos_);
+        pos_ = 0;
+        char tmp[64 * 1024];
+        ssize_t n = ::recv(fd_, tmp, sizeof(tmp), 0);
+        if (n <= 0)
+            return false;
+        buf_.insert(buf_.end(), tmp, tmp + n);
+        return true;
+    }
+
+    int fd_;
+    bool owns_;
+    std::string buf_;
+    size_t pos_ = 0;
+};
+#endif
+
+std::string detectReply(const cv::Mat& gray, const Detector& detector,
+    Clock::time_point received) {
+    if (gray.empty())
+        return "ERR cannot decode image\n";
+
+    auto detections = detector.run(gray);
+    double ms = std::chrono::duration<double, std::milli>(
+        Clock::now() - received).count();
+
+    std::ostringstream os;
+    os << "OK " << detections.size() << " " << ms << "\n";
+    for (const auto& d : detections) {
+        os << d.center.x << " " << d.center.y << " " << d.radius << " "
+            << d.confidence << "\n";
+    }
+    return os.str();
+}
+
+// Runs a request (decode + detect) on a pool thread. An exception
+// becomes an ERR reply instead of reaching the writer's future::get(),
+// where it would take the whole server down.
+template <typename F>
+std::string guardedReply(F&& work) {
+    try {
+        return work();
+    }
+    catch (const std::exception& e) {
+        // one reply line: cv::Exception messages span several
+        std::string msg = e.what();
+        while (!msg.empty() && std::isspace(static_cast<unsigned char>(msg.back())))
+            msg.pop_back();
+        std::replace(msg.begin(), msg.end(), '\n', ' ');
+        return "ERR " + msg + "\n";
+    }
+    catch (...) {
+        return "ERR unknown error\n";
+    }
+}
+
+std::future<std::string> readyReply(std::string s) {
+    std::promise<std::string> p;
+    p.set_value(std::move(s));
+    return p.get_future();
+}
+
+// Reads requests from `ch` on the calling thread and hands them to the
+// pool; a writer thread sends the replies back in request order.
+void serveChannel(Channel& ch, const Detector& detector, ThreadPool& pool) {
+    BoundedQueue<std::future<std::string>> replies(pool.size() * 2);
+
+    std::thread writer([&] {
+        bool ok = true;
+        while (auto r = replies.pop()) {
+            std::string s = r->get();
+            if (ok)
+                ok = ch.write(s);
+        }
+    });
+
+    std::string line;
+    while (ch.readLine(line)) {
+        if (!line.empty() && line.back() == '\r')
+            line.pop_back();
+        if (line.empty())
+            continue;
+        if (line == "QUIT")
+            break;
+
+        if (line.rfind("PATH ", 0) == 0) {
+            std::string path = line.substr(5);
+            auto received = Clock::now();
+            replies.push(pool.submit([path, received, &detector] {
+                return guardedReply([&] {
+                    cv::Mat gray = readGray(path);
+                    return detectReply(gray, detector, received);
+                });
+            }));
+        }
+        else if (line.rfind("DATA ", 0) == 0) {
+            size_t n = 0;
+            std::istringstream(line.substr(5)) >> n;
+            if (n == 0 || n > kMaxPayload) {
+                // cannot resynchronise without a valid length
+                replies.push(readyReply("ERR bad payload size\n"));
+                break;
+            }
+            auto data = std::make_shared<std::vector<uchar>>();
+            if (!ch.readExact(*data, n))
+                break;
+            auto received = Clock::now();
+            replies.push(pool.submit([data, received, &detector] {
+                return guardedReply([&] {
+                    cv::Mat gray = decodeGray(*data);
+                    return detectReply(gray, detector, received);
+                });
+            }));
+        }
+        else {
+            replies.push(readyReply("ERR unknown request\n"));
+        }
+    }
+
+    replies.close();
+    writer.join();
+}
+
+#ifndef _WIN32
+int connectUnix(const std::string& path) {
+    sockaddr_un addr{};
+    if (path.size() >= sizeof(addr.sun_path))
+        return -1;
+    addr.sun_family = AF_UNIX;
+    std::copy(path.begin(), path.end(), addr.sun_path);
+
+    int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+        return -1;
+    if (::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Binds and listens on `path`. An existing file there is replaced only
+// if it is a socket no server answers on (left by one that crashed).
+int listenUnix(const std::string& path) {
+    sockaddr_un addr{};
+    if (path.size() >= sizeof(addr.sun_path))
+        return -1;
+    addr.sun_family = AF_UNIX;
+    std::copy(path.begin(), path.end(), addr.sun_path);
+    auto* sa = reinterpret_cast<sockaddr*>(&addr);
+
+    int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+        return -1;
+    if (::bind(fd, sa, sizeof(addr)) != 0) {
+        struct stat st{};
+        bool stale = errno == EADDRINUSE &&
+            ::lstat(path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode);
+        if (stale) {
+            int probe = connectUnix(path);
+            if (probe >= 0) {
+                ::close(probe);
+                stale = false;
+            }
+        }
+        if (!stale || ::unlink(path.c_str()) != 0 || ::bind(fd, sa, sizeof(addr)) != 0) {
+            ::close(fd);
+            return -1;
+        }
+    }
+    if (::listen(fd, 64) != 0) {
+        ::close(fd);
+        ::unlink(path.c_str());
+        return -1;
+    }
+    return fd;
+}
+
+volatile std::sig_atomic_t stopRequested = 0;
+
+extern "C" void requestStop(int) { stopRequested = 1; }
+
+// One connection being served. Its thread shuts the socket down when
+// it is done; the accept loop then joins it and only then closes the
+// descriptor, so the number is never reused while the thread or the
+// shutdown below might still use it.
+struct ClientThread {
+    int fd = -1;
+    std::atomic<bool> done{ false };
+    std::thread thread;
+};
+
+// Serves until SIGINT or SIGTERM. Then it stops accepting and shuts
+// down reading on every connection: requests already read are still
+// answered. It joins the client threads before returning, so
+// `detector` and `pool` outlive every use.
+int serveSocket(const std::string& path, const Detector& detector,
+    ThreadPool& pool) {
+    int fd = listenUnix(path);
+    if (fd < 0) {
+        std::cerr << "Error: cannot listen on " << path
+            << " (path too long, in use, or not a socket)\n";
+        return 5;
+    }
+
+    // a client hanging up mid-reply must not kill the server
+    std::signal(SIGPIPE, SIG_IGN);
+    // no SA_RESTART, so a signal interrupts accept()
+    struct sigaction stop{};
+    stop.sa_handler = requestStop;
+    sigemptyset(&stop.sa_mask);
+    ::sigaction(SIGINT, &stop, nullptr);
+    ::sigaction(SIGTERM, &stop, nullptr);
+
+    std::cerr << "Listening on " << path << " with " << pool.size()
+        << " workers\n";
+
+    std::list<ClientThread> clients;
+    auto reap = [&clients] {
+        for (auto it = clients.begin(); it != clients.end();) {
+            if (!it->done.load()) {
+                ++it;
+                continue;
+            }
+            it->thread.join();
+            ::close(it->fd);
+            it = clients.erase(it);
+        }
+    };
+
+    while (!stopRequested) {
+        int client = ::accept(fd, nullptr, nullptr);
+        reap();
+        if (client < 0)
+            continue;
+        ClientThread& c = clients.emplace_back();
+        c.fd = client;
+        c.thread = std::thread([&c, &detector, &pool] {
+            {
+                SocketChannel ch(c.fd, false);
+                serveChannel(ch, detector, pool);
+            }
+            // the peer sees the end now; the descriptor itself is
+            // closed by the accept loop
+            ::shutdown(c.fd, SHUT_RDWR);
+            c.done.store(true);
+        });
+    }
+
+    ::close(fd);
+    ::unlink(path.c_str());
+    for (auto& c : clients)
+        ::shutdown(c.fd, SHUT_RD);
+    for (auto& c : clients) {
+        c.thread.join();
+        ::close(c.fd);
+    }
+    std::cerr << "Stopped\n";
+    return 0;
+}
+#endif
+
+} // namespace
+
+int runServer(const ServerOptions& opt) {
+    int workers = opt.workers > 0
+        ? opt.workers
+        : int(std::max(1u, std::thread::hardware_concurrency()));
+
+    Detector detector(opt.params);
+    ThreadPool pool{ size_t(workers), size_t(workers) * 4 };
+
+    // Requests already running keep the detector they started with.
+    // Reloads start from the startup params, not from the defaults.
+    std::unique_ptr<ParamsWatcher> watcher;
+    if (!opt.configPath.empty()) {
+        watcher = std::make_unique<ParamsWatcher>(opt.configPath,
+            opt.params,
+            [&detector](const CoinDetector::Params& p) { detector.setParams(p); });
+    }
+
+    if (opt.socketPath.empty()) {
+        StdioChannel ch;
+        serveChannel(ch, detector, pool);
+        return 0;
+    }
+
+#ifdef _WIN32
+    std::cerr << "Error: --socket is not supported on this platform; "
+        "use stdin/stdout mode\n";
+    return 5;
+#else
+    return serveSocket(opt.socketPath, detector, pool);
+#endif
+}
+
+int runClient(const std::string& socketPath,
+    const std::string& imagePath,
+    bool sendBytes) {
+#ifdef _WIN32
+    (void)socketPath; (void)imagePath; (void)sendBytes;
+    std::cerr << "Error: --connect is not supported on this platform\n";
+    return 5;
+#else
+    std::string request;
+    if (sendBytes) {
+        std::ifstream f(imagePath, std::ios::binary);
+        if (!f) {
+            std::cerr << "Error: failed to read image: " << imagePath << "\n";
+            return 3;
+        }
+        std::string bytes((std::istreambuf_iterator<char>(f)),
+            std::istreambuf_iterator<char>());
+        request = "DATA " + std::to_string(bytes.size()) + "\n" + bytes;
+    }
+    else {
+        // the server may run in another working directory
+        request = "PATH " + std::filesystem::absolute(imagePath).string() + "\n";
+    }
+    request += "QUIT\n";
+
+    // a server that dies mid-request is an error, not a signal
+    std::signal(SIGPIPE, SIG_IGN);
+    int fd = connectUnix(socketPath);
+    if (fd < 0) {
+        std::cerr << "Error: cannot connect to " << socketPath << "\n";
+        return 5;
+    }
+    SocketChannel ch(fd);
+
+    auto t0 = Clock::now();
+    std::string line;
+    if (!ch.write(request) || !ch.readLine(line)) {
+        std::cerr << "Error: no reply from server\n";
+        return 5;
+    }
+    if (line.rfind("OK ", 0) != 0) {
+        std::cerr << line << "\n";
+        return 6;
+    }
+
+    size_t count = 0;
+    double serverMs = 0.0;
+    std::istringstream(line.substr(3)) >> count >> serverMs;
+    for (size_t i = 0; i < count && ch.readLine(line); ++i)
+        std::cout << line << "\n";
+
+    double totalMs = std::chrono::duration<double, std::milli>(
+        Clock::now() - t0).count();
+    std::cerr << "server_ms=" << serverMs << " roundtrip_ms=" << totalMs << "\n";
+    return 0;
+#endif
+}
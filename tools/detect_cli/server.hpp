@@ -0,0 +1,22 @@
+#pragma once
+#include "coin_detector.hpp"
+#include <string>
+
+// Long-running detection server. The Detector is built once and shared
+// by a pool of worker threads; see server.cpp for the wire protocol.
+struct ServerOptions {
+    std::string socketPath;  // Unix domain socket; empty = stdin/stdout
+    int workers = 0;         // 0 = one per hardware thread
+    CoinDetector::Params params;
+    std::string configPath;  // reloaded on change; empty = no watching
+};
+
+// With a socket it serves until SIGINT or SIGTERM, answers the requests
+// already read, removes the socket file and returns 0.
+int runServer(const ServerOptions& opt);
+
+// Sends one image to a server listening on `socketPath` and prints the
+// reply as "cx cy r score" lines; latency goes to stderr.
+int runClient(const std::string& socketPath,
+    const std::string& imagePath,
+    bool sendBytes);
@@ -0,0 +1,54 @@
+#include "AutoSaver.hpp"
+
+AutoSaver::AutoSaver(Callback onDone)
+    : onDone_(std::move(onDone)) {
+    thread_ = std::thread([this] { Run(); });
+}
+
+AutoSaver::~AutoSaver() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    wake_.notify_all();
+    thread_.join();
+}
+
+void AutoSaver::Save(const std::string& path, std::vector<Circle> circles) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        pending_[path] = std::move(circles);
+    }
+    wake_.notify_one();
+}
+
+std::optional<std::vector<Circle>> AutoSaver::Pending(const std::string& path) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (auto it = pending_.find(path); it != pending_.end())
+        return it->second;
+    if (auto it = writing_.find(path); it != writing_.end())
+        return it->second;
+    return std::nullopt;
+}
+
+void AutoSaver::Run() {
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            wake_.wait(lock, [this] { return stop_ || !pending_.empty(); });
+            // on stop, still write what is pending
+            if (pending_.empty())
+                return;
+            writing_.swap(pending_);
+        }
+
+        for (const auto& [path, circles] : writing_) {
+            bool ok = SaveLabels(path, circles);
+            if (onDone_)
+                onDone_(path, ok);
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        writing_.clear();
+    }
+}
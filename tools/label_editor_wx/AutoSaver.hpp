@@ -0,0 +1,40 @@
+#pragma once
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+#include "LabelIO.hpp"
+
+// Writes label files on a background thread so switching images never
+// waits for the disk. Saves to the same path are coalesced: only the
+// newest circles queued for a path are written. The destructor writes
+// whatever is still pending.
+class AutoSaver {
+public:
+    // Called on the saver thread; forward to the GUI with CallAfter.
+    using Callback = std::function<void(const std::string& path, bool ok)>;
+
+    explicit AutoSaver(Callback onDone);
+    ~AutoSaver();
+
+    void Save(const std::string& path, std::vector<Circle> circles);
+
+    // Circles queued for `path` and not written yet. Reading the file
+    // while a save is pending would return the old labels.
+    std::optional<std::vector<Circle>> Pending(const std::string& path) const;
+
+private:
+    void Run();
+
+    Callback onDone_;
+    mutable std::mutex mutex_;
+    std::condition_variable wake_;
+    std::map<std::string, std::vector<Circle>> pending_;
+    std::map<std::string, std::vector<Circle>> writing_;
+    bool stop_ = false;
+    std::thread thread_;
+};
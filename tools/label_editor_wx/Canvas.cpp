@@ -1,16 +1,26 @@
 #include "Canvas.hpp"
-#include <opencv2/imgproc.hpp>
-#include <filesystem>
+#include "MainFrame.hpp"
+#include <algorithm>
 #include <cmath>
+#include <memory>
 
-namespace fs = std::filesystem;
+namespace {
+constexpr double kMinZoom = 1.0 / 64.0;
+constexpr double kMaxZoom = 32.0;
+constexpr double kWheelStep = 1.25;
+constexpr int kCirclePad = 6;   //    +  
+}
 
 wxBEGIN_EVENT_TABLE(Canvas, wxPanel)
 EVT_PAINT(Canvas::OnPaint)
 EVT_LEFT_DOWN(Canvas::OnLeftDown)
 EVT_LEFT_UP(Canvas::OnLeftUp)
+EVT_MIDDLE_DOWN(Canvas::OnMiddleDown)
+EVT_MIDDLE_UP(Canvas::OnLeftUp)
 EVT_MOTION(Canvas::OnMotion)
 EVT_RIGHT_DOWN(Canvas::OnRightDown)
+EVT_MOUSEWHEEL(Canvas::OnMouseWheel)
+EVT_MOUSE_CAPTURE_LOST(Canvas::OnCaptureLost)
 EVT_KEY_DOWN(Canvas::OnKeyDown)
 wxEND_EVENT_TABLE()
 
@@ -21,100 +31,179 @@ Canvas::Canvas(wxWindow* parent)
     SetFocus(); //    (Del, S  ..)
 }
 
-cv::Mat Canvas::GetImageMat() const {
-    if (!hasImage_)
-        return cv::Mat();
-
-    wxImage img = image_;
-
-    cv::Mat mat(
-        img.GetHeight(),
-        img.GetWidth(),
-        CV_8UC3,
-        img.GetData()
-    );
-
-    cv::Mat matBGR;
-    cv::cvtColor(mat, matBGR, cv::COLOR_RGB2BGR);
-
-    return matBGR.clone();
-}
-
 const std::vector<Circle>& Canvas::GetGroundTruthCircles() const {
     return circles_;
 }
 
-bool Canvas::LoadImage(const std::string& imgPath) {
-    imagePath_ = imgPath;
-    if (!image_.LoadFile(imgPath)) {
-        hasImage_ = false;
-        return false;
-    }
-    
+void Canvas::SetImage(std::shared_ptr<const LoadedImage> img) {
+    image_ = std::move(img);
+    hasImage_ = image_ != nullptr;
+
     //     
     detected_.clear();
     showDetections_ = false;
+    modified_ = false;
 
-    bitmap_ = wxBitmap(image_);
-    hasImage_ = true;
+    if (!hasImage_) {
+        imagePath_.clear();
+        labelsPath_.clear();
+        gray_.release();
+        circles_.clear();
+        tiles_.Reset(nullptr, 0, 0);
+        active_ = -1;
+        Refresh();
+        return;
+    }
 
-    //   
-    SetMinSize(wxSize(image_.GetWidth(), image_.GetHeight()));
-    SetSize(wxSize(image_.GetWidth(), image_.GetHeight()));
-    Refresh();
+    //    ( ,  ):  
+    imagePath_ = image_->path;
+    labelsPath_ = image_->labelsPath;
+    gray_ = image_->gray;
+    tiles_.Reset(image_->pyramid);
+
+    circles_ = image_->labels;
+    indexDirty_ = true;
+    active_ = circles_.empty() ? -1 : 0;
+
+    ZoomToFit();
+}
+
+bool Canvas::SaveLabels() {
+    if (labelsPath_.empty()) return false;
+    if (!::SaveLabels(labelsPath_, circles_)) return false;
+    modified_ = false;
     return true;
 }
 
-bool Canvas::LoadOrCreateLabelsForImage() {
-    if (!hasImage_) return false;
-    fs::path p(imagePath_);
-    fs::path lbl = p.parent_path() / (p.stem().string() + "_labels.txt");
-    labelsPath_ = lbl.string();
+// =====    =====
 
-    circles_ = LoadLabels(labelsPath_);
-    active_ = circles_.empty() ? -1 : 0;
+wxPoint2DDouble Canvas::ScreenToImage(const wxPoint& p) const {
+    return wxPoint2DDouble(origin_.m_x + p.x / zoom_, origin_.m_y + p.y / zoom_);
+}
+
+wxPoint2DDouble Canvas::ImageToScreen(double x, double y) const {
+    return wxPoint2DDouble((x - origin_.m_x) * zoom_, (y - origin_.m_y) * zoom_);
+}
+
+void Canvas::ZoomToFit() {
+    if (!hasImage_) return;
+    const wxSize cs = GetClientSize();
+    const double w = image_->Size().width, h = image_->Size().height;
+
+    zoom_ = (cs.x > 0 && cs.y > 0) ? std::min(cs.x / w, cs.y / h) : 1.0;
+    zoom_ = std::clamp(zoom_, kMinZoom, kMaxZoom);
+    //   
+    origin_ = wxPoint2DDouble(w / 2 - cs.x / (2 * zoom_), h / 2 - cs.y / (2 * zoom_));
     Refresh();
-    return true;
 }
 
-bool Canvas::SaveLabels() {
-    if (labelsPath_.empty()) return false;
-    return ::SaveLabels(labelsPath_, circles_);
+void Canvas::SetZoom(double zoom, const wxPoint& anchor) {
+    //       
+    const wxPoint2DDouble fixed = ScreenToImage(anchor);
+    zoom_ = std::clamp(zoom, kMinZoom, kMaxZoom);
+    origin_ = wxPoint2DDouble(fixed.m_x - anchor.x / zoom_, fixed.m_y - anchor.y / zoom_);
+    Refresh();
 }
 
+wxRect Canvas::CircleScreenRect(const Circle& c) const {
+    const wxPoint2DDouble s = ImageToScreen(c.cx, c.cy);
+    const double r = c.r * zoom_ + kCirclePad;
+    const int x0 = (int)std::floor(s.m_x - r), y0 = (int)std::floor(s.m_y - r);
+    const int x1 = (int)std::ceil(s.m_x + r), y1 = (int)std::ceil(s.m_y + r);
+    return wxRect(x0, y0, x1 - x0 + 1, y1 - y0 + 1);
+}
+
+void Canvas::RefreshCircle(int idx) {
+    if (idx >= 0 && idx < (int)circles_.size())
+        RefreshRect(CircleScreenRect(circles_[idx]), false);
+}
+
+// =====     =====
+
 double Canvas::Dist(double x1, double y1, double x2, double y2) const {
     const double dx = x1 - x2;
     const double dy = y1 - y2;
     return std::sqrt(dx * dx + dy * dy);
 }
 
-bool Canvas::HitCenter(const Circle& c, const wxPoint& p) const {
-    return Dist(c.cx, c.cy, p.x, p.y) <= hitTolPx_;
+bool Canvas::HitCenter(const Circle& c, const wxPoint2DDouble& p) const {
+    return Dist(c.cx, c.cy, p.m_x, p.m_y) <= HitTolerance();
 }
 
-int Canvas::HitTest(const wxPoint& p) const {
+int Canvas::HitTest(const wxPoint& sp) const {
+    if (indexDirty_) {
+        index_.Build(circles_);
+        indexDirty_ = false;
+    }
+    const wxPoint2DDouble p = ScreenToImage(sp);
+    const double tol = HitTolerance();
+    //   ,    ( )
+    index_.Query(p.m_x, p.m_y, tol, hits_);
+
     // 1)  
-    for (int i = (int)circles_.size() - 1; i >= 0; --i) {
+    for (int i : hits_) {
         if (HitCenter(circles_[i], p)) return i;
     }
     // 2)   
-    for (int i = (int)circles_.size() - 1; i >= 0; --i) {
-        double d = Dist(circles_[i].cx, circles_[i].cy, p.x, p.y);
-        if (std::abs(d - circles_[i].r) <= hitTolPx_) return i;
+    for (int i : hits_) {
+        double d = Dist(circles_[i].cx, circles_[i].cy, p.m_x, p.m_y);
+        if (std::abs(d - circles_[i].r) <= tol) return i;
     }
     return -1;
 }
 
+// =====  =====
+
+void Canvas::DrawTiles(wxGraphicsContext& gc, const wxRect& dirty) {
+    const int level = tiles_.LevelFor(zoom_);
+    const cv::Size size = tiles_.LevelSize(level);
+    const double tileImg = TileCache::kTileSize * double(1 << level); //    
+    const int tilesX = (size.width + TileCache::kTileSize - 1) / TileCache::kTileSize;
+    const int tilesY = (size.height + TileCache::kTileSize - 1) / TileCache::kTileSize;
+
+    const wxPoint2DDouble a = ScreenToImage(dirty.GetTopLeft());
+    const wxPoint2DDouble b = ScreenToImage(dirty.GetBottomRight() + wxPoint(1, 1));
+    const int tx0 = std::max(0, (int)std::floor(a.m_x / tileImg));
+    const int ty0 = std::max(0, (int)std::floor(a.m_y / tileImg));
+    const int tx1 = std::min(tilesX - 1, (int)std::floor(b.m_x / tileImg));
+    const int ty1 = std::min(tilesY - 1, (int)std::floor(b.m_y / tileImg));
+
+    //      ,  
+    gc.SetInterpolationQuality(zoom_ >= 2.0 ? wxINTERPOLATION_NONE : wxINTERPOLATION_GOOD);
+
+    const double imgW = image_->Size().width, imgH = image_->Size().height;
+    for (int ty = ty0; ty <= ty1; ++ty) {
+        for (int tx = tx0; tx <= tx1; ++tx) {
+            const wxBitmap& bmp = tiles_.Get(level, tx, ty);
+            //       ,    
+            const wxPoint2DDouble p0 = ImageToScreen(tx * tileImg, ty * tileImg);
+            const wxPoint2DDouble p1 = ImageToScreen(
+                std::min(imgW, (tx + 1) * tileImg), std::min(imgH, (ty + 1) * tileImg));
+            const double x0 = std::floor(p0.m_x), y0 = std::floor(p0.m_y);
+            gc.DrawBitmap(bmp, x0, y0, std::ceil(p1.m_x) - x0, std::ceil(p1.m_y) - y0);
+        }
+    }
+}
+
 void Canvas::OnPaint(wxPaintEvent&) {
     wxAutoBufferedPaintDC dc(this);
-    dc.Clear();
+
+    //   ,   
+    const wxRect dirty = GetUpdateRegion().GetBox();
+    dc.SetPen(*wxTRANSPARENT_PEN);
+    dc.SetBrush(wxBrush(GetBackgroundColour()));
+    dc.DrawRectangle(dirty);
 
     if (!hasImage_) {
         dc.DrawText("Open an image to start", 10, 10);
         return;
     }
 
-    dc.DrawBitmap(bitmap_, 0, 0, false);
+    {
+        std::unique_ptr<wxGraphicsContext> gc(wxGraphicsContext::Create(dc));
+        if (gc)
+            DrawTiles(*gc, dirty);
+    }
 
     //  
     wxPen penRed(*wxRED, 2);
@@ -123,15 +212,18 @@ void Canvas::OnPaint(wxPaintEvent&) {
     //  
     for (size_t i = 0; i < circles_.size(); ++i) {
         const auto& c = circles_[i];
+        if (!CircleScreenRect(c).Intersects(dirty)) continue;
+
+        const wxPoint2DDouble s = ImageToScreen(c.cx, c.cy);
+        const wxPoint center((int)std::round(s.m_x), (int)std::round(s.m_y));
         dc.SetPen((int)i == active_ ? penGreen : penRed);
         dc.SetBrush(*wxTRANSPARENT_BRUSH);
-        dc.DrawCircle(wxPoint((int)std::round(c.cx), (int)std::round(c.cy)),
-            (int)std::round(c.r));
+        dc.DrawCircle(center, (int)std::round(c.r * zoom_));
 
         // 
         dc.SetPen(*wxTRANSPARENT_PEN);
         dc.SetBrush((int)i == active_ ? *wxGREEN_BRUSH : *wxBLUE_BRUSH);
-        dc.DrawCircle(wxPoint((int)std::round(c.cx), (int)std::round(c.cy)), 3);
+        dc.DrawCircle(center, 3);
     }
 
     // =====  (  ) =====
@@ -146,92 +238,170 @@ void Canvas::OnPaint(wxPaintEvent&) {
         dc.SetBrush(*wxTRANSPARENT_BRUSH);
 
         for (const auto& d : detected_) {
+            if (!CircleScreenRect(d).Intersects(dirty)) continue;
+
             //   
+            const wxPoint2DDouble s = ImageToScreen(d.cx, d.cy);
             dc.DrawCircle(
                 wxPoint(
-                    (int)std::round(d.cx),
-                    (int)std::round(d.cy)
+                    (int)std::round(s.m_x),
+                    (int)std::round(s.m_y)
                 ),
-                (int)std::round(d.r)
+                (int)std::round(d.r * zoom_)
             );
 
             // confidence ( ,   )
             /*dc.DrawText(
                 wxString::Format("score=%.2f", d.confidence),
-                (int)std::round(d.cx + d.r + 2),
-                (int)std::round(d.cy)
+                (int)std::round(s.m_x + d.r * zoom_ + 2),
+                (int)std::round(s.m_y)
             );*/
         }
     }
 }
 
+// =====    =====
+
+void Canvas::StartPan(const wxPoint& p) {
+    dragMode_ = DragMode::Pan;
+    lastMouse_ = p;
+    if (!HasCapture()) CaptureMouse();
+}
+
+void Canvas::EndDrag() {
+    if (HasCapture()) ReleaseMouse();
+    dragMode_ = DragMode::None;
+}
+
 void Canvas::OnLeftDown(wxMouseEvent& evt) {
     if (!hasImage_) return;
     SetFocus();
 
     wxPoint p = evt.GetPosition();
     int idx = HitTest(p);
+
+    //       
+    RefreshCircle(active_);
     active_ = idx;
+    RefreshCircle(active_);
 
     if (active_ >= 0) {
         const auto& c = circles_[active_];
-        if (HitCenter(c, p)) dragMode_ = DragMode::MoveCenter;
+        if (HitCenter(c, ScreenToImage(p))) dragMode_ = DragMode::MoveCenter;
         else dragMode_ = DragMode::ResizeRadius;
         lastMouse_ = p;
         CaptureMouse();
     }
+    else {
+        //  :  
+        StartPan(p);
+    }
+}
 
-    Refresh();
+void Canvas::OnMiddleDown(wxMouseEvent& evt) {
+    if (!hasImage_) return;
+    SetFocus();
+    StartPan(evt.GetPosition());
 }
 
 void Canvas::OnLeftUp(wxMouseEvent&) {
-    if (HasCapture()) ReleaseMouse();
+    EndDrag();
+}
+
+void Canvas::OnCaptureLost(wxMouseCaptureLostEvent&) {
     dragMode_ = DragMode::None;
 }
 
 void Canvas::OnMotion(wxMouseEvent& evt) {
     if (!hasImage_) return;
-    if (active_ < 0) return;
-    if (!evt.Dragging() || !evt.LeftIsDown()) return;
+    if (!evt.Dragging()) return;
 
     wxPoint p = evt.GetPosition();
+
+    if (dragMode_ == DragMode::Pan) {
+        const wxPoint d = p - lastMouse_;
+        lastMouse_ = p;
+        origin_.m_x -= d.x / zoom_;
+        origin_.m_y -= d.y / zoom_;
+        //   ,    
+        ScrollWindow(d.x, d.y);
+        return;
+    }
+
+    if (active_ < 0) return;
+    if (!evt.LeftIsDown()) return;
+
     auto& c = circles_[active_];
+    const wxRect before = CircleScreenRect(c);
+    const wxPoint2DDouble ip = ScreenToImage(p);
 
     if (dragMode_ == DragMode::MoveCenter) {
-        c.cx = p.x;
-        c.cy = p.y;
+        c.cx = ip.m_x;
+        c.cy = ip.m_y;
     }
     else if (dragMode_ == DragMode::ResizeRadius) {
-        c.r = std::max(1.0, Dist(c.cx, c.cy, p.x, p.y));
+        c.r = std::max(1.0, Dist(c.cx, c.cy, ip.m_x, ip.m_y));
     }
-    Refresh();
+    indexDirty_ = true;
+    modified_ = true;
+
+    //       
+    RefreshRect(before.Union(CircleScreenRect(c)), false);
+}
+
+void Canvas::OnMouseWheel(wxMouseEvent& evt) {
+    if (!hasImage_) return;
+    const int steps = evt.GetWheelRotation() / std::max(1, evt.GetWheelDelta());
+    if (steps == 0) return;
+    SetZoom(zoom_ * std::pow(kWheelStep, steps), evt.GetPosition());
 }
 
 void Canvas::OnRightDown(wxMouseEvent& evt) {
     if (!hasImage_) return;
     SetFocus();
 
-    wxPoint p = evt.GetPosition();
+    const wxPoint2DDouble p = ScreenToImage(evt.GetPosition());
     //    (  )
-    circles_.push_back(Circle{ (double)p.x, (double)p.y, 40.0 });
+    circles_.push_back(Circle{ p.m_x, p.m_y, 40.0 });
+    indexDirty_ = true;
+    modified_ = true;
+
+    RefreshCircle(active_);
     active_ = (int)circles_.size() - 1;
-    Refresh();
+    RefreshCircle(active_);
 }
 
 void Canvas::OnKeyDown(wxKeyEvent& evt) {
     if (evt.GetKeyCode() == WXK_DELETE) {
         if (active_ >= 0 && active_ < (int)circles_.size()) {
+            RefreshCircle(active_);
             circles_.erase(circles_.begin() + active_);
+            indexDirty_ = true;
+            modified_ = true;
             if (circles_.empty()) active_ = -1;
             else active_ = std::min(active_, (int)circles_.size() - 1);
-            Refresh();
+            RefreshCircle(active_);
         }
         return;
     }
 
-    //  : Ctrl+S   S
-    if (evt.GetKeyCode() == 'S' && (evt.ControlDown() || !evt.ControlDown())) {
-        SaveLabels();
+    // F -   , 1 -  100%
+    if (evt.GetKeyCode() == 'F') {
+        ZoomToFit();
+        return;
+    }
+    if (evt.GetKeyCode() == '1') {
+        const wxSize cs = GetClientSize();
+        SetZoom(1.0, wxPoint(cs.x / 2, cs.y / 2));
+        return;
+    }
+
+    // Ctrl+S,     :   
+    // MainFrame::OnSave, ..  AutoSaver,   
+    //        
+    if (evt.GetKeyCode() == 'S' && evt.ControlDown()) {
+        wxCommandEvent save(wxEVT_MENU, ID_Save);
+        wxPostEvent(wxGetTopLevelParent(this), save);
         return;
     }
 
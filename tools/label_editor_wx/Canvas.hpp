@@ -1,43 +1,76 @@
 #pragma once
 #include <wx/wx.h>
 #include <wx/dcbuffer.h>
+#include <wx/graphics.h>
 #include <vector>
 #include <string>
 #include "LabelIO.hpp"
 #include <opencv2/core.hpp>
 #include "Detector.hpp"
+#include "CircleIndex.hpp"
+#include "TileCache.hpp"
+#include "Prefetcher.hpp"
+#include <memory>
 
 class Canvas : public wxPanel {
 public:
     explicit Canvas(wxWindow* parent);
 
-    bool LoadImage(const std::string& imgPath);
-    bool LoadOrCreateLabelsForImage();
+    // Shows an image loaded by LoadImageFile or the Prefetcher, with its
+    // labels. nullptr clears the canvas.
+    void SetImage(std::shared_ptr<const LoadedImage> img);
     bool SaveLabels();
 
+    // Labels were edited since SetImage or the last save.
+    bool IsModified() const { return modified_; }
+    void SetModified(bool modified) { modified_ = modified; }
+
     void SetLabelsPath(const std::string& path) { labelsPath_ = path; }
     const std::string& GetImagePath() const { return imagePath_; }
     const std::string& GetLabelsPath() const { return labelsPath_; }
 
-    cv::Mat GetImageMat() const;
+    // Grayscale copy of the image, converted once when it is loaded and
+    // reused by every detection run.
+    const cv::Mat& GetGrayMat() const { return gray_; }
     const std::vector<Circle>& GetGroundTruthCircles() const;
     void SetDetectedCircles(const std::vector<Circle>& circles);
 
+    // Zoom is in screen pixels per image pixel. The mouse wheel zooms
+    // around the cursor; dragging empty space (or with the middle
+    // button) pans; F fits the image to the window, 1 shows it at 100%.
+    void ZoomToFit();
+    void SetZoom(double zoom, const wxPoint& anchor);
+
 private:
     void OnPaint(wxPaintEvent& evt);
     void OnLeftDown(wxMouseEvent& evt);
     void OnLeftUp(wxMouseEvent& evt);
+    void OnMiddleDown(wxMouseEvent& evt);
     void OnMotion(wxMouseEvent& evt);
     void OnRightDown(wxMouseEvent& evt);
+    void OnMouseWheel(wxMouseEvent& evt);
+    void OnCaptureLost(wxMouseCaptureLostEvent& evt);
     void OnKeyDown(wxKeyEvent& evt);
 
+    void DrawTiles(wxGraphicsContext& gc, const wxRect& dirty);
+    void StartPan(const wxPoint& p);
+    void EndDrag();
+
+    wxPoint2DDouble ScreenToImage(const wxPoint& p) const;
+    wxPoint2DDouble ImageToScreen(double x, double y) const;
+    // Screen area covered by a circle, its outline pen and center mark.
+    wxRect CircleScreenRect(const Circle& c) const;
+    void RefreshCircle(int idx);
+
     int HitTest(const wxPoint& p) const;
-    bool HitCenter(const Circle& c, const wxPoint& p) const;
+    bool HitCenter(const Circle& c, const wxPoint2DDouble& p) const;
     double Dist(double x1, double y1, double x2, double y2) const;
+    double HitTolerance() const { return hitTolPx_ / zoom_; }
 
 private:
-    wxBitmap bitmap_;
-    wxImage image_;
+    std::shared_ptr<const LoadedImage> image_;   // keeps the tile pyramid alive
+    cv::Mat gray_;
+    TileCache tiles_;
     bool hasImage_ = false;
 
     std::string imagePath_;
@@ -45,12 +78,21 @@ private:
     std::vector<Circle> circles_;
     std::vector<Circle> detected_;
     bool showDetections_ = true;
+    bool modified_ = false;
+
+    // hit-test grid over circles_, rebuilt lazily after edits
+    mutable CircleIndex index_;
+    mutable bool indexDirty_ = true;
+    mutable std::vector<int> hits_;
 
     int active_ = -1;
-    enum class DragMode { None, MoveCenter, ResizeRadius };
+    enum class DragMode { None, MoveCenter, ResizeRadius, Pan };
     DragMode dragMode_ = DragMode::None;
 
+    double zoom_ = 1.0;
+    wxPoint2DDouble origin_;   // image point at the window's top-left corner
+
     wxPoint lastMouse_;
-    double hitTolPx_ = 10.0;   //    /
+    double hitTolPx_ = 10.0;   //    / (  )
     wxDECLARE_EVENT_TABLE();
 };
\ No newline at end of file
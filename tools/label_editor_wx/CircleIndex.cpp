@@ -0,0 +1,70 @@
+#include "CircleIndex.hpp"
+#include <algorithm>
+#include <cmath>
+#include <functional>
+
+int CircleIndex::CellX(double x) const {
+    return std::clamp(int(std::floor((x - minX_) / cell_)), 0, cols_ - 1);
+}
+
+int CircleIndex::CellY(double y) const {
+    return std::clamp(int(std::floor((y - minY_) / cell_)), 0, rows_ - 1);
+}
+
+void CircleIndex::Build(const std::vector<Circle>& circles) {
+    start_.clear();
+    items_.clear();
+    cols_ = rows_ = 0;
+    if (circles.empty())
+        return;
+
+    double maxX = circles[0].cx, maxY = circles[0].cy;
+    minX_ = maxX;
+    minY_ = maxY;
+    for (const auto& c : circles) {
+        minX_ = std::min(minX_, c.cx - c.r);
+        minY_ = std::min(minY_, c.cy - c.r);
+        maxX = std::max(maxX, c.cx + c.r);
+        maxY = std::max(maxY, c.cy + c.r);
+    }
+    cols_ = int((maxX - minX_) / cell_) + 1;
+    rows_ = int((maxY - minY_) / cell_) + 1;
+
+    // two passes: count per cell, then fill
+    start_.assign(size_t(cols_) * rows_ + 1, 0);
+    auto forCells = [&](const Circle& c, const std::function<void(size_t)>& fn) {
+        const int x0 = CellX(c.cx - c.r), x1 = CellX(c.cx + c.r);
+        const int y0 = CellY(c.cy - c.r), y1 = CellY(c.cy + c.r);
+        for (int y = y0; y <= y1; ++y)
+            for (int x = x0; x <= x1; ++x)
+                fn(size_t(y) * cols_ + x);
+    };
+    for (const auto& c : circles)
+        forCells(c, [&](size_t cell) { start_[cell + 1]++; });
+    for (size_t i = 1; i < start_.size(); ++i)
+        start_[i] += start_[i - 1];
+
+    items_.resize(start_.back());
+    std::vector<int> fill(start_.begin(), start_.end() - 1);
+    for (int i = 0; i < int(circles.size()); ++i)
+        forCells(circles[i], [&](size_t cell) { items_[fill[cell]++] = i; });
+}
+
+void CircleIndex::Query(double x, double y, double tol,
+    std::vector<int>& out) const {
+    out.clear();
+    if (cols_ == 0)
+        return;
+
+    const int x0 = CellX(x - tol), x1 = CellX(x + tol);
+    const int y0 = CellY(y - tol), y1 = CellY(y + tol);
+    for (int cy = y0; cy <= y1; ++cy) {
+        for (int cx = x0; cx <= x1; ++cx) {
+            const size_t cell = size_t(cy) * cols_ + cx;
+            out.insert(out.end(), items_.begin() + start_[cell],
+                items_.begin() + start_[cell + 1]);
+        }
+    }
+    std::sort(out.begin(), out.end(), std::greater<int>());
+    out.erase(std::unique(out.begin(), out.end()), out.end());
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include <vector>
+#include "LabelIO.hpp"
+
+// Uniform grid over image coordinates for hit testing many circles.
+// Each circle is listed in every cell its bounding box touches, so a
+// query only looks at the circles near the point instead of all of them.
+class CircleIndex {
+public:
+    explicit CircleIndex(double cellSize = 64.0) : cell_(cellSize) {}
+
+    void Build(const std::vector<Circle>& circles);
+
+    // Candidate circles near (x, y), as indices in descending order
+    // without duplicates: every circle whose bounding box grown by `tol`
+    // contains the point is included (callers still test the distance).
+    void Query(double x, double y, double tol, std::vector<int>& out) const;
+
+private:
+    int CellX(double x) const;
+    int CellY(double y) const;
+
+    double cell_;
+    double minX_ = 0.0, minY_ = 0.0;
+    int cols_ = 0, rows_ = 0;
+    std::vector<int> start_;   // CSR layout: cell -> [start_[c], start_[c+1])
+    std::vector<int> items_;
+};
@@ -0,0 +1,58 @@
+#include "DetectionWorker.hpp"
+#include <chrono>
+
+DetectionWorker::DetectionWorker(Callback onDone)
+    : onDone_(std::move(onDone)) {
+    thread_ = std::thread([this] { Run(); });
+}
+
+DetectionWorker::~DetectionWorker() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+        pending_.reset();
+    }
+    wake_.notify_all();
+    thread_.join();
+}
+
+void DetectionWorker::Request(const cv::Mat& gray,
+    const CoinDetector::Params& params, uint64_t generation) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        pending_ = Job{ gray, params, generation };
+    }
+    wake_.notify_one();
+}
+
+void DetectionWorker::Run() {
+    for (;;) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            wake_.wait(lock, [this] { return stop_ || pending_.has_value(); });
+            if (stop_)
+                return;
+            job = std::move(*pending_);
+            pending_.reset();
+        }
+
+        auto t0 = std::chrono::steady_clock::now();
+        Result r;
+        r.generation = job.generation;
+        // a throwing run() would end the thread and, through std::thread,
+        // the whole editor; report it instead
+        try {
+            r.detections = Detector(job.params).run(job.gray);
+        }
+        catch (const std::exception& e) {
+            r.error = e.what();
+        }
+        catch (...) {
+            r.error = "unknown error";
+        }
+        r.ms = std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - t0).count();
+        onDone_(std::move(r));
+    }
+}
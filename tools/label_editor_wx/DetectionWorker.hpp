@@ -0,0 +1,53 @@
+#pragma once
+#include <opencv2/core.hpp>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Detector.hpp"
+
+// Runs detections on a background thread, newest request first: a
+// request that has not started yet is replaced by the next one, so
+// dragging a slider computes only the latest position. A detection that
+// is already running finishes; callers drop its result by comparing
+// generations.
+class DetectionWorker {
+public:
+    struct Result {
+        uint64_t generation = 0;
+        std::vector<Detection> detections;
+        double ms = 0.0;
+        std::string error;  // set (and detections empty) if run() threw
+    };
+
+    // Called on the worker thread; forward to the GUI with CallAfter.
+    using Callback = std::function<void(Result)>;
+
+    explicit DetectionWorker(Callback onDone);
+    ~DetectionWorker();
+
+    // `gray` is shared, not copied: the caller must not write into it
+    // afterwards (replace it with a new Mat instead).
+    void Request(const cv::Mat& gray, const CoinDetector::Params& params,
+        uint64_t generation);
+
+private:
+    struct Job {
+        cv::Mat gray;
+        CoinDetector::Params params;
+        uint64_t generation = 0;
+    };
+
+    void Run();
+
+    Callback onDone_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::optional<Job> pending_;
+    bool stop_ = false;
+    std::thread thread_;
+};
@@ -1,23 +1,30 @@
 #include "LabelIO.hpp"
-#include <fstream>
+#include "label_io.hpp"
+#include <filesystem>
 
 std::vector<Circle> LoadLabels(const std::string& path) {
     std::vector<Circle> out;
-    std::ifstream in(path);
-    if (!in.is_open()) return out;
+    std::vector<LabelCircle> labels;
+    if (!readLabels(path, labels)) return out;
 
-    double cx, cy, r;
-    while (in >> cx >> cy >> r) {
-        out.push_back(Circle{ cx, cy, r });
+    out.reserve(labels.size());
+    for (const auto& l : labels) {
+        out.push_back(Circle{ l.cx, l.cy, l.r, l.score });
     }
     return out;
 }
 
 bool SaveLabels(const std::string& path, const std::vector<Circle>& circles) {
-    std::ofstream out(path, std::ios::trunc);
-    if (!out.is_open()) return false;
+    // one writer per thread (GUI and autosave), reused between saves
+    thread_local LabelWriter out;
+    out.clear(LabelFormat::Txt);
     for (const auto& c : circles) {
-        out << c.cx << " " << c.cy << " " << c.r << "\n";
+        out.add(LabelCircle{ float(c.cx), float(c.cy), float(c.r) });
     }
-    return true;
-}
\ No newline at end of file
+    return out.writeTo(path);
+}
+
+std::string LabelsPathFor(const std::string& imagePath) {
+    std::filesystem::path p(imagePath);
+    return (p.parent_path() / (p.stem().string() + "_labels.txt")).string();
+}
@@ -10,4 +10,7 @@ struct Circle {
 };
 
 std::vector<Circle> LoadLabels(const std::string& path);
-bool SaveLabels(const std::string& path, const std::vector<Circle>& circles);
\ No newline at end of file
+bool SaveLabels(const std::string& path, const std::vector<Circle>& circles);
+
+// <dir>/<stem>_labels.txt next to the image.
+std::string LabelsPathFor(const std::string& imagePath);
@@ -1,27 +1,51 @@
 #include "MainFrame.hpp"
 #include <wx/filedlg.h>
+#include <wx/dirdlg.h>
+#include <algorithm>
+#include <filesystem>
 #include "Detector.hpp"
 #include "evaluator.hpp"
 
+namespace {
+// Images kept decoded around the current one. A 12 MP photo takes about
+// 60 MB with its tile pyramid and gray copy.
+constexpr size_t kPrefetchBudget = size_t(768) << 20;
+constexpr int kPrefetchAhead = 4;
+constexpr int kAutosaveMs = 20000;
+}
+
 wxBEGIN_EVENT_TABLE(MainFrame, wxFrame)
 EVT_MENU(ID_Open, MainFrame::OnOpen)
+EVT_MENU(ID_OpenFolder, MainFrame::OnOpenFolder)
+EVT_MENU(ID_Next, MainFrame::OnNext)
+EVT_MENU(ID_Prev, MainFrame::OnPrev)
 EVT_MENU(ID_Save, MainFrame::OnSave)
 EVT_MENU(ID_Detect, MainFrame::OnDetect)
+EVT_MENU(ID_Predetect, MainFrame::OnPredetect)
+EVT_TIMER(wxID_ANY, MainFrame::OnAutosaveTimer)
+EVT_CLOSE(MainFrame::OnClose)
 EVT_MENU(wxID_EXIT, MainFrame::OnExit)
 wxEND_EVENT_TABLE()
 
 MainFrame::MainFrame()
     : wxFrame(nullptr, wxID_ANY, "Label Editor (wxWidgets)",
-        wxDefaultPosition, wxSize(900, 700)) {
+        wxDefaultPosition, wxSize(900, 700)),
+    autosaveTimer_(this) {
 
     wxMenu* fileMenu = new wxMenu();
     fileMenu->Append(ID_Open, "&Open...\tCtrl+O");
+    fileMenu->Append(ID_OpenFolder, "Open &folder...\tCtrl+Shift+O");
+    fileMenu->AppendSeparator();
+    fileMenu->Append(ID_Next, "&Next image\tPgDn");
+    fileMenu->Append(ID_Prev, "&Previous image\tPgUp");
+    fileMenu->AppendSeparator();
     fileMenu->Append(ID_Save, "&Save labels\tCtrl+S");
     fileMenu->AppendSeparator();
     fileMenu->Append(wxID_EXIT, "E&xit");
 
     wxMenu* toolsMenu = new wxMenu();
     toolsMenu->Append(ID_Detect, "&Detect\tCtrl+D");
+    toolsMenu->AppendCheckItem(ID_Predetect, "&Pre-detect next images");
 
     wxMenuBar* menuBar = new wxMenuBar();
     menuBar->Append(fileMenu, "&File");
@@ -29,12 +53,40 @@ MainFrame::MainFrame()
     SetMenuBar(menuBar);
 
     CreateStatusBar();
-    SetStatusText("Open an image. Right click adds a circle. Drag to move/resize. Del deletes. S saves.");
+    SetStatusText("Open an image or a folder. PgDn/PgUp switch images. Right click adds a circle. Drag to move/resize. Del deletes. S saves.");
 
     canvas_ = new Canvas(this);
-    auto* sizer = new wxBoxSizer(wxVERTICAL);
+    params_ = new ParamPanel(this, CoinDetector::Params{});
+    auto* sizer = new wxBoxSizer(wxHORIZONTAL);
     sizer->Add(canvas_, 1, wxEXPAND);
+    sizer->Add(params_, 0, wxEXPAND);
     SetSizer(sizer);
+
+    // Detection runs off the GUI thread; results come back through
+    // CallAfter and are applied only if nothing newer was requested.
+    worker_ = std::make_unique<DetectionWorker>([this](DetectionWorker::Result r) {
+        CallAfter([this, r = std::move(r)] { OnDetectionDone(r); });
+    });
+
+    // Live preview: re-detect on every slider move once an image is open.
+    // The worker keeps only the newest request, so a drag computes the
+    // positions it has time for and always ends on the last one.
+    params_->SetOnChange([this] {
+        // detections made ahead with the old params are stale now
+        prefetch_->SetDetection(predetect_, params_->GetParams());
+        if (!canvas_->GetGrayMat().empty())
+            StartDetection();
+    });
+
+    // Folder mode: the images around the current one are decoded (and
+    // optionally detected) in the background, edits are saved by the
+    // AutoSaver thread, so next/prev never waits for the disk.
+    prefetch_ = std::make_unique<Prefetcher>(kPrefetchBudget, kPrefetchAhead);
+    saver_ = std::make_unique<AutoSaver>([this](const std::string& path, bool ok) {
+        if (!ok)
+            CallAfter([this, path] { SetStatusText(("Autosave failed: " + path).c_str()); });
+    });
+    autosaveTimer_.Start(kAutosaveMs);
 }
 
 void MainFrame::OnOpen(wxCommandEvent&) {
@@ -49,23 +101,121 @@ void MainFrame::OnOpen(wxCommandEvent&) {
 
     if (openFileDialog.ShowModal() == wxID_CANCEL) return;
 
+    // the rest of the folder becomes reachable with next/prev
     std::string imgPath = openFileDialog.GetPath().ToStdString();
-    if (!canvas_->LoadImage(imgPath)) {
+    OpenFolder(std::filesystem::path(imgPath).parent_path().string(), imgPath);
+}
+
+void MainFrame::OnOpenFolder(wxCommandEvent&) {
+    wxDirDialog dirDialog(this, "Open folder", "", wxDD_DEFAULT_STYLE | wxDD_DIR_MUST_EXIST);
+    if (dirDialog.ShowModal() == wxID_CANCEL) return;
+    OpenFolder(dirDialog.GetPath().ToStdString(), "");
+}
+
+void MainFrame::OpenFolder(const std::string& dir, const std::string& select) {
+    std::vector<std::string> files = ListImageFiles(dir);
+    if (files.empty()) {
+        wxMessageBox("No images in " + dir, "Error", wxICON_ERROR);
+        return;
+    }
+
+    size_t index = 0;
+    if (!select.empty()) {
+        // compare as paths: the dialog and the directory listing may
+        // spell the same file differently
+        const std::filesystem::path want(select);
+        auto it = std::find_if(files.begin(), files.end(), [&](const std::string& f) {
+            return std::filesystem::path(f).filename() == want.filename();
+        });
+        if (it != files.end())
+            index = size_t(it - files.begin());
+    }
+
+    LeaveImage();
+    canvas_->SetImage(nullptr);
+    prefetch_->SetFiles(std::move(files));
+    ShowImage(index);
+}
+
+void MainFrame::OnNext(wxCommandEvent&) {
+    if (current_ + 1 < prefetch_->Size())
+        ShowImage(current_ + 1);
+}
+
+void MainFrame::OnPrev(wxCommandEvent&) {
+    if (current_ > 0 && current_ < prefetch_->Size())
+        ShowImage(current_ - 1);
+}
+
+void MainFrame::ShowImage(size_t index) {
+    LeaveImage();
+
+    auto img = prefetch_->Get(index);
+    if (!img) {
         wxMessageBox("Failed to load image", "Error", wxICON_ERROR);
         return;
     }
+    // an autosave of this image may not have reached the disk yet
+    if (auto pending = saver_->Pending(img->labelsPath)) {
+        prefetch_->UpdateLabels(index, *pending);
+        img = prefetch_->Get(index);
+    }
 
-    canvas_->LoadOrCreateLabelsForImage();
-    SetStatusText(("Opened: " + imgPath).c_str());
+    // drop a detection still running on the previous image
+    generation_++;
+    current_ = index;
+    canvas_->SetImage(img);
+    prefetch_->Prefetch(index);
+
+    SetStatusText(wxString::Format("[%zu/%zu] Opened: %s",
+        index + 1, prefetch_->Size(), img->path.c_str()));
     Layout();
-    Fit(); //    ( ,  )
+
+    // detected ahead with the current params: show it right away
+    if (img->detections && img->detectionVersion == prefetch_->DetectionVersion()) {
+        DetectionWorker::Result r;
+        r.generation = generation_;
+        r.detections = *img->detections;
+        r.ms = img->detectionMs;
+        OnDetectionDone(r);
+    }
+    else if (predetect_) {
+        StartDetection();
+    }
+}
+
+void MainFrame::LeaveImage() {
+    if (canvas_->GetLabelsPath().empty()) return;
+    AutosaveCurrent();
+    // the cache must show these labels when we come back, saved or not
+    prefetch_->UpdateLabels(current_, canvas_->GetGroundTruthCircles());
+}
+
+void MainFrame::AutosaveCurrent() {
+    if (!canvas_->IsModified()) return;
+    saver_->Save(canvas_->GetLabelsPath(), canvas_->GetGroundTruthCircles());
+    canvas_->SetModified(false);
+}
+
+void MainFrame::OnAutosaveTimer(wxTimerEvent&) {
+    AutosaveCurrent();
+}
+
+void MainFrame::OnClose(wxCloseEvent& evt) {
+    autosaveTimer_.Stop();
+    AutosaveCurrent();
+    // writes whatever is still queued before the window goes away
+    saver_.reset();
+    evt.Skip();
 }
 
 void MainFrame::OnSave(wxCommandEvent&) {
-    if (!canvas_->SaveLabels()) {
-        wxMessageBox("Failed to save labels", "Error", wxICON_ERROR);
-        return;
-    }
+    if (canvas_->GetLabelsPath().empty()) return;
+    // through the saver as well, so an older autosave of the same file
+    // still in its queue cannot overwrite this one; failures are reported
+    // by its callback
+    saver_->Save(canvas_->GetLabelsPath(), canvas_->GetGroundTruthCircles());
+    canvas_->SetModified(false);
     SetStatusText(("Saved: " + canvas_->GetLabelsPath()).c_str());
 }
 
@@ -73,27 +223,54 @@ void MainFrame::OnExit(wxCommandEvent&) {
     Close(true);
 }
 
+void MainFrame::OnPredetect(wxCommandEvent& evt) {
+    predetect_ = evt.IsChecked();
+    prefetch_->SetDetection(predetect_, params_->GetParams());
+    if (predetect_ && current_ < prefetch_->Size())
+        prefetch_->Prefetch(current_);
+}
+
 void MainFrame::OnDetect(wxCommandEvent&) {
     if (!canvas_) return;
 
     // 1.    Canvas
-    cv::Mat img = canvas_->GetImageMat();
-    if (img.empty()) {
+    if (canvas_->GetGrayMat().empty()) {
         wxMessageBox("No image loaded", "Error", wxICON_ERROR);
         return;
     }
 
-    // 2.  
-    Detector detector;
-    auto detections = detector.run(img);
+    StartDetection();
+}
+
+void MainFrame::StartDetection() {
+    // 2.   ( )
+    worker_->Request(canvas_->GetGrayMat(), params_->GetParams(), ++generation_);
+    SetStatusText("Detecting...");
+}
+
+void MainFrame::OnDetectionDone(const DetectionWorker::Result& r) {
+    // superseded by a newer request or another image
+    if (r.generation != generation_)
+        return;
+    if (!r.error.empty()) {
+        canvas_->SetDetectedCircles({});
+        // cv::Exception messages span several lines
+        wxString msg(r.error);
+        msg.Trim();
+        msg.Replace("\n", " ");
+        SetStatusText("Detection failed: " + msg);
+        return;
+    }
+    const auto& detections = r.detections;
 
     // 3.  Detection -> Circle
     std::vector<Circle> circles;
     for (const auto& d : detections) {
         Circle c;
-        c.cx = d.bbox.x + d.bbox.width * 0.5;
-        c.cy = d.bbox.y + d.bbox.height * 0.5;
-        c.r = 0.5 * std::min(d.bbox.width, d.bbox.height);
+        c.cx = d.center.x;
+        c.cy = d.center.y;
+        c.r = d.radius;
+        c.confidence = d.confidence;
         circles.push_back(c);
     }
 
@@ -108,7 +285,7 @@ void MainFrame::OnDetect(wxCommandEvent&) {
         DetectedCircle dc;
         dc.center = cv::Point2f(c.cx, c.cy);
         dc.radius = c.r;
-        dc.score = 1.0f; //  d.confidence,  
+        dc.score = static_cast<float>(c.confidence);
         detectedEval.push_back(dc);
     }
 
@@ -137,14 +314,15 @@ void MainFrame::OnDetect(wxCommandEvent&) {
     // 5. 
     SetStatusText(
         wxString::Format(
-            "Detections=%zu | TP=%d FP=%d FN=%d | P=%.2f R=%.2f F1=%.2f",
+            "Detections=%zu | TP=%d FP=%d FN=%d | P=%.2f R=%.2f F1=%.2f | %.0f ms",
             detections.size(),
             result.TP,
             result.FP,
             result.FN,
             precision,
             recall,
-            f1
+            f1,
+            r.ms
         )
     );
 }
\ No newline at end of file
@@ -1,12 +1,22 @@
 #pragma once
 #include <wx/wx.h>
+#include <cstdint>
+#include <memory>
+#include "AutoSaver.hpp"
 #include "Canvas.hpp"
+#include "DetectionWorker.hpp"
+#include "ParamPanel.hpp"
+#include "Prefetcher.hpp"
 
 enum
 {
     ID_Open = wxID_HIGHEST + 1,
+    ID_OpenFolder,
+    ID_Next,
+    ID_Prev,
     ID_Save,
-    ID_Detect
+    ID_Detect,
+    ID_Predetect
 };
 
 class MainFrame : public wxFrame
@@ -16,11 +26,37 @@ public:
 
 private:
     void OnOpen(wxCommandEvent& evt);
+    void OnOpenFolder(wxCommandEvent& evt);
+    void OnNext(wxCommandEvent& evt);
+    void OnPrev(wxCommandEvent& evt);
     void OnSave(wxCommandEvent& evt);
     void OnExit(wxCommandEvent& evt);
     void OnDetect(wxCommandEvent& evt);
+    void OnPredetect(wxCommandEvent& evt);
+    void OnAutosaveTimer(wxTimerEvent& evt);
+    void OnClose(wxCloseEvent& evt);
+
+    // `select` is the file to show first; empty shows the first image.
+    void OpenFolder(const std::string& dir, const std::string& select);
+    void ShowImage(size_t index);
+    // Queues the labels of the current image for saving if they changed
+    // and keeps them in the prefetch cache.
+    void LeaveImage();
+    void AutosaveCurrent();
+
+    void StartDetection();
+    void OnDetectionDone(const DetectionWorker::Result& r);
 
 private:
     Canvas* canvas_ = nullptr;
+    ParamPanel* params_ = nullptr;
+    std::unique_ptr<DetectionWorker> worker_;
+    uint64_t generation_ = 0;   // results of older requests are dropped
+
+    std::unique_ptr<Prefetcher> prefetch_;
+    std::unique_ptr<AutoSaver> saver_;
+    size_t current_ = 0;        // index of the shown image in prefetch_
+    bool predetect_ = false;
+    wxTimer autosaveTimer_;
     wxDECLARE_EVENT_TABLE();
 };
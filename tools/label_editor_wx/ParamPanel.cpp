@@ -0,0 +1,44 @@
+#include "ParamPanel.hpp"
+#include <algorithm>
+#include <cmath>
+
+ParamPanel::ParamPanel(wxWindow* parent, const CoinDetector::Params& initial)
+    : wxPanel(parent, wxID_ANY), base_(initial) {
+    auto* sizer = new wxBoxSizer(wxVERTICAL);
+
+    param2_ = AddSlider(sizer, "Accumulator threshold", initial.houghParam2, 5, 150);
+    minRadius_ = AddSlider(sizer, "Min radius", initial.minRadius, 1, 400);
+    maxRadius_ = AddSlider(sizer, "Max radius", initial.maxRadius, 2, 800);
+    kernel_ = AddSlider(sizer, "Blur kernel", initial.gaussKernel, 3, 31);
+    sigma_ = AddSlider(sizer, "Blur sigma x10",
+        int(std::lround(initial.gaussSigma * 10.0)), 1, 100);
+
+    SetSizer(sizer);
+    Bind(wxEVT_SLIDER, &ParamPanel::OnSlider, this);
+}
+
+wxSlider* ParamPanel::AddSlider(wxSizer* sizer, const wxString& label,
+    int value, int minValue, int maxValue) {
+    sizer->Add(new wxStaticText(this, wxID_ANY, label), 0, wxLEFT | wxRIGHT | wxTOP, 6);
+    auto* slider = new wxSlider(this, wxID_ANY,
+        std::clamp(value, minValue, maxValue), minValue, maxValue,
+        wxDefaultPosition, wxSize(220, -1),
+        wxSL_HORIZONTAL | wxSL_VALUE_LABEL);
+    sizer->Add(slider, 0, wxEXPAND | wxLEFT | wxRIGHT, 6);
+    return slider;
+}
+
+CoinDetector::Params ParamPanel::GetParams() const {
+    CoinDetector::Params p = base_;
+    p.houghParam2 = param2_->GetValue();
+    p.minRadius = minRadius_->GetValue();
+    p.maxRadius = std::max(p.minRadius + 1, maxRadius_->GetValue());
+    p.gaussKernel = kernel_->GetValue() | 1;
+    p.gaussSigma = sigma_->GetValue() / 10.0;
+    return p;
+}
+
+void ParamPanel::OnSlider(wxCommandEvent&) {
+    if (onChange_)
+        onChange_();
+}
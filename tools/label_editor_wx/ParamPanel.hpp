@@ -0,0 +1,27 @@
+#pragma once
+#include <wx/wx.h>
+#include <functional>
+#include "coin_detector.hpp"
+
+// Sliders for the detector params worth tuning by eye. onChange fires on
+// every slider move (including while dragging).
+class ParamPanel : public wxPanel {
+public:
+    ParamPanel(wxWindow* parent, const CoinDetector::Params& initial);
+
+    CoinDetector::Params GetParams() const;
+    void SetOnChange(std::function<void()> fn) { onChange_ = std::move(fn); }
+
+private:
+    wxSlider* AddSlider(wxSizer* sizer, const wxString& label,
+        int value, int minValue, int maxValue);
+    void OnSlider(wxCommandEvent& evt);
+
+    CoinDetector::Params base_;   // fields without a slider
+    wxSlider* param2_ = nullptr;
+    wxSlider* minRadius_ = nullptr;
+    wxSlider* maxRadius_ = nullptr;
+    wxSlider* kernel_ = nullptr;
+    wxSlider* sigma_ = nullptr;   // tenths
+    std::function<void()> onChange_;
+};
@@ -0,0 +1,290 @@
+#include "Prefetcher.hpp"
+#include "TileCache.hpp"
+#include "image_view.hpp"
+#include "label_io.hpp"
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// Marks an index as being loaded (Prefetcher::loading_) until it goes out
+// of scope, then wakes the Get() calls waiting for it. Releasing it in
+// the destructor keeps Get() from waiting forever when a decode or a
+// detection throws. `lock` holds the prefetcher's mutex on entry; it may
+// be unlocked in between.
+class LoadingMark {
+public:
+    LoadingMark(std::unique_lock<std::mutex>& lock,
+        std::unordered_set<size_t>& loading, std::condition_variable& loaded,
+        size_t index)
+        : lock_(lock), loading_(loading), loaded_(loaded), index_(index) {
+    }
+    LoadingMark(const LoadingMark&) = delete;
+    LoadingMark& operator=(const LoadingMark&) = delete;
+
+    ~LoadingMark() {
+        if (!lock_.owns_lock())
+            lock_.lock();
+        loading_.erase(index_);
+        lock_.unlock();
+        loaded_.notify_all();
+    }
+
+private:
+    std::unique_lock<std::mutex>& lock_;
+    std::unordered_set<size_t>& loading_;
+    std::condition_variable& loaded_;
+    size_t index_;
+};
+
+} // namespace
+
+size_t LoadedImage::Bytes() const {
+    size_t n = gray.total() * gray.elemSize();
+    for (const auto& level : pyramid)
+        n += level.total() * level.elemSize();
+    return n;
+}
+
+std::shared_ptr<const LoadedImage> LoadImageFile(const std::string& path) {
+    // read the bytes ourselves: std::ifstream copes with non-ASCII paths
+    // on Windows, cv::imread does not
+    std::ifstream in(fs::path(path), std::ios::binary);
+    if (!in.is_open())
+        return nullptr;
+    std::vector<unsigned char> bytes((std::istreambuf_iterator<char>(in)),
+        std::istreambuf_iterator<char>());
+    cv::Mat bgr = cv::imdecode(bytes, cv::IMREAD_COLOR);
+    if (bgr.empty())
+        return nullptr;
+
+    auto img = std::make_shared<LoadedImage>();
+    img->path = path;
+    img->labelsPath = LabelsPathFor(path);
+
+    cv::Mat rgb;
+    cv::cvtColor(bgr, rgb, cv::COLOR_BGR2RGB);
+    img->pyramid = TileCache::BuildPyramid(rgb);
+    toGray(ImageView::fromMat(bgr), img->gray);
+    // edits are saved to <stem>_labels.txt; until it exists, start from
+    // whatever ground truth sits next to the image (.txt, .csv, .json)
+    img->labels = LoadLabels(findLabelsFor(path));
+    return img;
+}
+
+std::vector<std::string> ListImageFiles(const std::string& dir) {
+    std::vector<std::string> files;
+    std::error_code ec;
+    for (const auto& e : fs::directory_iterator(dir, ec)) {
+        if (!e.is_regular_file(ec))
+            continue;
+        std::string ext = e.path().extension().string();
+        std::transform(ext.begin(), ext.end(), ext.begin(),
+            [](unsigned char c) { return char(std::tolower(c)); });
+        if (ext == ".png" || ext == ".jpg" || ext == ".jpeg")
+            files.push_back(e.path().string());
+    }
+    std::sort(files.begin(), files.end());
+    return files;
+}
+
+Prefetcher::Prefetcher(size_t budgetBytes, int ahead, size_t threads)
+    : budget_(budgetBytes), ahead_(std::max(0, ahead)),
+    pool_(std::make_unique<ThreadPool>(threads, 4 * size_t(ahead_ + 2))) {
+}
+
+Prefetcher::~Prefetcher() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    // queued loads see stop_ and return; running ones finish
+    pool_.reset();
+}
+
+void Prefetcher::SetFiles(std::vector<std::string> files) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    files_ = std::move(files);
+    cache_.clear();
+    lru_.clear();
+    bytes_ = 0;
+    current_ = 0;
+    folder_++;
+}
+
+void Prefetcher::SetDetection(bool enabled, const CoinDetector::Params& params) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    detect_ = enabled;
+    params_ = params;
+    version_++;
+}
+
+uint64_t Prefetcher::DetectionVersion() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return version_;
+}
+
+std::shared_ptr<const LoadedImage> Prefetcher::Get(size_t index) {
+    if (index >= files_.size())
+        return nullptr;
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    auto cached = [&]() -> std::shared_ptr<const LoadedImage> {
+        auto it = cache_.find(index);
+        if (it == cache_.end())
+            return nullptr;
+        lru_.splice(lru_.begin(), lru_, it->second.lru);
+        return it->second.image;
+    };
+    // cached but still being detected in the background: show it now,
+    // the detection result is picked up on the next visit
+    if (auto img = cached())
+        return img;
+
+    // a background load of this image is queued or running: wait for it
+    // instead of decoding the same file twice
+    loaded_.wait(lock, [&] { return !loading_.count(index); });
+    if (auto img = cached())
+        return img;
+
+    loading_.insert(index);
+    LoadingMark mark(lock, loading_, loaded_, index);
+    const std::string path = files_[index];
+    const uint64_t folder = folder_;
+    lock.unlock();
+
+    auto img = LoadImageFile(path);
+
+    lock.lock();
+    if (img && folder == folder_)
+        Insert(index, img);
+    return img;
+}
+
+void Prefetcher::Prefetch(size_t current) {
+    std::vector<size_t> order;
+    uint64_t folder;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        current_ = current;
+        folder = folder_;
+        // forward first: that is where the user is going
+        for (int k = 1; k <= ahead_; ++k) {
+            if (current + k < files_.size())
+                order.push_back(current + k);
+        }
+        if (current > 0)
+            order.push_back(current - 1);
+        if (detect_ && current < files_.size())
+            order.insert(order.begin(), current);
+        order.erase(std::remove_if(order.begin(), order.end(),
+            [this](size_t i) { return !NeedsWork(i); }), order.end());
+        for (size_t i : order)
+            loading_.insert(i);
+    }
+
+    for (size_t i : order)
+        pool_->submit([this, i, folder] { Load(i, folder); });
+}
+
+void Prefetcher::UpdateLabels(size_t index, const std::vector<Circle>& labels) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = cache_.find(index);
+    if (it == cache_.end())
+        return;
+    // the pixels are shared with the old entry, only the labels differ
+    auto img = std::make_shared<LoadedImage>(*it->second.image);
+    img->labels = labels;
+    it->second.image = std::move(img);
+}
+
+bool Prefetcher::InWindow(size_t index) const {
+    return index + 1 >= current_ && index <= current_ + size_t(ahead_);
+}
+
+bool Prefetcher::NeedsWork(size_t index) const {
+    if (loading_.count(index))
+        return false;
+    auto it = cache_.find(index);
+    if (it == cache_.end())
+        return true;
+    const LoadedImage& img = *it->second.image;
+    return detect_ && !(img.detections && img.detectionVersion == version_);
+}
+
+void Prefetcher::Load(size_t index, uint64_t folder) {
+    // Prefetch() marked the index; a throwing decode or detection
+    // still releases it (the exception ends up in the discarded future)
+    std::unique_lock<std::mutex> lock(mutex_);
+    LoadingMark mark(lock, loading_, loaded_, index);
+
+    // the user moved on (or to another folder) while this was queued
+    if (stop_ || folder != folder_ || !InWindow(index))
+        return;
+
+    std::shared_ptr<const LoadedImage> cached;
+    if (auto it = cache_.find(index); it != cache_.end())
+        cached = it->second.image;
+    const std::string path = files_[index];
+    const bool detect = detect_;
+    const CoinDetector::Params params = params_;
+    const uint64_t version = version_;
+    lock.unlock();
+
+    std::shared_ptr<LoadedImage> img;
+    if (cached) {
+        img = std::make_shared<LoadedImage>(*cached);
+    }
+    else if (auto loaded = LoadImageFile(path)) {
+        img = std::make_shared<LoadedImage>(*loaded);
+    }
+
+    if (img && detect) {
+        auto t0 = std::chrono::steady_clock::now();
+        img->detections = Detector(params).run(img->gray);
+        img->detectionVersion = version;
+        img->detectionMs = std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - t0).count();
+    }
+
+    lock.lock();
+    if (img && folder == folder_) {
+        // labels edited while we were detecting win over ours
+        if (auto it = cache_.find(index); it != cache_.end())
+            img->labels = it->second.image->labels;
+        Insert(index, std::move(img));
+    }
+}
+
+void Prefetcher::Insert(size_t index, std::shared_ptr<const LoadedImage> image) {
+    auto it = cache_.find(index);
+    if (it != cache_.end()) {
+        bytes_ -= it->second.image->Bytes();
+        lru_.erase(it->second.lru);
+        cache_.erase(it);
+    }
+    bytes_ += image->Bytes();
+    lru_.push_front(index);
+    cache_[index] = Slot{ std::move(image), lru_.begin() };
+    Evict();
+}
+
+void Prefetcher::Evict() {
+    auto it = lru_.end();
+    while (bytes_ > budget_ && it != lru_.begin()) {
+        --it;
+        if (*it == current_)
+            continue;
+        auto slot = cache_.find(*it);
+        bytes_ -= slot->second.image->Bytes();
+        cache_.erase(slot);
+        it = lru_.erase(it);
+    }
+}
@@ -0,0 +1,112 @@
+#pragma once
+#include <opencv2/core.hpp>
+#include <condition_variable>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "Detector.hpp"
+#include "LabelIO.hpp"
+#include "thread_pool.hpp"
+
+// One dataset image decoded and ready to show: the tile pyramid for the
+// canvas (level 0 is RGB at full size), gray for the detector, and the
+// labels file next to it. Shared read-only between the cache, the
+// canvas and detections, so none of it is ever written after loading.
+struct LoadedImage {
+    std::string path;
+    std::string labelsPath;
+    std::vector<cv::Mat> pyramid;
+    cv::Mat gray;
+    std::vector<Circle> labels;
+
+    // Filled when the image was detected ahead of time, with the
+    // Prefetcher's detection version at that moment.
+    std::optional<std::vector<Detection>> detections;
+    uint64_t detectionVersion = 0;
+    double detectionMs = 0.0;
+
+    cv::Size Size() const { return pyramid.empty() ? cv::Size() : pyramid[0].size(); }
+    size_t Bytes() const;
+};
+
+// Decodes an image and reads its labels. Returns nullptr if the image
+// cannot be read.
+std::shared_ptr<const LoadedImage> LoadImageFile(const std::string& path);
+
+// .png/.jpg/.jpeg files in `dir`, sorted by name.
+std::vector<std::string> ListImageFiles(const std::string& dir);
+
+// Keeps the images around the current one of a folder decoded. After
+// Prefetch(i) background threads load i+1 .. i+ahead and i-1, newest
+// request first, optionally running the detector on them too. Loaded
+// images live in an LRU cache bounded by a byte budget; the current
+// image is never evicted.
+class Prefetcher {
+public:
+    Prefetcher(size_t budgetBytes, int ahead, size_t threads = 2);
+    ~Prefetcher();
+
+    Prefetcher(const Prefetcher&) = delete;
+    Prefetcher& operator=(const Prefetcher&) = delete;
+
+    // Replaces the file list and drops everything cached.
+    void SetFiles(std::vector<std::string> files);
+    size_t Size() const { return files_.size(); }
+    const std::string& File(size_t index) const { return files_[index]; }
+
+    // With `enabled`, prefetched images are also detected with `params`.
+    // Every call starts a new detection version, so results computed
+    // with older params are recognisable as stale.
+    void SetDetection(bool enabled, const CoinDetector::Params& params);
+    uint64_t DetectionVersion() const;
+
+    // The image at `index`: from the cache, by waiting for a background
+    // load already in flight, or by decoding it on the calling thread.
+    std::shared_ptr<const LoadedImage> Get(size_t index);
+
+    // Makes `current` the pinned image and queues loads around it.
+    void Prefetch(size_t current);
+
+    // Replaces the cached labels of `index` after they were edited, so
+    // coming back to it does not show the version read from disk.
+    void UpdateLabels(size_t index, const std::vector<Circle>& labels);
+
+private:
+    struct Slot {
+        std::shared_ptr<const LoadedImage> image;
+        std::list<size_t>::iterator lru;
+    };
+
+    bool InWindow(size_t index) const;
+    bool NeedsWork(size_t index) const;
+    void Load(size_t index, uint64_t folder);
+    void Insert(size_t index, std::shared_ptr<const LoadedImage> image);
+    void Evict();
+
+    const size_t budget_;
+    const int ahead_;
+
+    std::vector<std::string> files_;   // changed only on the GUI thread
+
+    mutable std::mutex mutex_;
+    std::condition_variable loaded_;
+    std::unordered_map<size_t, Slot> cache_;
+    std::list<size_t> lru_;            // most recent first
+    std::unordered_set<size_t> loading_;
+    size_t bytes_ = 0;
+    size_t current_ = 0;
+    uint64_t folder_ = 0;              // bumped by SetFiles
+    bool stop_ = false;
+
+    bool detect_ = false;
+    CoinDetector::Params params_;
+    uint64_t version_ = 1;
+
+    std::unique_ptr<ThreadPool> pool_; // last: joined before the rest goes
+};
@@ -0,0 +1,83 @@
+#include "TileCache.hpp"
+#include <opencv2/imgproc.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+void TileCache::Reset(const unsigned char* rgb, int width, int height) {
+    if (!rgb || width <= 0 || height <= 0) {
+        Reset(std::vector<cv::Mat>{});
+        return;
+    }
+    Reset(BuildPyramid(cv::Mat(height, width, CV_8UC3,
+        const_cast<unsigned char*>(rgb))));
+}
+
+void TileCache::Reset(std::vector<cv::Mat> levels) {
+    Clear();
+    levels_ = std::move(levels);
+}
+
+std::vector<cv::Mat> TileCache::BuildPyramid(const cv::Mat& rgb) {
+    std::vector<cv::Mat> levels;
+    if (rgb.empty())
+        return levels;
+
+    levels.push_back(rgb);
+    while (std::max(levels.back().cols, levels.back().rows) > kTileSize) {
+        const cv::Mat& prev = levels.back();
+        cv::Mat next;
+        cv::resize(prev, next,
+            cv::Size(std::max(1, prev.cols / 2), std::max(1, prev.rows / 2)),
+            0, 0, cv::INTER_AREA);
+        levels.push_back(next);
+    }
+    return levels;
+}
+
+void TileCache::Clear() {
+    tiles_.clear();
+    lru_.clear();
+}
+
+int TileCache::LevelFor(double zoom) const {
+    if (levels_.empty() || zoom >= 1.0)
+        return 0;
+    int level = int(std::floor(std::log2(1.0 / zoom)));
+    return std::clamp(level, 0, Levels() - 1);
+}
+
+cv::Size TileCache::LevelSize(int level) const {
+    return levels_[level].size();
+}
+
+const wxBitmap& TileCache::Get(int level, int tx, int ty) {
+    const Key key = MakeKey(level, tx, ty);
+    auto it = tiles_.find(key);
+    if (it != tiles_.end()) {
+        lru_.splice(lru_.begin(), lru_, it->second.lru);
+        return it->second.bitmap;
+    }
+
+    const cv::Mat& src = levels_[level];
+    cv::Rect r(tx * kTileSize, ty * kTileSize, kTileSize, kTileSize);
+    r &= cv::Rect(0, 0, src.cols, src.rows);
+
+    wxImage tile(r.width, r.height, false);
+    unsigned char* dst = tile.GetData();
+    for (int y = 0; y < r.height; ++y) {
+        std::memcpy(dst + size_t(y) * r.width * 3,
+            src.ptr<unsigned char>(r.y + y) + size_t(r.x) * 3,
+            size_t(r.width) * 3);
+    }
+
+    if (tiles_.size() >= maxTiles_ && !lru_.empty()) {
+        tiles_.erase(lru_.back());
+        lru_.pop_back();
+    }
+    lru_.push_front(key);
+    auto& e = tiles_[key];
+    e.bitmap = wxBitmap(tile);
+    e.lru = lru_.begin();
+    return e.bitmap;
+}
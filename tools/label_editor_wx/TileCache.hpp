@@ -0,0 +1,53 @@
+#pragma once
+#include <wx/wx.h>
+#include <opencv2/core.hpp>
+#include <cstdint>
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+// Multi-resolution tiles of one image for drawing at any zoom. Level 0
+// is the image itself, each further level halves it, down to a single
+// tile. Tiles are converted to wxBitmap on first use and kept in an LRU
+// cache of at most `maxTiles`, so only the tiles around what was
+// recently on screen occupy bitmap memory.
+class TileCache {
+public:
+    static constexpr int kTileSize = 256;
+
+    explicit TileCache(size_t maxTiles = 384) : maxTiles_(maxTiles) {}
+
+    // `rgb` is packed 8-bit RGB (wxImage data) and must stay alive while
+    // the cache is used. Clears all cached tiles.
+    void Reset(const unsigned char* rgb, int width, int height);
+    // Same, with a pyramid already built by BuildPyramid (e.g. off the
+    // GUI thread). The level Mats are shared, not copied.
+    void Reset(std::vector<cv::Mat> levels);
+    void Clear();
+
+    static std::vector<cv::Mat> BuildPyramid(const cv::Mat& rgb);
+
+    int Levels() const { return int(levels_.size()); }
+    // Coarsest level that still has at least one pixel per screen pixel
+    // at `zoom` (screen pixels per image pixel).
+    int LevelFor(double zoom) const;
+    cv::Size LevelSize(int level) const;
+
+    const wxBitmap& Get(int level, int tx, int ty);
+
+private:
+    using Key = uint64_t;
+    static Key MakeKey(int level, int tx, int ty) {
+        return (Key(level) << 48) | (Key(uint32_t(ty)) << 24) | Key(uint32_t(tx));
+    }
+
+    struct Entry {
+        wxBitmap bitmap;
+        std::list<Key>::iterator lru;
+    };
+
+    std::vector<cv::Mat> levels_;   // RGB; level 0 borrows the caller's pixels
+    std::unordered_map<Key, Entry> tiles_;
+    std::list<Key> lru_;            // most recent first
+    size_t maxTiles_;
+};
@@ -0,0 +1,194 @@
+#include "dataset_pack.hpp"
+#include "image_io.hpp"
+#include "label_io.hpp"
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <future>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+// ============================================================
+// coins_pack: decodes a labelled folder once into a .pack file
+// (see dataset_pack.hpp) that coin_detector --batch and
+// coins_autotune read without decoding anything.
+// ============================================================
+
+struct PackItem {
+    fs::path path;
+    std::string name;                   // relative to the root, '/' separated
+    cv::Mat gray;
+    std::vector<LabelCircle> labels;
+    bool hasLabels = false;
+};
+
+// The images coin_detector --batch reads from the folder: only its own
+// files unless `recursive` (both tools take --recursive).
+static std::vector<PackItem> listImages(const fs::path& root, bool recursive) {
+    std::vector<PackItem> out;
+    auto add = [&](const fs::directory_entry& e) {
+        if (!e.is_regular_file())
+            return;
+        std::string ext = e.path().extension().string();
+        if (ext != ".jpg" && ext != ".png" && ext != ".jpeg")
+            return;
+        std::string stem = e.path().stem().string();
+        if (stem.size() >= 9 &&
+            stem.compare(stem.size() - 9, 9, "_detected") == 0)
+            return;
+
+        PackItem item;
+        item.path = e.path();
+        item.name = fs::relative(e.path(), root).generic_string();
+        out.push_back(std::move(item));
+    };
+    if (recursive) {
+        for (const auto& e : fs::recursive_directory_iterator(root))
+            add(e);
+    }
+    else {
+        for (const auto& e : fs::directory_iterator(root))
+            add(e);
+    }
+    std::sort(out.begin(), out.end(),
+        [](const PackItem& a, const PackItem& b) { return a.name < b.name; });
+    return out;
+}
+
+// Same decode as the coin_detector batch mode, so results on a pack
+// match results on the folder.
+static void decode(PackItem& item) {
+    item.gray = readGray(item.path.string());
+
+    std::string labels = findLabelsFor(item.path.string());
+    item.hasLabels = !labels.empty() && readLabels(labels, item.labels);
+}
+
+static void usage() {
+    std::cout
+        << "Usage:\n"
+        << "  coins_pack <labelled_folder> <out.pack> [options]\n"
+        << "Options:\n"
+        << "  --compress   store planes as PNG (smaller, decoded on read)\n"
+        << "  --recursive  include subfolders (coin_detector --batch needs\n"
+        << "               --recursive too; coins_autotune always recurses)\n"
+        << "  --jobs N     decode threads (default: all cores)\n"
+        << "\n"
+        << "Read it with: coin_detector <out.pack> --batch\n"
+        << "              coins_autotune <out.pack>\n";
+}
+
+int main(int argc, char** argv) {
+    fs::path root, outPath;
+    bool compress = false;
+    bool recursive = false;
+    int jobs = 0;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string a = argv[i];
+        if (a == "--compress") {
+            compress = true;
+        }
+        else if (a == "--recursive") {
+            recursive = true;
+        }
+        else if (a == "--jobs" && i + 1 < argc) {
+            jobs = std::atoi(argv[++i]);
+        }
+        else if (a == "--help" || a == "-h") {
+            usage();
+            return 0;
+        }
+        else if (a.rfind("--", 0) != 0 && root.empty()) {
+            root = a;
+        }
+        else if (a.rfind("--", 0) != 0 && outPath.empty()) {
+            outPath = a;
+        }
+        else {
+            std::cerr << "Unknown arg: " << a << "\n";
+            usage();
+            return 2;
+        }
+    }
+
+    if (root.empty() || outPath.empty()) {
+        usage();
+        return 2;
+    }
+    if (!fs::is_directory(root)) {
+        std::cerr << "Not a directory: " << root << "\n";
+        return 2;
+    }
+
+    auto t0 = std::chrono::steady_clock::now();
+    auto items = listImages(root, recursive);
+    if (items.empty()) {
+        std::cerr << "No images under " << root << "\n";
+        return 3;
+    }
+
+    DatasetPackWriter writer;
+    if (!writer.open(outPath.string(), compress)) {
+        std::cerr << "Error: can't open out file: " << outPath << "\n";
+        return 4;
+    }
+
+    if (jobs <= 0)
+        jobs = int(std::max(1u, std::thread::hardware_concurrency()));
+    ThreadPool pool{ size_t(jobs), size_t(jobs) * 4 };
+
+    // decode a window of images in parallel, write them in order, then
+    // drop their pixels: memory stays at a few frames per thread
+    size_t written = 0, labelled = 0, circles = 0, failed = 0;
+    const size_t window = size_t(jobs) * 2;
+    for (size_t begin = 0; begin < items.size(); begin += window) {
+        const size_t end = std::min(items.size(), begin + window);
+        std::vector<std::future<void>> done;
+        for (size_t i = begin; i < end; ++i)
+            done.push_back(pool.submit([&item = items[i]] { decode(item); }));
+        for (auto& f : done)
+            f.get();
+
+        for (size_t i = begin; i < end; ++i) {
+            PackItem& item = items[i];
+            if (item.gray.empty()) {
+                std::cerr << "Cannot open image: " << item.path << "\n";
+                failed++;
+                continue;
+            }
+            if (!writer.add(item.name, item.gray, item.hasLabels ? &item.labels : nullptr)) {
+                std::cerr << "Error: write failed: " << outPath << "\n";
+                return 4;
+            }
+            written++;
+            if (item.hasLabels) {
+                labelled++;
+                circles += item.labels.size();
+            }
+            item.gray.release();
+        }
+    }
+
+    if (!writer.finish()) {
+        std::cerr << "Error: write failed: " << outPath << "\n";
+        return 4;
+    }
+
+    double sec = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - t0).count();
+    std::cout << "Packed " << written << " images (" << labelled << " labelled, "
+        << circles << " circles";
+    if (failed)
+        std::cout << ", " << failed << " failed";
+    std::cout << ") into " << outPath << ": "
+        << double(writer.bytes()) / (1024.0 * 1024.0) << " MB"
+        << (compress ? " (png)" : "") << " in " << sec << " s\n";
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,232 @@
+#include "coin_classifier.hpp"
+#include "label_io.hpp"
+#include <opencv2/imgcodecs.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+// ============================================================
+// coins_train: fits the denomination classifier (see
+// coin_classifier.hpp) to a labelled folder.
+//
+// Every image needs its circle labels (as found by findLabelsFor) and
+// <stem>_classes.txt: one class name per line, in the order of the
+// circles in the label file. Images with several denominations train
+// the relative-radius feature; single-denomination photos do not.
+// ============================================================
+
+static std::vector<fs::path> listImages(const fs::path& root) {
+    std::vector<fs::path> out;
+    for (const auto& e : fs::recursive_directory_iterator(root)) {
+        if (!e.is_regular_file())
+            continue;
+        std::string ext = e.path().extension().string();
+        if (ext != ".jpg" && ext != ".png" && ext != ".jpeg")
+            continue;
+        std::string stem = e.path().stem().string();
+        if (stem.size() >= 9 &&
+            stem.compare(stem.size() - 9, 9, "_detected") == 0)
+            continue;
+        out.push_back(e.path());
+    }
+    std::sort(out.begin(), out.end());
+    return out;
+}
+
+// Class names, one per non-empty line; '#' starts a comment.
+static bool readClassNames(const fs::path& path, std::vector<std::string>& out) {
+    std::ifstream f(path);
+    if (!f)
+        return false;
+    out.clear();
+    std::string line;
+    while (std::getline(f, line)) {
+        line = line.substr(0, line.find('#'));
+        size_t b = line.find_first_not_of(" \t\r");
+        size_t e = line.find_last_not_of(" \t\r");
+        if (b != std::string::npos)
+            out.push_back(line.substr(b, e - b + 1));
+    }
+    return true;
+}
+
+static void usage() {
+    std::cout
+        << "Usage:\n"
+        << "  coins_train <labelled_folder> <out.yml> [options]\n"
+        << "Options:\n"
+        << "  --model M          centroid (default) or linear\n"
+        << "  --value NAME=V     monetary value of class NAME (repeatable;\n"
+        << "                     default 0), summed per image by the detector\n"
+        << "\n"
+        << "Each image needs labels and <stem>_classes.txt with one class\n"
+        << "name per circle, in label order.\n"
+        << "Use it with: coin_detect_cli --image <img> --classifier <out.yml>\n";
+}
+
+int main(int argc, char** argv) {
+    fs::path root, outPath;
+    CoinClassifier::Model model = CoinClassifier::Model::NearestCentroid;
+    std::map<std::string, double> values;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string a = argv[i];
+        if (a == "--model" && i + 1 < argc) {
+            std::string m = argv[++i];
+            if (m == "centroid")
+                model = CoinClassifier::Model::NearestCentroid;
+            else if (m == "linear")
+                model = CoinClassifier::Model::Linear;
+            else {
+                std::cerr << "Unknown model: " << m << "\n";
+                return 2;
+            }
+        }
+        else if (a == "--value" && i + 1 < argc) {
+            std::string v = argv[++i];
+            size_t eq = v.find('=');
+            if (eq == std::string::npos || eq == 0) {
+                std::cerr << "Expected NAME=VALUE: " << v << "\n";
+                return 2;
+            }
+            values[v.substr(0, eq)] = std::atof(v.c_str() + eq + 1);
+        }
+        else if (a == "--help" || a == "-h") {
+            usage();
+            return 0;
+        }
+        else if (a.rfind("--", 0) != 0 && root.empty()) {
+            root = a;
+        }
+        else if (a.rfind("--", 0) != 0 && outPath.empty()) {
+            outPath = a;
+        }
+        else {
+            std::cerr << "Unknown arg: " << a << "\n";
+            usage();
+            return 2;
+        }
+    }
+
+    if (root.empty() || outPath.empty()) {
+        usage();
+        return 2;
+    }
+    if (!fs::is_directory(root)) {
+        std::cerr << "Not a directory: " << root << "\n";
+        return 2;
+    }
+
+    // --------------------------------------------------------
+    // Features of every labelled coin
+    // --------------------------------------------------------
+    std::map<std::string, int> classIndex;
+    std::vector<std::string> classNames;
+    std::vector<int> labels;
+    cv::Mat features(0, kCoinFeatures, CV_32F);
+    cv::Mat imageFeatures;
+    size_t images = 0, skipped = 0;
+    double extractMs = 0.0;
+
+    for (const auto& path : listImages(root)) {
+        std::string labelPath = findLabelsFor(path.string());
+        fs::path classPath = path.parent_path() / (path.stem().string() + "_classes.txt");
+        std::vector<LabelCircle> circles;
+        std::vector<std::string> names;
+        if (labelPath.empty() || !readLabels(labelPath, circles) ||
+            !readClassNames(classPath, names)) {
+            skipped++;
+            continue;
+        }
+        if (names.size() != circles.size()) {
+            std::cerr << "Skipping " << path << ": " << circles.size()
+                << " circles but " << names.size() << " class names\n";
+            skipped++;
+            continue;
+        }
+
+        cv::Mat img = cv::imread(path.string(), cv::IMREAD_COLOR);
+        if (img.empty()) {
+            std::cerr << "Cannot open image: " << path << "\n";
+            skipped++;
+            continue;
+        }
+
+        std::vector<DetectedCircle> dets;
+        for (const auto& c : circles)
+            dets.push_back({ cv::Point2f(c.cx, c.cy), c.r, 1.0f });
+
+        auto t0 = std::chrono::steady_clock::now();
+        extractCoinFeatures(ImageView::fromMat(img), dets, imageFeatures);
+        extractMs += std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - t0).count();
+        features.push_back(imageFeatures);
+
+        for (const auto& n : names) {
+            auto it = classIndex.find(n);
+            if (it == classIndex.end()) {
+                it = classIndex.emplace(n, int(classNames.size())).first;
+                classNames.push_back(n);
+            }
+            labels.push_back(it->second);
+        }
+        images++;
+    }
+
+    if (labels.empty()) {
+        std::cerr << "No labelled coins with class names under " << root << "\n";
+        return 3;
+    }
+
+    // --------------------------------------------------------
+    // Fit, check on the training set, save
+    // --------------------------------------------------------
+    std::vector<CoinClassifier::CoinClass> classes;
+    for (const auto& n : classNames) {
+        auto v = values.find(n);
+        classes.push_back({ n, v != values.end() ? v->second : 0.0 });
+    }
+    for (const auto& [name, value] : values) {
+        if (!classIndex.count(name))
+            std::cerr << "Warning: --value for unknown class " << name << "\n";
+    }
+
+    CoinClassifier classifier = CoinClassifier::train(features, labels, classes, model);
+
+    std::vector<int> predicted;
+    classifier.classify(features, predicted);
+    std::vector<int> total(classes.size(), 0), correct(classes.size(), 0);
+    for (size_t i = 0; i < labels.size(); ++i) {
+        total[labels[i]]++;
+        if (predicted[i] == labels[i])
+            correct[labels[i]]++;
+    }
+
+    if (!classifier.save(outPath.string())) {
+        std::cerr << "Error: can't write model: " << outPath << "\n";
+        return 4;
+    }
+
+    std::cout << "Trained on " << labels.size() << " coins from " << images << " images";
+    if (skipped)
+        std::cout << " (" << skipped << " skipped)";
+    std::cout << "\n";
+    int allCorrect = 0;
+    for (size_t k = 0; k < classes.size(); ++k) {
+        std::cout << "  " << classes[k].name << " (value " << classes[k].value << "): "
+            << correct[k] << "/" << total[k] << " correct on the training set\n";
+        allCorrect += correct[k];
+    }
+    std::cout << "Training accuracy " << double(allCorrect) / double(labels.size())
+        << ", features " << extractMs * 1000.0 / double(labels.size()) << " us/coin\n"
+        << "Saved " << outPath << "\n";
+    return 0;
+}